@@ -0,0 +1,325 @@
+#!/bin/bash
+
+################################################################################
+# READ ME                                                                      #
+#------------------------------------------------------------------------------#
+# MOTIVATION                                                                   #
+# run.sh launches one configuration and tells how long it took. To know where  #
+# a version stands, and to spot regressions across compilers and nodes, we     #
+# need many configurations measured the same way, and numbers that compare:    #
+# - time per iteration, since sizes do not converge after as many iterations   #
+# - lattice updates per second (GLUP/s), and the memory bandwidth it implies   #
+# - that bandwidth against the triad of STREAM, measured in the same job       #
+# - strong and weak scaling efficiencies across processes and threads          #
+# This script sweeps the configurations given, runs each of them and writes    #
+# the results to a CSV file and to a JSON file.                                #
+#                                                                              #
+# PARAMETERS                                                                   #
+# 1) Language: one of 'C' | 'FORTRAN'                                          #
+# 2) Technologies: comma-separated list of 'serial' | 'openmp' | 'mpi' |       #
+#    'openacc' | 'hybrid_cpu' | 'hybrid_gpu'                                   #
+# 3) Sizes: comma-separated list of 'small' | 'big' | any number of rows and   #
+#    columns. For 'small' and 'big' the binaries built by the makefile are     #
+#    run, with the number of MPI processes they are meant for. For numbers, a  #
+#    binary is built with 'make benchmark_binary' for each number of MPI       #
+#    processes, which must divide the size.                                    #
+# 4) Processes: comma-separated list of numbers of MPI processes, used by the  #
+#    MPI technologies on numbered sizes only.                                  #
+# 5) Threads: comma-separated list of numbers of OpenMP threads, used by the   #
+#    OpenMP technologies only.                                                 #
+# 6) Output prefix: the results go to PREFIX.csv and PREFIX.json, the output   #
+#    of each run to the folder PREFIX_logs.                                    #
+#                                                                              #
+# ENVIRONMENT VARIABLES                                                        #
+# - REPETITIONS: number of runs per configuration, 1 by default.               #
+# - BYTES_PER_UPDATE: bytes moved from memory per cell update, 40 by default:  #
+#   the default versions read and write each grid once per sweep, in two       #
+#   sweeps. Lower it for FUSED_SWAP (24) or IN_PLACE (16) builds.              #
+# - NODES: number of nodes the runs span, SLURM_JOB_NUM_NODES or 1 by default. #
+#   The bandwidth of STREAM, measured on one node, is scaled by it.            #
+# - EXTRA_DEFINES: optional modes for the binaries built, as in the makefile.  #
+# - MPI_LAUNCHER: the command launching MPI processes, "mpirun -n" by default. #
+# - MPI_OPTIONS: options passed to it, "-mca btl ^openib" when not set.        #
+# - MPI_EXPORT: the option passing OMP_NUM_THREADS on to the MPI processes,    #
+#   "-x OMP_NUM_THREADS" with the default launcher and none otherwise.         #
+#   OMP_NUM_THREADS is set in the environment of the launcher either way,      #
+#   which MPICH, Intel MPI and srun pass on by themselves.                     #
+# - COMPILER: the compiler whose version is recorded, pgcc by default.         #
+#                                                                              #
+# EXAMPLES                                                                     #
+# ./benchmark.sh C mpi,hybrid_cpu big 1 14,28 results/big                      #
+# ./benchmark.sh C mpi 2048,4096,8192 1,2,4,8,16 1 results/mpi_scaling         #
+# REPETITIONS=3 ./benchmark.sh C openmp 4096 1 1,2,4,7,14,28 results/openmp    #
+################################################################################
+
+function echo_good
+{
+	echo -e "\033[32m$1\033[0m\c"
+}
+
+function echo_bad
+{
+	echo -e "\033[31m$1\033[0m\c"
+}
+
+function echo_success
+{
+	echo_good "[SUCCESS]"
+	echo " $1"
+}
+
+function echo_failure
+{
+	echo_bad "[FAILURE]"
+	echo " $1"
+	exit -1
+}
+
+function echo_result
+{
+	echo -e "\033[33m[RESULT]\033[0m $1"
+}
+
+# Function taken from Meta Stack Overflow (https://meta.stackoverflow.com)
+# Author: Glenn Jackman (profile: https://stackoverflow.com/users/7552/glenn-jackman)
+# Original article: https://stackoverflow.com/a/14367368
+function is_in_array
+{
+    local array="$1[@]"
+    local seeking=$2
+    local in=1
+    for element in "${!array}"; do
+        if [[ $element == $seeking ]]; then
+            in=0
+            break
+        fi
+    done
+    return $in
+}
+
+######################
+# Display quick help #
+######################
+echo "Quick help:";
+echo -e "\t- This script is meant to be run as follows: './benchmark.sh LANGUAGE IMPLEMENTATIONS SIZES PROCESSES THREADS OUTPUT_PREFIX'";
+echo -e "\t- LANGUAGE = 'C' | 'FORTRAN'";
+echo -e "\t- IMPLEMENTATIONS = comma-separated list of 'serial' | 'openmp' | 'mpi' | 'hybrid_cpu' | 'openacc' | 'hybrid_gpu'";
+echo -e "\t- SIZES = comma-separated list of 'small' | 'big' | number of rows and columns";
+echo -e "\t- PROCESSES = comma-separated list of numbers of MPI processes, for numbered sizes";
+echo -e "\t- THREADS = comma-separated list of numbers of OpenMP threads";
+echo -e "\t- OUTPUT_PREFIX = where to write PREFIX.csv, PREFIX.json and the logs of the runs in PREFIX_logs";
+echo -e "\t- Example: to sweep the C MPI version on the big grid and two custom sizes, run './benchmark.sh C mpi big,2048,4096 8,16 1 results/mpi'.\n";
+
+#################################
+# Check the number of arguments #
+#################################
+if [ "$#" -eq "6" ]; then
+	echo_success "Correct number of arguments received."
+else
+	echo_failure "Wrong number of arguments received: please refer to the quick help above."
+fi
+
+#############################################
+# Check that the language passed is correct #
+#############################################
+languages=("C" "FORTRAN");
+all_languages=`echo ${languages[@]}`;
+is_in_array languages $1
+language_retrieved=$?;
+if [ "${language_retrieved}" == "0" ]; then
+	echo_success "The language passed is correct.";
+else
+	echo_failure "The language '$1' is unknown. It must be one of: ${all_languages}.";
+fi
+language=$1
+
+#####################################################
+# Check that the implementations passed are correct #
+#####################################################
+implementations=("serial" "openmp" "mpi" "hybrid_cpu" "openacc" "hybrid_gpu");
+all_implementations=`echo ${implementations[@]}`;
+IFS=',' read -r -a implementations_passed <<< "$2"
+for implementation in "${implementations_passed[@]}"; do
+	is_in_array implementations ${implementation}
+	if [ "$?" != "0" ]; then
+		echo_failure "The implementation '${implementation}' is unknown. It must be one of: ${all_implementations}.";
+	fi
+done
+echo_success "The implementations passed are correct.";
+
+###########################################################
+# Check that the sizes, processes and threads are correct #
+###########################################################
+IFS=',' read -r -a sizes_passed <<< "$3"
+for size in "${sizes_passed[@]}"; do
+	if [ "${size}" != "small" ] && [ "${size}" != "big" ] && ! [[ "${size}" =~ ^[1-9][0-9]*$ ]]; then
+		echo_failure "The size '${size}' is unknown. It must be 'small', 'big' or a number of rows and columns.";
+	fi
+done
+IFS=',' read -r -a processes_passed <<< "$4"
+IFS=',' read -r -a threads_passed <<< "$5"
+for count in "${processes_passed[@]}" "${threads_passed[@]}"; do
+	if ! [[ "${count}" =~ ^[1-9][0-9]*$ ]]; then
+		echo_failure "The number of processes or threads '${count}' is not a positive number.";
+	fi
+done
+echo_success "The sizes, processes and threads passed are correct.";
+
+output_prefix=$6
+logs_directory="${output_prefix}_logs"
+mkdir -p "${logs_directory}" || echo_failure "The folder ${logs_directory} could not be created."
+csv_file="${output_prefix}.csv"
+json_file="${output_prefix}.json"
+
+repetitions=${REPETITIONS:-1}
+bytes_per_update=${BYTES_PER_UPDATE:-40}
+nodes=${NODES:-${SLURM_JOB_NUM_NODES:-1}}
+mpi_launcher=${MPI_LAUNCHER:-"mpirun -n"}
+mpi_options=${MPI_OPTIONS-"-mca btl ^openib"}
+# Only OpenMPI, the launcher by default, needs to be told which variables to pass on
+if [ -z "${MPI_LAUNCHER}" ]; then
+	mpi_export=${MPI_EXPORT-"-x OMP_NUM_THREADS"}
+else
+	mpi_export=${MPI_EXPORT-""}
+fi
+compiler=${COMPILER:-pgcc}
+
+##################################
+# Record what the results run on #
+##################################
+# Commas would split the fields of the CSV file
+run_date=`date -u +%Y-%m-%dT%H:%M:%SZ`
+run_host=`hostname | tr ',' ';'`
+run_commit=`git rev-parse --short HEAD 2>/dev/null || echo "unknown"`
+run_compiler=`${compiler} --version 2>/dev/null | grep -m 1 -v '^$' | tr ',' ';'`
+run_defines=`echo "${EXTRA_DEFINES}" | tr ',' ';'`
+
+##################################################
+# Measure the memory bandwidth of a node: STREAM #
+##################################################
+stream_binary="./bin/benchmark/stream"
+if [ ! -f "${stream_binary}" ]; then
+	make benchmark_stream > "${logs_directory}/stream_build.txt" 2>&1 || echo_failure "The STREAM triad could not be built, see ${logs_directory}/stream_build.txt."
+fi
+OMP_NUM_THREADS=${OMP_NUM_THREADS:-`nproc`} ${stream_binary} > "${logs_directory}/stream.txt" 2>&1 || echo_failure "The STREAM triad failed, see ${logs_directory}/stream.txt."
+stream_bandwidth=`sed -n 's/.* was \([0-9.]*\) GB\/s\./\1/p' "${logs_directory}/stream.txt"`
+stream_bandwidth=`awk -v b="${stream_bandwidth}" -v n="${nodes}" 'BEGIN { printf "%.3f", b * n }'`
+echo_result "STREAM triad bandwidth over ${nodes} node(s): ${stream_bandwidth} GB/s."
+
+#####################################
+# Run every configuration requested #
+#####################################
+echo "language,implementation,size,processes,threads,repetition,iterations,total_seconds,seconds_per_iteration,glups,bandwidth_gbs,stream_gbs,bandwidth_fraction,date,host,commit,compiler,extra_defines" > "${csv_file}"
+
+for implementation in "${implementations_passed[@]}"; do
+	for size in "${sizes_passed[@]}"; do
+		# The MPI processes and OpenMP threads this technology uses
+		case ${implementation} in
+			serial|openacc) process_counts=(1); thread_counts=(1);;
+			openmp) process_counts=(1); thread_counts=("${threads_passed[@]}");;
+			mpi|hybrid_gpu) process_counts=("${processes_passed[@]}"); thread_counts=(1);;
+			hybrid_cpu) process_counts=("${processes_passed[@]}"); thread_counts=("${threads_passed[@]}");;
+		esac
+		# The binaries of the makefile are meant for a given number of MPI processes, like run.sh launches them
+		if [ "${size}" == "small" ] || [ "${size}" == "big" ]; then
+			case ${implementation}_${size} in
+				mpi_small) process_counts=(4);;
+				mpi_big) process_counts=(112);;
+				hybrid_cpu_small|hybrid_gpu_small) process_counts=(2);;
+				hybrid_cpu_big|hybrid_gpu_big) process_counts=(8);;
+			esac
+		fi
+
+		for processes in "${process_counts[@]}"; do
+			if [ "${size}" == "small" ]; then
+				global=672
+				executable="./bin/${language}/${implementation}_small"
+			elif [ "${size}" == "big" ]; then
+				global=14560
+				executable="./bin/${language}/${implementation}_big"
+			else
+				global=${size}
+				executable="./bin/benchmark/${language}_${implementation}_${size}_${processes}"
+				if [ ! -f "${executable}" ]; then
+					make benchmark_binary BENCHMARK_LANGUAGE=${language} BENCHMARK_IMPLEMENTATION=${implementation} BENCHMARK_GLOBAL=${size} BENCHMARK_PROCESSES=${processes} EXTRA_DEFINES="${EXTRA_DEFINES}" > "${logs_directory}/build_${implementation}_${size}_${processes}.txt" 2>&1 || \
+						echo_failure "The ${implementation} version could not be built for ${size}x${size} on ${processes} processes, see ${logs_directory}/build_${implementation}_${size}_${processes}.txt."
+				fi
+			fi
+			if [ ! -f "${executable}" ]; then
+				echo_failure "The executable ${executable} does not exist.";
+			fi
+
+			for threads in "${thread_counts[@]}"; do
+				case ${implementation} in
+					serial|openacc|openmp) command="OMP_NUM_THREADS=${threads} ${executable}";;
+					*) command="OMP_NUM_THREADS=${threads} ${mpi_launcher} ${processes} ${mpi_export} ${mpi_options} ${executable}";;
+				esac
+
+				for repetition in `seq 1 ${repetitions}`; do
+					log_file="${logs_directory}/${language}_${implementation}_${size}_${processes}x${threads}_${repetition}.txt"
+					echo_success "Running \"${command}\", repetition ${repetition}.";
+					eval ${command} > "${log_file}" 2>&1 || echo_failure "The run failed, see ${log_file}."
+
+					# Parsed from the summary printed by every version
+					iterations=`sed -n 's/.*reached at iteration \([0-9]*\) was.*/\1/p' "${log_file}"`
+					total_seconds=`sed -n 's/^Total time was \([0-9.]*\) seconds\./\1/p' "${log_file}"`
+					if [ -z "${iterations}" ] || [ -z "${total_seconds}" ]; then
+						echo_failure "The summary could not be found in ${log_file}."
+					fi
+					metrics=`awk -v g=${global} -v i=${iterations} -v t=${total_seconds} -v b=${bytes_per_update} -v s=${stream_bandwidth} 'BEGIN {
+						glups = (t > 0) ? g * g * i / t / 1e9 : 0;
+						printf "%.6f,%.4f,%.3f,%.3f,%.3f", (i > 0) ? t / i : 0, glups, glups * b, s, (s > 0) ? glups * b / s : 0 }'`
+					echo "${language},${implementation},${size},${processes},${threads},${repetition},${iterations},${total_seconds},${metrics},${run_date},${run_host},${run_commit},${run_compiler},${run_defines}" >> "${csv_file}"
+					echo_result "${implementation} ${size} on ${processes}x${threads}: ${iterations} iterations in ${total_seconds}s ($(echo ${metrics} | cut -d, -f2) GLUP/s, $(echo ${metrics} | cut -d, -f3) GB/s)."
+				done
+			done
+		done
+	done
+done
+
+#########################################################################
+# Scaling efficiencies, against the configuration with fewest cores     #
+# - strong: same size, E = (T1 x W1) / (Tn x Wn) with T the time per    #
+#   iteration and W the number of cores (processes x threads)           #
+# - weak: same number of cells per core, E = T1 / Tn                    #
+#########################################################################
+awk -F',' -v OFS=',' '
+	NR == 1 { header = $0 "," "strong_efficiency,weak_efficiency"; next }
+	{
+		rows[NR] = $0
+		global = ($3 == "small") ? 672 : (($3 == "big") ? 14560 : $3)
+		cores = $4 * $5
+		strong_key[NR] = $1 SUBSEP $2 SUBSEP $3
+		weak_key[NR] = $1 SUBSEP $2 SUBSEP (global * global / cores)
+		cores_of[NR] = cores
+		time_of[NR] = $9
+		if(!(strong_key[NR] in strong_cores) || cores < strong_cores[strong_key[NR]]) { strong_cores[strong_key[NR]] = cores; strong_time[strong_key[NR]] = $9 }
+		if(!(weak_key[NR] in weak_cores) || cores < weak_cores[weak_key[NR]]) { weak_cores[weak_key[NR]] = cores; weak_time[weak_key[NR]] = $9 }
+	}
+	END {
+		print header
+		for(r = 2; r <= NR; r++)
+		{
+			strong = (time_of[r] > 0) ? strong_time[strong_key[r]] * strong_cores[strong_key[r]] / (time_of[r] * cores_of[r]) : 0
+			weak = (time_of[r] > 0) ? weak_time[weak_key[r]] / time_of[r] : 0
+			printf "%s,%.3f,%.3f\n", rows[r], strong, weak
+		}
+	}' "${csv_file}" > "${csv_file}.tmp" && mv "${csv_file}.tmp" "${csv_file}"
+
+##################################
+# The same results, in JSON form #
+##################################
+awk -F',' '
+	NR == 1 { for(f = 1; f <= NF; f++) { names[f] = $f }; print "["; next }
+	{
+		printf "%s  {", (NR > 2) ? ",\n" : ""
+		for(f = 1; f <= NF; f++)
+		{
+			numeric = ($f ~ /^-?[0-9]+(\.[0-9]+)?$/ && names[f] != "size" && names[f] != "commit")
+			printf "%s\"%s\": %s%s%s", (f > 1) ? ", " : "", names[f], numeric ? "" : "\"", $f, numeric ? "" : "\""
+		}
+		printf "}"
+	}
+	END { print "\n]" }' "${csv_file}" > "${json_file}"
+
+echo_success "The results are in ${csv_file} and ${json_file}."
@@ -0,0 +1,286 @@
+/**
+ * @file checkpoint.c
+ **/
+
+#include "checkpoint.h"
+
+#ifdef CHECKPOINT
+
+#include "util.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // EXIT_FAILURE, getenv, malloc, free
+#include <string.h> // memcpy, memset, strcmp, strcpy
+
+/**
+ * @brief Gives the path of the checkpoint file, from the setting LAPLACE_CHECKPOINT_FILE.
+ * @return The path of the checkpoint file.
+ **/
+static const char* get_checkpoint_path(void)
+{
+	const char* path = getenv("LAPLACE_CHECKPOINT_FILE");
+	return (path == NULL || path[0] == '\0') ? CHECKPOINT_FILE : path;
+}
+
+/**
+ * @brief Gives the size of a slot of the checkpoint file: a header followed by the whole plate.
+ * @return The size of a slot, in bytes.
+ **/
+static MPI_Offset get_slot_size(void)
+{
+	return (MPI_Offset)sizeof(struct checkpoint_header_t) + (MPI_Offset)(ROWS_GLOBAL + 2) * (COLUMNS + 2) * sizeof(double);
+}
+
+/**
+ * @brief Gives the position of a row of the plate in a slot of the checkpoint file.
+ * @param[in] slot The slot, from 0 to CHECKPOINT_SLOTS - 1.
+ * @param[in] row The row in the plate, 0 being the top boundary.
+ * @return The offset of the row, in bytes.
+ **/
+static MPI_Offset get_row_offset(int slot, int row)
+{
+	return slot * get_slot_size() + (MPI_Offset)sizeof(struct checkpoint_header_t) + (MPI_Offset)row * (COLUMNS + 2) * sizeof(double);
+}
+
+/**
+ * @brief Tells whether a header is that of a checkpoint of this plate.
+ * @param[in] header The header.
+ * @return 1 if it is, 0 otherwise.
+ **/
+static int is_header_of_plate(struct checkpoint_header_t* header)
+{
+	header->magic[sizeof(header->magic) - 1] = '\0';
+	return strcmp(header->magic, CHECKPOINT_MAGIC) == 0 && header->rows == ROWS_GLOBAL && header->columns == COLUMNS;
+}
+
+/**
+ * @brief Reads the headers of all slots of a checkpoint file and finds the latest complete checkpoint of this plate.
+ * @details Collective: every MPI process must call it.
+ * @param[in] file The checkpoint file, open for reading.
+ * @param[out] headers The header of each slot, zeroed where the file is too short to hold it.
+ * @return The slot of the latest complete checkpoint, -1 if there is none.
+ **/
+static int find_latest_checkpoint(MPI_File file, struct checkpoint_header_t headers[CHECKPOINT_SLOTS])
+{
+	int latest = -1;
+	for(int slot = 0; slot < CHECKPOINT_SLOTS; slot++)
+	{
+		memset(&headers[slot], 0, sizeof(struct checkpoint_header_t));
+		MPI_File_read_at_all(file, slot * get_slot_size(), &headers[slot], sizeof(struct checkpoint_header_t), MPI_BYTE, MPI_STATUS_IGNORE);
+		if(is_header_of_plate(&headers[slot]) && headers[slot].iteration > 0 && (latest == -1 || headers[slot].iteration > headers[latest].iteration))
+		{
+			latest = slot;
+		}
+	}
+	return latest;
+}
+
+/**
+ * @brief Writes the header of the checkpoint in progress, which makes it the complete checkpoint to restart from.
+ * @param[inout] checkpoint The checkpoint file, whose rows are written by every MPI process.
+ **/
+static void write_header(struct checkpoint_t* checkpoint)
+{
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	if(my_rank == 0)
+	{
+		MPI_File_write_at(checkpoint->file, checkpoint->slot * get_slot_size(), &checkpoint->header, sizeof(struct checkpoint_header_t), MPI_BYTE, MPI_STATUS_IGNORE);
+	}
+	checkpoint->in_progress = 0;
+}
+
+/**
+ * @brief Completes the checkpoint in progress, if any, then writes its header.
+ * @param[inout] checkpoint The checkpoint file.
+ **/
+static void complete_checkpoint(struct checkpoint_t* checkpoint)
+{
+	if(!checkpoint->in_progress)
+	{
+		return;
+	}
+
+	if(checkpoint->request != MPI_REQUEST_NULL)
+	{
+		MPI_Wait(&checkpoint->request, MPI_STATUS_IGNORE);
+		MPI_Ibarrier(checkpoint->communicator, &checkpoint->barrier);
+	}
+	MPI_Wait(&checkpoint->barrier, MPI_STATUS_IGNORE);
+	write_header(checkpoint);
+}
+
+int restart_from_checkpoint(double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2], int* iteration, double* dt_global)
+{
+	if(get_setting("LAPLACE_RESTART", 0) != 1)
+	{
+		return 0;
+	}
+
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	const char* path = get_checkpoint_path();
+
+	MPI_File file;
+	if(MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+	{
+		if(my_rank == 0)
+		{
+			printf("No checkpoint in %s, starting from the initial temperatures.\n", path);
+		}
+		return 0;
+	}
+
+	struct checkpoint_header_t headers[CHECKPOINT_SLOTS];
+	int slot = find_latest_checkpoint(file, headers);
+	// The first slot is always the first written, it tells what the file is
+	if(headers[0].magic[0] != '\0' && !is_header_of_plate(&headers[0]))
+	{
+		if(my_rank == 0)
+		{
+			printf("%s is not a checkpoint of a plate of %d x %d cells.\n", path, ROWS_GLOBAL, COLUMNS);
+		}
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
+	if(slot == -1)
+	{
+		MPI_File_close(&file);
+		if(my_rank == 0)
+		{
+			printf("%s holds no complete checkpoint, starting from the initial temperatures.\n", path);
+		}
+		return 0;
+	}
+
+	// My rows and my halo rows, which are the boundaries on the first and last MPI processes
+	MPI_File_read_at_all(file, get_row_offset(slot, GRID_ROW_OFFSET(my_rank)), &temperature[0][0], (ROWS + 2) * (COLUMNS + 2), MPI_DOUBLE, MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+	if(temperature_last != temperature)
+	{
+		memcpy(temperature_last, temperature, sizeof(double) * (ROWS + 2) * (COLUMNS + 2));
+	}
+
+	*iteration = headers[slot].iteration;
+	*dt_global = headers[slot].dt;
+	if(my_rank == 0)
+	{
+		printf("Restarting from iteration %d of %s.\n", headers[slot].iteration, path);
+	}
+	return 1;
+}
+
+void create_checkpoints(struct checkpoint_t* checkpoint)
+{
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	const char* path = get_checkpoint_path();
+
+	if(MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_RDWR, MPI_INFO_NULL, &checkpoint->file) != MPI_SUCCESS)
+	{
+		if(my_rank == 0)
+		{
+			printf("Cannot open the checkpoint file %s.\n", path);
+		}
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
+	if(get_setting("LAPLACE_RESTART", 0) == 1)
+	{
+		// The checkpoint restarted from stays, the first one of this run goes to the other slot
+		struct checkpoint_header_t headers[CHECKPOINT_SLOTS];
+		int latest = find_latest_checkpoint(checkpoint->file, headers);
+		checkpoint->slot = (latest == -1) ? CHECKPOINT_SLOTS - 1 : latest;
+	}
+	else
+	{
+		// The checkpoints of an earlier run would pass for those of this one
+		MPI_File_set_size(checkpoint->file, 0);
+		checkpoint->slot = CHECKPOINT_SLOTS - 1;
+	}
+	// The header of a checkpoint waits on a barrier of its own, which the iterations reach at different times in each MPI process
+	MPI_Comm_dup(MPI_COMM_WORLD, &checkpoint->communicator);
+	checkpoint->interval = get_setting("LAPLACE_CHECKPOINT_INTERVAL", CHECKPOINT_INTERVAL);
+	checkpoint->rows = malloc(sizeof(double) * (ROWS + 2) * (COLUMNS + 2));
+	if(checkpoint->rows == NULL)
+	{
+		printf("The checkpoint buffer of %d x %d cells could not be allocated.\n", ROWS + 2, COLUMNS + 2);
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
+	checkpoint->request = MPI_REQUEST_NULL;
+	checkpoint->barrier = MPI_REQUEST_NULL;
+	checkpoint->in_progress = 0;
+	memset(&checkpoint->header, 0, sizeof(struct checkpoint_header_t));
+}
+
+void save_checkpoint(struct checkpoint_t* checkpoint, double (*temperature)[COLUMNS+2], int iteration, double dt_global)
+{
+	complete_checkpoint(checkpoint);
+
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+	// My rows, and the boundary of the plate if I hold it. The copy leaves the grid free for the next iterations.
+	int first_row = (my_rank == 0) ? 0 : 1;
+	int last_row = (my_rank == comm_size - 1) ? ROWS + 1 : ROWS;
+	int count = (last_row - first_row + 1) * (COLUMNS + 2);
+	memcpy(checkpoint->rows, &temperature[first_row][0], sizeof(double) * count);
+
+	// The last complete checkpoint stays in its slot, the other one no longer holds a complete checkpoint
+	checkpoint->slot = (checkpoint->slot + 1) % CHECKPOINT_SLOTS;
+	memset(&checkpoint->header, 0, sizeof(struct checkpoint_header_t));
+	strcpy(checkpoint->header.magic, CHECKPOINT_MAGIC);
+	checkpoint->header.rows = ROWS_GLOBAL;
+	checkpoint->header.columns = COLUMNS;
+	write_header(checkpoint);
+	checkpoint->header.iteration = iteration;
+	checkpoint->header.dt = dt_global;
+
+	// The last complete checkpoint is on disk, and its slot is the only one to pass for complete, before any row is overwritten
+	MPI_File_sync(checkpoint->file);
+	MPI_Barrier(checkpoint->communicator);
+	MPI_File_sync(checkpoint->file);
+
+	MPI_File_iwrite_at_all(checkpoint->file, get_row_offset(checkpoint->slot, GRID_ROW_OFFSET(my_rank) + first_row), checkpoint->rows, count, MPI_DOUBLE, &checkpoint->request);
+	checkpoint->in_progress = 1;
+}
+
+void progress_checkpoint(struct checkpoint_t* checkpoint)
+{
+	if(!checkpoint->in_progress)
+	{
+		return;
+	}
+
+	int done;
+	if(checkpoint->request != MPI_REQUEST_NULL)
+	{
+		MPI_Test(&checkpoint->request, &done, MPI_STATUS_IGNORE);
+		if(!done)
+		{
+			return;
+		}
+		// My rows are written, the header waits for those of the other MPI processes
+		MPI_Ibarrier(checkpoint->communicator, &checkpoint->barrier);
+	}
+	MPI_Test(&checkpoint->barrier, &done, MPI_STATUS_IGNORE);
+	if(done)
+	{
+		write_header(checkpoint);
+	}
+}
+
+void close_checkpoints(struct checkpoint_t* checkpoint, double (*temperature)[COLUMNS+2], int iteration, double dt_global)
+{
+	// Unless the last checkpoint is that field already
+	if(checkpoint->header.iteration != iteration)
+	{
+		save_checkpoint(checkpoint, temperature, iteration, dt_global);
+	}
+	complete_checkpoint(checkpoint);
+	MPI_File_sync(checkpoint->file);
+	MPI_File_close(&checkpoint->file);
+	MPI_Comm_free(&checkpoint->communicator);
+	free(checkpoint->rows);
+}
+
+#endif
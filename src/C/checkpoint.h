@@ -0,0 +1,122 @@
+/**
+ * @file checkpoint.h
+ * @brief This file contains the checkpoints written and read back through MPI-IO by the C MPI versions with the optional mode CHECKPOINT.
+ * @details The checkpoint file has CHECKPOINT_SLOTS slots, each holding a header, with the dimensions of the plate, the iteration and the temperature change, followed by the whole plate, boundaries included, one row after the other. Checkpoints go to the slots in turn, so that the last complete one stays in its slot while the next is written to the other. Each MPI process writes its rows at their offset in the plate with a collective, non-blocking MPI_File_iwrite_at_all(), from a copy of its grid: the iterations go on while the rows are written, each of them testing the write so that it progresses. The header of a slot says iteration 0 from the moment its rows start being overwritten, and gets the iteration of the checkpoint once the rows of all the MPI processes are written, which an MPI_Ibarrier() tested by the iterations too tells. A run killed at any point therefore leaves a complete checkpoint behind, the latest or the one before, once one has been written. The field reached at the end of the run is always written, which makes the latest slot the full temperature field too.
+ * On restart, the slot with the latest complete checkpoint is read back: each MPI process reads its rows and its halo rows from the plate, so the file can be read back with any number of MPI processes sharing the rows, see RUNTIME_GRID; the run then resumes at the iteration after the checkpoint and gives the results of an uninterrupted run.
+ *
+ * Settings:
+ * - LAPLACE_CHECKPOINT_INTERVAL: the number of iterations between two checkpoints, CHECKPOINT_INTERVAL by default.
+ * - LAPLACE_RESTART: 1 to resume from the checkpoint file, if any, rather than from the initial temperatures. Otherwise the checkpoint file is emptied when the run starts.
+ * - LAPLACE_CHECKPOINT_FILE: the path of the checkpoint file, CHECKPOINT_FILE by default. Unlike the other settings, it is a string.
+ **/
+
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef CHECKPOINT
+	#include <mpi.h> // MPI_*
+
+	#if defined(CARTESIAN_2D) || defined(DEEP_HALO) || defined(OVERLAP) || defined(DEFERRED_CONVERGENCE)
+		#error "CHECKPOINT writes and reads rows of the 1D decomposition at the end of an iteration: it supports none of CARTESIAN_2D, DEEP_HALO, OVERLAP and DEFERRED_CONVERGENCE."
+	#endif
+
+	#ifndef CHECKPOINT_INTERVAL
+		/// Default number of iterations between two checkpoints, can be overriden with a define at compilation time.
+		#define CHECKPOINT_INTERVAL 1000
+	#endif
+	#ifndef CHECKPOINT_FILE
+		/// Default path of the checkpoint file, can be overriden with a define at compilation time.
+		#define CHECKPOINT_FILE "laplace.chk"
+	#endif
+	/// Number of checkpoints kept in the checkpoint file, the one being written and the last complete one.
+	#define CHECKPOINT_SLOTS 2
+	/// The first bytes of a slot of a checkpoint file.
+	#define CHECKPOINT_MAGIC "LAPLACE"
+
+	/// The header of a slot of a checkpoint file, followed by the rows of the plate.
+	struct checkpoint_header_t
+	{
+		/// CHECKPOINT_MAGIC, null terminated.
+		char magic[8];
+		/// Number of rows of the plate (excluding boundaries).
+		int rows;
+		/// Number of columns of the plate (excluding boundaries).
+		int columns;
+		/// The last iteration computed, 0 while the rows are being written.
+		int iteration;
+		/// Unused, keeps dt aligned.
+		int reserved;
+		/// The temperature change across all MPI processes at that iteration.
+		double dt;
+	};
+
+	/// The checkpoint file of a run, and the checkpoint being written.
+	struct checkpoint_t
+	{
+		/// The checkpoint file, open for the whole run.
+		MPI_File file;
+		/// Number of iterations between two checkpoints.
+		int interval;
+		/// The copy of my rows being written, boundaries included on the first and last MPI processes.
+		double* rows;
+		/// The slot of the checkpoint in progress, or of the last one written.
+		int slot;
+		/// Whether the header of the checkpoint in progress is still to be written.
+		int in_progress;
+		/// The request of the write of my rows in progress, MPI_REQUEST_NULL once complete.
+		MPI_Request request;
+		/// A duplicate of MPI_COMM_WORLD, on which only the barriers of the checkpoints are done.
+		MPI_Comm communicator;
+		/// The barrier telling the rows of every MPI process are written, entered once mine are.
+		MPI_Request barrier;
+		/// The header written once the rows in progress are written.
+		struct checkpoint_header_t header;
+	};
+
+	/// Tells whether a checkpoint is written at the end of an iteration.
+	#define CHECKPOINT_DUE(checkpoint, iteration) (((iteration) % (checkpoint)->interval) == 0)
+
+	/**
+	 * @brief Reads the grids back from the checkpoint file if the setting LAPLACE_RESTART asks for it.
+	 * @details The program is stopped if the file holds no complete checkpoint, or one of another plate.
+	 * @param[out] temperature The 2D array that contains the current iteration temperatures, halo rows included.
+	 * @param[out] temperature_last The 2D array that contains the previous iteration temperatures, given the same rows. It may be \p temperature itself.
+	 * @param[out] iteration The iteration of the checkpoint, left untouched if there is no restart.
+	 * @param[out] dt_global The temperature change of the checkpoint, left untouched if there is no restart.
+	 * @return 1 if the grids were read back, 0 otherwise.
+	 * @pre Both grids have been initialised with initialise_temperatures(), so that the boundaries are set when there is no restart.
+	 **/
+	int restart_from_checkpoint(double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2], int* iteration, double* dt_global);
+	/**
+	 * @brief Opens the checkpoint file for writing, emptying it unless the run restarted from it.
+	 * @param[out] checkpoint The checkpoint file, to close with close_checkpoints().
+	 **/
+	void create_checkpoints(struct checkpoint_t* checkpoint);
+	/**
+	 * @brief Starts writing my rows to the next slot, once the checkpoint in progress, if any, is complete.
+	 * @details Collective: every MPI process must call it at the same iteration.
+	 * @param[inout] checkpoint The checkpoint file.
+	 * @param[in] temperature The 2D array that contains the temperatures reached at \p iteration.
+	 * @param[in] iteration The last iteration computed.
+	 * @param[in] dt_global The temperature change across all MPI processes at \p iteration.
+	 **/
+	void save_checkpoint(struct checkpoint_t* checkpoint, double (*temperature)[COLUMNS+2], int iteration, double dt_global);
+	/**
+	 * @brief Lets the checkpoint in progress, if any, advance, and writes its header once the rows of every MPI process are written.
+	 * @details To call at every iteration that does not save a checkpoint, so that the checkpoint is complete soon after it started.
+	 * @param[inout] checkpoint The checkpoint file.
+	 **/
+	void progress_checkpoint(struct checkpoint_t* checkpoint);
+	/**
+	 * @brief Writes the field reached at the end of the run, waits until it is on disk and closes the checkpoint file.
+	 * @param[inout] checkpoint The checkpoint file.
+	 * @param[in] temperature The 2D array that contains the temperatures reached at \p iteration.
+	 * @param[in] iteration The last iteration computed.
+	 * @param[in] dt_global The temperature change across all MPI processes at \p iteration.
+	 **/
+	void close_checkpoints(struct checkpoint_t* checkpoint, double (*temperature)[COLUMNS+2], int iteration, double dt_global);
+#endif
+
+#endif
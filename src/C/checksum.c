@@ -0,0 +1,71 @@
+/**
+ * @file checksum.c
+ **/
+
+#include "checksum.h"
+
+#ifdef CHECKSUM
+
+#include <inttypes.h> // PRIx64
+#include <stdint.h> // uint64_t
+#include <stdio.h> // printf
+#include <string.h> // memcpy
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+#endif
+
+/**
+ * @brief Mixes the bits of an integer, so that close integers give unrelated ones.
+ * @details This is the finaliser of SplitMix64.
+ * @param[in] x The integer to mix.
+ * @return The integer mixed.
+ **/
+static uint64_t mix_bits(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= UINT64_C(0xbf58476d1ce4e5b9);
+	x ^= x >> 27;
+	x *= UINT64_C(0x94d049bb133111eb);
+	x ^= x >> 31;
+	return x;
+}
+
+void print_checksum(const temperature_t* grid, int row_length, int rows, int columns, int row_offset, int column_offset)
+{
+	// The hash, fixed-point sum and number of my cells, summed modulo 2^64
+	uint64_t hash = 0;
+	uint64_t sum = 0;
+	uint64_t count = (uint64_t)rows * (uint64_t)columns;
+
+	#pragma omp parallel for reduction(+:hash, sum) schedule(static)
+	for(int i = 1; i <= rows; i++)
+	{
+		const temperature_t* row = grid + (size_t)i * row_length;
+		// The position, in the plate, of the cell [i][0], rows including their boundaries
+		const uint64_t row_position = (uint64_t)(row_offset + i) * (COLUMNS + 2) + column_offset;
+		for(int j = 1; j <= columns; j++)
+		{
+			const double value = row[j];
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			hash += mix_bits(bits ^ mix_bits(row_position + j));
+			sum += (uint64_t)(value * (UINT64_C(1) << CHECKSUM_FRACTION_BITS) + 0.5);
+		}
+	}
+
+	uint64_t totals[3] = {hash, sum, count};
+	#ifdef VERSION_RUN_IS_MPI
+		int my_rank;
+		MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+		MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : totals, totals, 3, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+		if(my_rank != 0)
+		{
+			return;
+		}
+	#endif
+
+	const double mean = (double)totals[1] / (double)(UINT64_C(1) << CHECKSUM_FRACTION_BITS) / (double)totals[2];
+	printf("Checksum of the final temperatures is %016" PRIx64 ", their mean is %.12f\n", totals[0], mean);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @file checksum.h
+ * @brief This file contains the checksum of the final temperatures of the whole plate, printed by the optional mode CHECKSUM.
+ * @details By default a run is checked on the few cells printed by track_progress() and the halo swap verification cell, which says nothing of the rest of the plate. With CHECKSUM, each MPI process also sums, in parallel over the rows of its part of the plate, a hash of every cell it holds, mixing the bits of its temperature with its position in the plate, and its temperature in fixed point, rounded to 2^-CHECKSUM_FRACTION_BITS. Both sums are of 64-bit unsigned integers, wrapping around, so that they do not depend on the order in which the cells are added: the same plate gives the same checksum whatever its decomposition among MPI processes and threads. The sums of all MPI processes are combined with a single reduction, and the line printed after the summary gives the hash and the mean temperature, which verify.sh compares against reference_outputs/C/checksums.txt. The hash checks that every cell is bit-identical, the mean that builds that are not bit-identical, such as SINGLE_PRECISION ones, stay close.
+ * The right boundary set by initialise_temperatures() in the MPI versions is rounded differently for each number of MPI processes, so the plates they reach differ from that of the others in the last bits of some cells: each reference output has its own checksum.
+ **/
+
+#ifndef CHECKSUM_H_INCLUDED
+#define CHECKSUM_H_INCLUDED
+
+#include "precision.h"
+
+#ifdef CHECKSUM
+	#ifdef ENSEMBLE
+		#error "CHECKSUM does not support ENSEMBLE, whose plates are interleaved in the same grid."
+	#endif
+
+	/// Number of fractional bits of the temperatures summed, whose sum fits in 64 bits for plates of up to 8e10 cells.
+	#define CHECKSUM_FRACTION_BITS 20
+
+	/**
+	 * @brief Computes the checksum of the cells of my part of the plate, combines those of all MPI processes and prints that of the whole plate.
+	 * @details In MPI versions, every MPI process must call it; the line is printed by the MPI process of rank 0.
+	 * @param[in] grid The cell [0][0] of my grid, which holds the final temperatures on the host.
+	 * @param[in] row_length The number of cells of a row of my grid, boundaries and halos included.
+	 * @param[in] rows The number of rows of my part of the plate, those of my grid from 1 to rows.
+	 * @param[in] columns The number of columns of my part of the plate, those of my grid from 1 to columns.
+	 * @param[in] row_offset The row, in the plate, of row 0 of my grid.
+	 * @param[in] column_offset The column, in the plate, of column 0 of my grid.
+	 **/
+	void print_checksum(const temperature_t* grid, int row_length, int rows, int columns, int row_offset, int column_offset);
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file decomposition.c
+ **/
+
+#ifdef CARTESIAN_2D
+
+#include "decomposition.h"
+#include "util.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h> // memcpy
+
+/// Tag of the rows travelling to the south neighbour.
+#define TAG_SOUTHWARDS 0
+/// Tag of the rows travelling to the north neighbour.
+#define TAG_NORTHWARDS 1
+/// Tag of the columns travelling to the east neighbour.
+#define TAG_EASTWARDS 2
+/// Tag of the columns travelling to the west neighbour.
+#define TAG_WESTWARDS 3
+
+void create_decomposition(struct decomposition_t* decomposition)
+{
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+	if(comm_size != PROCESS_COUNT)
+	{
+		printf("The 2D decomposition is meant to be run with %d MPI processes, not %d.\n", PROCESS_COUNT, comm_size);
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
+
+	// The plate is not periodic; let MPI reorder ranks so that neighbours end up on the same node when it can
+	int dimensions[2] = {PROCESS_GRID_ROWS, PROCESS_GRID_COLUMNS};
+	int periods[2] = {0, 0};
+	MPI_Cart_create(MPI_COMM_WORLD, 2, dimensions, periods, 1, &decomposition->communicator);
+	MPI_Comm_rank(decomposition->communicator, &decomposition->rank);
+	MPI_Cart_coords(decomposition->communicator, decomposition->rank, 2, decomposition->coordinates);
+	MPI_Cart_shift(decomposition->communicator, 0, 1, &decomposition->north, &decomposition->south);
+	MPI_Cart_shift(decomposition->communicator, 1, 1, &decomposition->west, &decomposition->east);
+
+	MPI_Type_contiguous(LOCAL_COLUMNS, MPI_DOUBLE, &decomposition->row);
+	MPI_Type_commit(&decomposition->row);
+	MPI_Type_vector(LOCAL_ROWS, 1, LOCAL_COLUMNS + 2, MPI_DOUBLE, &decomposition->column);
+	MPI_Type_commit(&decomposition->column);
+}
+
+void free_decomposition(struct decomposition_t* decomposition)
+{
+	MPI_Type_free(&decomposition->row);
+	MPI_Type_free(&decomposition->column);
+	MPI_Comm_free(&decomposition->communicator);
+}
+
+void initialise_temperatures_decomposed(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_last[LOCAL_ROWS+2][LOCAL_COLUMNS+2])
+{
+	// Global row and column of my cell [0][0]
+	int first_row = decomposition->coordinates[0] * LOCAL_ROWS;
+	int first_column = decomposition->coordinates[1] * LOCAL_COLUMNS;
+
+	for(int i = 0; i <= LOCAL_ROWS+1; i++)
+	{
+		for(int j = 0; j <= LOCAL_COLUMNS+1; j++)
+		{
+			temperature_last[i][j] = 0.0;
+		}
+	}
+
+	// Right boundary (for the last process column only), a linear increase computed per strip of ROWS rows like initialise_temperatures() does
+	if(decomposition->coordinates[1] == PROCESS_GRID_COLUMNS - 1)
+	{
+		for(int i = 0; i <= LOCAL_ROWS+1; i++)
+		{
+			int global_row = first_row + i;
+			int strip = (global_row - 1) / ROWS;
+			if(strip < 0)
+			{
+				strip = 0;
+			}
+			else if(strip > PROCESS_COUNT - 1)
+			{
+				strip = PROCESS_COUNT - 1;
+			}
+			double tMin = (strip) * 100.0 / PROCESS_COUNT;
+			double tMax = (strip+1) * 100.0 / PROCESS_COUNT;
+			temperature_last[i][LOCAL_COLUMNS+1] = tMin + ((tMax-tMin)/ROWS)*(global_row - strip * ROWS);
+		}
+	}
+
+	// Bottom boundary (for the last process row only)
+	if(decomposition->coordinates[0] == PROCESS_GRID_ROWS - 1)
+	{
+		for(int j = 0; j <= LOCAL_COLUMNS+1; j++)
+		{
+			temperature_last[LOCAL_ROWS+1][j] = (100.0 / COLUMNS) * (first_column + j);
+		}
+	}
+
+	// The left and top boundaries are 0, as are the halos until the first swap
+
+	memcpy(temperature, temperature_last, sizeof(double) * (LOCAL_ROWS + 2) * (LOCAL_COLUMNS + 2));
+
+	MPI_Barrier(decomposition->communicator);
+}
+
+/**
+ * @brief Posts the requests of a halo swap.
+ * @param[in] decomposition The decomposition.
+ * @param[in] temperature The 2D array whose outer rows and columns are sent.
+ * @param[out] temperature_next The 2D array whose halos receive those of the neighbours.
+ * @param[out] requests The HALO_SWAP_REQUESTS requests posted.
+ * @param[in] receive MPI_Irecv, or MPI_Recv_init for persistent requests.
+ * @param[in] send MPI_Isend, or MPI_Send_init for persistent requests.
+ **/
+static void post_halo_swap(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_next[LOCAL_ROWS+2][LOCAL_COLUMNS+2], MPI_Request requests[HALO_SWAP_REQUESTS],
+						   int (*receive)(void*, int, MPI_Datatype, int, int, MPI_Comm, MPI_Request*),
+						   int (*send)(const void*, int, MPI_Datatype, int, int, MPI_Comm, MPI_Request*))
+{
+	// Receives first, so that the messages can land straight into the halos
+	receive(&temperature_next[0][1], 1, decomposition->row, decomposition->north, TAG_SOUTHWARDS, decomposition->communicator, &requests[0]);
+	receive(&temperature_next[LOCAL_ROWS+1][1], 1, decomposition->row, decomposition->south, TAG_NORTHWARDS, decomposition->communicator, &requests[1]);
+	receive(&temperature_next[1][0], 1, decomposition->column, decomposition->west, TAG_EASTWARDS, decomposition->communicator, &requests[2]);
+	receive(&temperature_next[1][LOCAL_COLUMNS+1], 1, decomposition->column, decomposition->east, TAG_WESTWARDS, decomposition->communicator, &requests[3]);
+
+	send(&temperature[LOCAL_ROWS][1], 1, decomposition->row, decomposition->south, TAG_SOUTHWARDS, decomposition->communicator, &requests[4]);
+	send(&temperature[1][1], 1, decomposition->row, decomposition->north, TAG_NORTHWARDS, decomposition->communicator, &requests[5]);
+	send(&temperature[1][LOCAL_COLUMNS], 1, decomposition->column, decomposition->east, TAG_EASTWARDS, decomposition->communicator, &requests[6]);
+	send(&temperature[1][1], 1, decomposition->column, decomposition->west, TAG_WESTWARDS, decomposition->communicator, &requests[7]);
+}
+
+void start_halo_swap(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_next[LOCAL_ROWS+2][LOCAL_COLUMNS+2], MPI_Request requests[HALO_SWAP_REQUESTS])
+{
+	post_halo_swap(decomposition, temperature, temperature_next, requests, MPI_Irecv, MPI_Isend);
+}
+
+#ifdef PERSISTENT_HALO
+void create_halo_swaps_decomposed(const struct decomposition_t* decomposition, MPI_Request requests[HALO_SWAP_SETS][HALO_SWAP_REQUESTS], double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_last[LOCAL_ROWS+2][LOCAL_COLUMNS+2])
+{
+	#ifdef FUSED_SWAP
+		// Each grid both sends and receives, one at a time
+		post_halo_swap(decomposition, temperature, temperature, requests[0], MPI_Recv_init, MPI_Send_init);
+		post_halo_swap(decomposition, temperature_last, temperature_last, requests[1], MPI_Recv_init, MPI_Send_init);
+	#else
+		post_halo_swap(decomposition, temperature, temperature_last, requests[0], MPI_Recv_init, MPI_Send_init);
+	#endif
+}
+#endif
+
+void track_progress_decomposed(const struct decomposition_t* decomposition, int iteration, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2])
+{
+	// Laid out like a strip of the 1D decomposition. Only the cells printed are ever written, the others are never paged in.
+	static double strip[ROWS+2][COLUMNS+2];
+
+	if(decomposition->coordinates[0] == PROCESS_GRID_ROWS - 1 && decomposition->coordinates[1] == PROCESS_GRID_COLUMNS - 1)
+	{
+		for(int i = 6; i > 0; i--)
+		{
+			strip[ROWS-i+1][COLUMNS-i+1] = temperature[LOCAL_ROWS-i+1][LOCAL_COLUMNS-i+1];
+		}
+		track_progress(iteration, strip);
+	}
+}
+
+void print_verification_cell_decomposed(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2])
+{
+	// Global row of the last row of the strip before last, and the process row holding it
+	int global_row = ROWS_GLOBAL - ROWS;
+	int process_row = (global_row - 1) / LOCAL_ROWS;
+
+	if(decomposition->coordinates[0] == process_row && decomposition->coordinates[1] == PROCESS_GRID_COLUMNS - 1)
+	{
+		printf("Value of halo swap verification cell [%d][%d] is %.18f\n", ROWS_GLOBAL - ROWS - 1, COLUMNS - 1, temperature[global_row - process_row * LOCAL_ROWS][LOCAL_COLUMNS]);
+	}
+}
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * @file decomposition.h
+ * @brief This file contains the 2D Cartesian domain decomposition used by the optional mode CARTESIAN_2D of the MPI versions.
+ * @details By default the plate is cut in strips of ROWS rows, one per MPI process, each process exchanging two full rows per iteration. With CARTESIAN_2D the plate is instead cut in PROCESS_GRID_ROWS x PROCESS_GRID_COLUMNS tiles of LOCAL_ROWS x LOCAL_COLUMNS cells, and each process exchanges a row with its north and south neighbours and a column with its west and east neighbours. The tiles are smaller in perimeter than the strips as soon as the plate is cut in more than a few pieces, so is the halo traffic.
+ **/
+
+#ifndef DECOMPOSITION_H_INCLUDED
+#define DECOMPOSITION_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef CARTESIAN_2D
+	#include <mpi.h> // MPI_*
+	#include "halo.h"
+
+	/// Number of MPI processes. The makefile gives ROWS as the rows per MPI process of the 1D decomposition.
+	#define PROCESS_COUNT (ROWS_GLOBAL / ROWS)
+	#ifndef PROCESS_GRID_ROWS
+		/// Number of rows of the process grid, can be overriden with a define at compilation time.
+		#define PROCESS_GRID_ROWS 2
+	#endif
+	/// Number of columns of the process grid.
+	#define PROCESS_GRID_COLUMNS (PROCESS_COUNT / PROCESS_GRID_ROWS)
+
+	#if (PROCESS_COUNT % PROCESS_GRID_ROWS) != 0
+		#error "PROCESS_GRID_ROWS must divide the number of MPI processes."
+	#endif
+	#if (ROWS_GLOBAL % PROCESS_GRID_ROWS) != 0 || (COLUMNS % PROCESS_GRID_COLUMNS) != 0
+		#error "The process grid must divide the plate in tiles of equal size."
+	#endif
+
+	/// Rows per MPI process (excluding boundaries).
+	#define LOCAL_ROWS (ROWS_GLOBAL / PROCESS_GRID_ROWS)
+	/// Columns per MPI process (excluding boundaries).
+	#define LOCAL_COLUMNS (COLUMNS / PROCESS_GRID_COLUMNS)
+
+	#if LOCAL_ROWS < 6 || LOCAL_COLUMNS < 6
+		#error "The tiles must be at least 6x6 cells, the cells printed by track_progress() must fit in the last tile."
+	#endif
+
+	/**
+	 * @brief The position of an MPI process in the process grid, and what it needs to swap halos.
+	 **/
+	struct decomposition_t
+	{
+		/// The Cartesian communicator.
+		MPI_Comm communicator;
+		/// The rank of my MPI process in the Cartesian communicator.
+		int rank;
+		/// The row and column of my MPI process in the process grid.
+		int coordinates[2];
+		/// The rank of my north neighbour, MPI_PROC_NULL if I am on the top of the plate.
+		int north;
+		/// The rank of my south neighbour, MPI_PROC_NULL if I am on the bottom of the plate.
+		int south;
+		/// The rank of my west neighbour, MPI_PROC_NULL if I am on the left of the plate.
+		int west;
+		/// The rank of my east neighbour, MPI_PROC_NULL if I am on the right of the plate.
+		int east;
+		/// A row of LOCAL_COLUMNS cells.
+		MPI_Datatype row;
+		/// A column of LOCAL_ROWS cells, strided by a tile row.
+		MPI_Datatype column;
+	};
+
+	/**
+	 * @brief Creates the process grid.
+	 * @param[out] decomposition The decomposition to fill, to release with free_decomposition().
+	 * @pre MPI is initialised and runs PROCESS_COUNT MPI processes. The program is stopped otherwise.
+	 **/
+	void create_decomposition(struct decomposition_t* decomposition);
+	/**
+	 * @brief Releases the communicator and datatypes of a decomposition.
+	 * @param[inout] decomposition The decomposition to release.
+	 **/
+	void free_decomposition(struct decomposition_t* decomposition);
+	/**
+	 * @brief Initialises the temperatures of my tile.
+	 * @details Counterpart of initialise_temperatures() for tiles. Every cell gets the value it has in the 1D decomposition, including the right boundary which initialise_temperatures() computes per strip of ROWS rows, so that both decompositions give bit-identical results.
+	 * @param[in] decomposition The decomposition.
+	 * @param[out] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[out] temperature_last The 2D array that contains the previous iteration temperatures.
+	 **/
+	void initialise_temperatures_decomposed(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_last[LOCAL_ROWS+2][LOCAL_COLUMNS+2]);
+	/**
+	 * @brief Starts the exchange of my outer rows and columns with my four neighbours.
+	 * @details Neighbours beyond the plate boundaries are MPI_PROC_NULL, the matching requests complete straight away.
+	 * @param[in] decomposition The decomposition.
+	 * @param[in] temperature The 2D array whose outer rows and columns are sent.
+	 * @param[out] temperature_next The 2D array whose halos receive those of the neighbours.
+	 * @param[out] requests The HALO_SWAP_REQUESTS requests to complete before touching the halos of \p temperature_next or the outer rows and columns of \p temperature.
+	 **/
+	void start_halo_swap(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_next[LOCAL_ROWS+2][LOCAL_COLUMNS+2], MPI_Request requests[HALO_SWAP_REQUESTS]);
+	#ifdef PERSISTENT_HALO
+		/**
+		 * @brief Creates the persistent requests of the halo swap of the 2D decomposition.
+		 * @details Counterpart of create_halo_swaps() for tiles. The requests are those of start_halo_swap(), created inactive.
+		 * @param[in] decomposition The decomposition.
+		 * @param[out] requests The sets of requests to start with MPI_Startall() and to release with free_halo_swaps(), before free_decomposition().
+		 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+		 * @param[in] temperature_last The 2D array that contains the previous iteration temperatures.
+		 **/
+		void create_halo_swaps_decomposed(const struct decomposition_t* decomposition, MPI_Request requests[HALO_SWAP_SETS][HALO_SWAP_REQUESTS], double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2], double temperature_last[LOCAL_ROWS+2][LOCAL_COLUMNS+2]);
+	#endif
+	/**
+	 * @brief Prints information used for tracking, from the tile holding the bottom-right corner of the plate.
+	 * @details The cells printed are handed to track_progress() so that the output does not change.
+	 * @param[in] decomposition The decomposition.
+	 * @param[in] iteration The iteration at which printing progress.
+	 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+	 **/
+	void track_progress_decomposed(const struct decomposition_t* decomposition, int iteration, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2]);
+	/**
+	 * @brief Prints the halo swap verification cell, from the tile that holds it.
+	 * @details The cell is the same as that printed by the 1D decomposition, the last column of the last row of the strip before last.
+	 * @param[in] decomposition The decomposition.
+	 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+	 **/
+	void print_verification_cell_decomposed(const struct decomposition_t* decomposition, double temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2]);
+#else
+	/// Rows per MPI process (excluding boundaries).
+	#define LOCAL_ROWS ROWS
+	/// Columns per MPI process (excluding boundaries).
+	#define LOCAL_COLUMNS COLUMNS
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file dimensions.c
+ **/
+
+#include "dimensions.h"
+
+#ifdef DIMENSIONS_AT_RUNTIME
+
+#include "util.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // EXIT_FAILURE, exit
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+	#include "halo.h"
+#endif
+
+/// Smallest number of rows of an MPI process and of columns, for the 6 cells printed by track_progress().
+#define MINIMUM_CELLS 6
+
+int grid_rows = COMPILED_ROWS;
+int grid_columns = COMPILED_COLUMNS;
+int grid_rows_global = COMPILED_ROWS_GLOBAL;
+int grid_rows_max = COMPILED_ROWS;
+
+/// Number of MPI processes sharing the rows of the plate.
+static int process_count = 1;
+
+int grid_rows_of(int rank)
+{
+	return grid_rows_global / process_count + ((rank < grid_rows_global % process_count) ? 1 : 0);
+}
+
+int grid_row_offset(int rank)
+{
+	int remainder = grid_rows_global % process_count;
+	return rank * (grid_rows_global / process_count) + ((rank < remainder) ? rank : remainder);
+}
+
+void initialise_dimensions(void)
+{
+	int my_rank = 0;
+	#ifdef VERSION_RUN_IS_MPI
+		MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+	#endif
+
+	grid_rows_global = get_setting("LAPLACE_ROWS", COMPILED_ROWS_GLOBAL);
+	grid_columns = get_setting("LAPLACE_COLUMNS", COMPILED_COLUMNS);
+	grid_rows = grid_rows_of(my_rank);
+	grid_rows_max = grid_rows_of(0);
+
+	// The last MPI process has the fewest rows
+	int minimum_rows = MINIMUM_CELLS;
+	#ifdef VERSION_RUN_IS_MPI
+		if(minimum_rows < 2 * HALO_WIDTH)
+		{
+			minimum_rows = 2 * HALO_WIDTH;
+		}
+	#endif
+	if(grid_rows_of(process_count - 1) < minimum_rows || grid_columns < MINIMUM_CELLS)
+	{
+		printf("A plate of %d x %d cells cannot be shared between %d MPI processes: each needs at least %d rows, and the plate at least %d columns.\n", grid_rows_global, grid_columns, process_count, minimum_rows, MINIMUM_CELLS);
+		#ifdef VERSION_RUN_IS_MPI
+			MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+		#else
+			exit(EXIT_FAILURE);
+		#endif
+	}
+}
+
+#ifdef VERSION_RUN_IS_MPI
+void initialise_temperatures_shared(double temperature[ROWS+2][COLUMNS+2], double temperature_last[ROWS+2][COLUMNS+2])
+{
+	initialise_temperatures(temperature, temperature_last);
+	if(grid_rows_global % process_count == 0)
+	{
+		return;
+	}
+
+	// The MPI processes do not all have the same number of rows: the right boundary follows my rows in the plate
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	for(int i = 0; i <= ROWS+1; i++)
+	{
+		temperature_last[i][COLUMNS+1] = (100.0 / ROWS_GLOBAL) * (GRID_ROW_OFFSET(my_rank) + i);
+		temperature[i][COLUMNS+1] = temperature_last[i][COLUMNS+1];
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file dimensions.h
+ * @brief This file contains the dimensions of the grids, and their runtime counterpart used by the C CPU versions with the optional mode RUNTIME_GRID.
+ * @details By default ROWS, COLUMNS and ROWS_GLOBAL are defines passed as compilation flags, see makefile, and the MPI versions only run with the number of MPI processes they were built for. With RUNTIME_GRID, the same macros expand to variables set by initialise_dimensions() when the program starts: the plate is LAPLACE_ROWS x LAPLACE_COLUMNS cells, the sizes compiled in by default, and its rows are shared between however many MPI processes there are. When the rows do not divide evenly, the first MPI processes get one row more. The loops keep their fixed-size counterparts' speed through the row kernels of stencil.h, of which versions specialised for the widths of the plates of the makefile are picked at startup.
+ * The GPU versions, whose data clauses need fixed sizes, ignore RUNTIME_GRID.
+ *
+ * Settings:
+ * - LAPLACE_ROWS: the number of rows of the plate (excluding boundaries), that compiled in by default.
+ * - LAPLACE_COLUMNS: the number of columns of the plate (excluding boundaries), that compiled in by default.
+ **/
+
+#ifndef DIMENSIONS_H_INCLUDED
+#define DIMENSIONS_H_INCLUDED
+
+#if defined(RUNTIME_GRID) && !defined(_OPENACC)
+	/// The dimensions are set at runtime, see initialise_dimensions().
+	#define DIMENSIONS_AT_RUNTIME
+
+	#ifdef CARTESIAN_2D
+		#error "RUNTIME_GRID does not support CARTESIAN_2D, whose process grid is checked at compilation time."
+	#endif
+
+	/// The dimensions compiled in, taken as defaults.
+	enum
+	{
+		/// Number of rows per MPI process (excluding boundaries) compiled in.
+		COMPILED_ROWS = ROWS,
+		/// Number of columns (excluding boundaries) compiled in.
+		COMPILED_COLUMNS = COLUMNS,
+		#ifdef ROWS_GLOBAL
+			/// Number of rows of the whole plate (excluding boundaries) compiled in.
+			COMPILED_ROWS_GLOBAL = ROWS_GLOBAL
+		#else
+			/// Number of rows of the whole plate (excluding boundaries) compiled in.
+			COMPILED_ROWS_GLOBAL = ROWS
+		#endif
+	};
+
+	/// Number of rows of my MPI process (excluding boundaries).
+	extern int grid_rows;
+	/// Number of columns (excluding boundaries).
+	extern int grid_columns;
+	/// Number of rows of the whole plate (excluding boundaries).
+	extern int grid_rows_global;
+	/// Largest number of rows of an MPI process (excluding boundaries).
+	extern int grid_rows_max;
+
+	#undef ROWS
+	#undef COLUMNS
+	#undef ROWS_GLOBAL
+	/// Number of rows (excluding boundaries), per MPI process in MPI versions.
+	#define ROWS grid_rows
+	/// Number of columns (excluding boundaries).
+	#define COLUMNS grid_columns
+	/// Number of rows of the whole plate (excluding boundaries).
+	#define ROWS_GLOBAL grid_rows_global
+
+	/**
+	 * @brief Sets the dimensions from the settings LAPLACE_ROWS and LAPLACE_COLUMNS, and shares the rows between the MPI processes.
+	 * @details The program is stopped if an MPI process would get too few rows, or the plate too few columns, for the cells printed by track_progress() and the halos swapped.
+	 * @pre Called once, before any grid is allocated, after MPI is initialised in MPI versions.
+	 **/
+	void initialise_dimensions(void);
+	/**
+	 * @brief Gives the number of rows of an MPI process.
+	 * @param[in] rank The rank of the MPI process.
+	 * @return Its number of rows (excluding boundaries).
+	 **/
+	int grid_rows_of(int rank);
+	/**
+	 * @brief Gives the row, in the plate, of the cell [0][0] of an MPI process.
+	 * @param[in] rank The rank of the MPI process.
+	 * @return The number of rows of the MPI processes before it.
+	 **/
+	int grid_row_offset(int rank);
+
+	#ifdef VERSION_RUN_IS_MPI
+		/**
+		 * @brief Counterpart of initialise_temperatures() for rows shared unevenly between the MPI processes.
+		 * @details initialise_temperatures() ramps the right boundary of each MPI process over its own rows, which only joins up between MPI processes when they all have the same number of rows. Even shares keep that boundary, so that they give the results of the reference outputs; uneven ones get the right boundary of the serial version, set from the rows of each MPI process in the plate.
+		 * @param[out] temperature The 2D array that contains the current temperatures.
+		 * @param[out] temperature_last The 2D array that contains the previous iteration temperatures.
+		 **/
+		void initialise_temperatures_shared(double temperature[ROWS+2][COLUMNS+2], double temperature_last[ROWS+2][COLUMNS+2]);
+	#endif
+
+	/// Number of rows of an MPI process, see grid_rows_of().
+	#define GRID_ROWS_OF(rank) grid_rows_of(rank)
+	/// Row, in the plate, of the cell [0][0] of an MPI process, see grid_row_offset().
+	#define GRID_ROW_OFFSET(rank) grid_row_offset(rank)
+	/// Largest number of rows of an MPI process.
+	#define GRID_ROWS_MAX grid_rows_max
+#else
+	/// Number of rows of an MPI process: all have ROWS.
+	#define GRID_ROWS_OF(rank) ROWS
+	/// Row, in the plate, of the cell [0][0] of an MPI process.
+	#define GRID_ROW_OFFSET(rank) ((rank) * ROWS)
+	/// Largest number of rows of an MPI process.
+	#define GRID_ROWS_MAX ROWS
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file ensemble.c
+ **/
+
+#include "ensemble.h"
+
+#ifdef ENSEMBLE
+
+#include "util.h"
+#include "grid.h"
+#include "profile.h"
+#include "telemetry.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // EXIT_SUCCESS
+#include <math.h> // fabs, fmax
+
+/// The temperatures of a cell in every plate of the ensemble.
+typedef double ensemble_cell_t[ENSEMBLE_SIZE];
+
+/// Number of cells printed by track_progress(), on the diagonal ending at cell [ROWS][COLUMNS].
+#define PROGRESS_CELLS 6
+
+/**
+ * @brief Gives the factor applied to the bottom boundary of a plate of the ensemble.
+ * @param[in] plate The plate, from 0 to ENSEMBLE_SIZE - 1.
+ * @return The factor, 1 for plate 0 which is the plate of the reference outputs.
+ **/
+static double get_bottom_scale(int plate)
+{
+	return (double)(ENSEMBLE_SIZE - plate) / ENSEMBLE_SIZE;
+}
+
+/**
+ * @brief Initialises the temperatures of every plate of the ensemble, boundaries included.
+ * @param[out] temperature The interleaved grid that contains the current iteration temperatures.
+ * @param[out] temperature_last The interleaved grid that contains the previous iteration temperatures.
+ **/
+static void initialise_ensemble(ensemble_cell_t (*temperature)[COLUMNS+2], ensemble_cell_t (*temperature_last)[COLUMNS+2])
+{
+	// Each plate is initialised on its own, then interleaved
+	double (*plate_temperature)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	double (*plate_temperature_last)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	for(int m = 0; m < ENSEMBLE_SIZE; m++)
+	{
+		initialise_temperatures(plate_temperature, plate_temperature_last);
+		double scale = get_bottom_scale(m);
+		for(int j = 0; j <= COLUMNS + 1; j++)
+		{
+			plate_temperature_last[ROWS+1][j] *= scale;
+		}
+
+		#pragma omp parallel for schedule(static)
+		for(int i = 0; i <= ROWS + 1; i++)
+		{
+			for(int j = 0; j <= COLUMNS + 1; j++)
+			{
+				temperature[i][j][m] = plate_temperature_last[i][j];
+				temperature_last[i][j][m] = plate_temperature_last[i][j];
+			}
+		}
+	}
+	free_grid(plate_temperature);
+	free_grid(plate_temperature_last);
+}
+
+/**
+ * @brief Averages the four neighbours of every cell of the plates still running, and finds the temperature change of each plate in the same sweep.
+ * @param[out] temperature The interleaved grid computed. The cells of the plates that stopped are those of \p temperature_last.
+ * @param[in] temperature_last The interleaved grid of the previous iteration.
+ * @param[in] running Whether each plate is still running.
+ * @param[out] dt The temperature change of each plate, 0 for those that stopped.
+ **/
+static void sweep_ensemble(ensemble_cell_t (*restrict temperature)[COLUMNS+2], ensemble_cell_t (*restrict temperature_last)[COLUMNS+2], const int running[ENSEMBLE_SIZE], double dt[ENSEMBLE_SIZE])
+{
+	for(int m = 0; m < ENSEMBLE_SIZE; m++)
+	{
+		dt[m] = 0.0;
+	}
+
+	#pragma omp parallel for reduction(max:dt[:ENSEMBLE_SIZE]) schedule(static)
+	for(int i = 1; i <= ROWS; i++)
+	{
+		for(int j = 1; j <= COLUMNS; j++)
+		{
+			// The same cell of every plate, next to each other
+			#pragma omp simd
+			for(int m = 0; m < ENSEMBLE_SIZE; m++)
+			{
+				double average = 0.25 * (temperature_last[i+1][j  ][m] +
+										 temperature_last[i-1][j  ][m] +
+										 temperature_last[i  ][j+1][m] +
+										 temperature_last[i  ][j-1][m]);
+				double updated = running[m] ? average : temperature_last[i][j][m];
+				temperature[i][j][m] = updated;
+				dt[m] = fmax(fabs(updated - temperature_last[i][j][m]), dt[m]);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Copies the cells of plate 0 printed by track_progress() to a plate grid, then calls it on that grid.
+ * @param[in] iteration The iteration reached.
+ * @param[in] temperature The interleaved grid that contains the current iteration temperatures.
+ * @param[out] progress The plate grid handed to track_progress(), of which only the cells printed are set.
+ **/
+static void track_ensemble_progress(int iteration, ensemble_cell_t (*temperature)[COLUMNS+2], double (*progress)[COLUMNS+2])
+{
+	for(int k = 0; k < PROGRESS_CELLS; k++)
+	{
+		progress[ROWS - k][COLUMNS - k] = temperature[ROWS - k][COLUMNS - k][0];
+	}
+	track_progress(iteration, progress);
+}
+
+int run_ensemble(void)
+{
+	// A row of the ensemble holds the COLUMNS+2 cells of every plate, allocated as the row of a plate that much wider
+	ensemble_cell_t (*temperature)[COLUMNS+2] = allocate_grid(ROWS, (COLUMNS + 2) * ENSEMBLE_SIZE - 2);
+	ensemble_cell_t (*temperature_last)[COLUMNS+2] = allocate_grid(ROWS, (COLUMNS + 2) * ENSEMBLE_SIZE - 2);
+	// Used to swap the two grids above
+	ensemble_cell_t (*temperature_swap)[COLUMNS+2];
+	// Plate 0, the plate of the reference outputs, is the one whose progress is printed
+	double (*progress)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	// Whether each plate is still running
+	int running[ENSEMBLE_SIZE];
+	// Number of plates still running
+	int running_count = ENSEMBLE_SIZE;
+	// Temperature change of each plate
+	double dt[ENSEMBLE_SIZE];
+	// The iteration at which each plate stopped, and its temperature change then
+	int stopped_iteration[ENSEMBLE_SIZE];
+	double stopped_dt[ENSEMBLE_SIZE];
+	// Current iteration
+	int iteration = 0;
+	// Largest temperature change of the plates running
+	double dt_largest = 100;
+
+	for(int m = 0; m < ENSEMBLE_SIZE; m++)
+	{
+		running[m] = 1;
+		stopped_iteration[m] = 0;
+		stopped_dt[m] = 100;
+	}
+	printf("Running an ensemble of %d plates\n\n", ENSEMBLE_SIZE);
+	initialise_ensemble(temperature, temperature_last);
+
+	#ifdef PHASE_TIMERS
+		initialise_phase_timers();
+	#endif
+	#ifdef TELEMETRY
+		initialise_telemetry();
+	#endif
+
+	///////////////////////////////////
+	// -- Code from here is timed -- //
+	///////////////////////////////////
+	start_timer(&timer_simulation);
+
+	// Do until every plate is under threshold or until max iterations is reached
+	while(running_count > 0 && iteration <= MAX_NUMBER_OF_ITERATIONS)
+	{
+		iteration++;
+
+		// The grid computed during last iteration becomes the one we read from
+		temperature_swap = temperature_last;
+		temperature_last = temperature;
+		temperature = temperature_swap;
+
+		PHASE_BEGIN(PHASE_STENCIL);
+		sweep_ensemble(temperature, temperature_last, running, dt);
+		PHASE_END(PHASE_STENCIL);
+
+		// The plates under threshold stop, their cells are carried over from now on
+		dt_largest = 0.0;
+		for(int m = 0; m < ENSEMBLE_SIZE; m++)
+		{
+			if(running[m])
+			{
+				stopped_iteration[m] = iteration;
+				stopped_dt[m] = dt[m];
+				dt_largest = fmax(dt[m], dt_largest);
+				if(dt[m] <= MAX_TEMP_ERROR)
+				{
+					running[m] = 0;
+					running_count--;
+				}
+			}
+		}
+
+		// Periodically print test values
+		if((iteration % PRINT_FREQUENCY) == 0)
+		{
+			PHASE_BEGIN(PHASE_PRINT);
+			track_ensemble_progress(iteration, temperature, progress);
+			PHASE_END(PHASE_PRINT);
+		}
+
+		TELEMETRY_RECORD(iteration, dt_largest, dt_largest);
+	}
+
+	/////////////////////////////////////////////
+	// -- Code from here is no longer timed -- //
+	/////////////////////////////////////////////
+	stop_timer(&timer_simulation);
+
+	print_summary(iteration, dt_largest, timer_simulation);
+	#ifdef PHASE_TIMERS
+		print_phase_timers();
+	#endif
+	#ifdef TELEMETRY
+		close_telemetry();
+	#endif
+	for(int m = 0; m < ENSEMBLE_SIZE; m++)
+	{
+		printf("Plate %d, bottom boundary scaled by %.3f: the maximum temperature change was reached at iteration %d was %.18f, cell [%d][%d] is %.18f\n", m, get_bottom_scale(m), stopped_iteration[m], stopped_dt[m], ROWS - 1, COLUMNS - 1, temperature[ROWS][COLUMNS][m]);
+	}
+
+	free_grid(temperature);
+	free_grid(temperature_last);
+	free_grid(progress);
+
+	return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file ensemble.h
+ * @brief This file contains the ensemble of plates solved together by the C serial and OpenMP versions with the optional mode ENSEMBLE.
+ * @details A parameter study runs many plates that only differ by their boundaries, and separate runs stream the same stencil through memory once per plate. With ENSEMBLE, ENSEMBLE_SIZE plates are stored interleaved, the temperatures of a cell in every plate being next to each other, and a single sweep updates them all: the innermost loop runs over the plates, is vectorised, and each row of each neighbour is read once for the whole ensemble. Each plate has its own temperature change and stops once it reaches MAX_TEMP_ERROR, its cells being carried over unchanged from then on; the run stops once every plate has. The progress printed every PRINT_FREQUENCY iterations is that of plate 0. The summary of the run is followed by a line per plate, with the iteration and temperature change at which it stopped and its cell [ROWS-1][COLUMNS-1].
+ * Plate m starts from initialise_temperatures(), with its bottom boundary scaled by (ENSEMBLE_SIZE - m) / ENSEMBLE_SIZE, so that plate 0 is the plate of the reference outputs and gives their results; a study changes get_bottom_scale() in ensemble.c to describe its variants. The grids take ENSEMBLE_SIZE times the memory of a plate, the stencil is that of FUSED_SWAP.
+ **/
+
+#ifndef ENSEMBLE_H_INCLUDED
+#define ENSEMBLE_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef ENSEMBLE
+	#if defined(IN_PLACE) || defined(TEMPORAL_BLOCKING) || defined(RED_BLACK_SOR) || defined(ACTIVE_FRONTIER)
+		#error "ENSEMBLE has its own sweep over the interleaved plates: it supports none of IN_PLACE, TEMPORAL_BLOCKING, RED_BLACK_SOR and ACTIVE_FRONTIER."
+	#endif
+
+	#ifndef ENSEMBLE_SIZE
+		/// Number of plates solved together, can be overriden with a define at compilation time. It is the length of the vectorised loop, 4 or 8 fill the vector registers.
+		#define ENSEMBLE_SIZE 4
+	#endif
+
+	/**
+	 * @brief Solves the plates of the ensemble, then prints the summary of the run and the results of each plate.
+	 * @return EXIT_SUCCESS.
+	 * @pre The dimensions are set, see initialise_dimensions() with RUNTIME_GRID.
+	 **/
+	int run_ensemble(void);
+#endif
+
+#endif
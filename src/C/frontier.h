@@ -0,0 +1,53 @@
+/**
+ * @file frontier.h
+ * @brief This file contains the active frontier used by the CPU versions with the optional mode ACTIVE_FRONTIER.
+ * @details initialise_temperatures() sets the whole interior to 0, and heat only enters through the right and bottom boundaries, one cell further per iteration. During iteration n, a cell further than n cells from the right boundary and from the bottom boundary therefore averages four neighbours that are all still exactly 0, and computing it gives 0 with a temperature change of 0. With ACTIVE_FRONTIER, each row is computed from the first column that heat may have reached, unless the row itself is within reach of the bottom boundary. The cells skipped already hold 0 in both grids, so results are bit-identical. The big version converges long before heat crosses the plate, and this skips about three quarters of its work.
+ **/
+
+#ifndef FRONTIER_H_INCLUDED
+#define FRONTIER_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef ROWS_GLOBAL
+	/// Number of rows of the whole plate (excluding boundaries).
+	#define FRONTIER_PLATE_ROWS ROWS_GLOBAL
+#else
+	/// Number of rows of the whole plate (excluding boundaries).
+	#define FRONTIER_PLATE_ROWS ROWS
+#endif
+
+#ifdef ACTIVE_FRONTIER
+	/**
+	 * @brief Gives the first column of a row that may change during an iteration.
+	 * @param[in] iteration The iteration, the first one being 1.
+	 * @param[in] global_row The row, in the plate: the first row of the plate is 1, its bottom boundary FRONTIER_PLATE_ROWS+1.
+	 * @param[in] column_offset The column, in the plate, of column 0 of the grid. It is 0, except for the tiles of the mode CARTESIAN_2D.
+	 * @param[in] first The first column of the grid that the loop computes.
+	 * @param[in] last The last column of the grid that the loop computes.
+	 * @return The first column to compute, between \p first and \p last + 1. The latter means that the whole row is skipped.
+	 **/
+	static inline int frontier_first_column(int iteration, int global_row, int column_offset, int first, int last)
+	{
+		// Within reach of the bottom boundary, the whole row may have warmed up
+		if(global_row > FRONTIER_PLATE_ROWS - iteration)
+		{
+			return first;
+		}
+
+		int column = COLUMNS + 1 - iteration - column_offset;
+		if(column < first)
+		{
+			return first;
+		}
+		return (column > last + 1) ? last + 1 : column;
+	}
+
+	/// First column of a row to compute during an iteration, see frontier_first_column().
+	#define FRONTIER_FIRST_COLUMN(iteration, global_row, column_offset, first, last) frontier_first_column((iteration), (global_row), (column_offset), (first), (last))
+#else
+	/// First column of a row to compute during an iteration: all of them by default.
+	#define FRONTIER_FIRST_COLUMN(iteration, global_row, column_offset, first, last) (first)
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * @file grid.c
+ **/
+
+#define _GNU_SOURCE // posix_memalign, madvise
+#include "grid.h"
+#include "util.h"
+#include "precision.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // posix_memalign, free, exit
+#include <string.h> // memset
+#include <sys/mman.h> // madvise
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_Abort
+#endif
+
+#ifdef _OPENMP
+/**
+ * @brief Sets to 0 the cells of rows \p first_row to \p last_row, and columns \p first_column to \p last_column, of a grid.
+ * @param[out] grid The grid.
+ * @param[in] columns The number of columns of the grid, excluding boundaries.
+ * @param[in] first_row The first row set.
+ * @param[in] last_row The last row set.
+ * @param[in] first_column The first column set.
+ * @param[in] last_column The last column set.
+ **/
+static void touch_cells(void* grid, int columns, int first_row, int last_row, int first_column, int last_column)
+{
+	temperature_t (*cells)[columns+2] = grid;
+	for(int i = first_row; i <= last_row; i++)
+	{
+		memset(&cells[i][first_column], 0, sizeof(temperature_t) * (last_column - first_column + 1));
+	}
+}
+#endif
+
+void* allocate_grid(int rows, int columns)
+{
+	const struct grid_partition_t partition = {GRID_PARTITION_ROWS, 0, 0, 0};
+	return allocate_partitioned_grid(rows, columns, &partition);
+}
+
+void* allocate_partitioned_grid(int rows, int columns, const struct grid_partition_t* partition)
+{
+	size_t size = sizeof(temperature_t) * (rows + 2) * (columns + 2);
+	int use_huge_pages = (get_setting("LAPLACE_HUGE_PAGES", 0) == 1);
+	void* grid = NULL;
+
+	if(posix_memalign(&grid, use_huge_pages ? HUGE_PAGE_SIZE : GRID_ALIGNMENT, size) != 0)
+	{
+		printf("Could not allocate a grid of %zu bytes.\n", size);
+		#ifdef VERSION_RUN_IS_MPI
+			// The grids of the MPI versions may be allocated before MPI is initialised
+			int mpi_initialised;
+			MPI_Initialized(&mpi_initialised);
+			if(mpi_initialised)
+			{
+				MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+			}
+		#endif
+		exit(EXIT_FAILURE);
+	}
+
+	#ifdef MADV_HUGEPAGE
+		// Must be done before the first touch, pages already faulted in are not promoted straight away
+		if(use_huge_pages)
+		{
+			madvise(grid, size, MADV_HUGEPAGE);
+		}
+	#endif
+
+	#ifdef _OPENMP
+		// First touch, with the same partition as the compute loops
+		switch(partition->kind)
+		{
+			case GRID_PARTITION_ROWS:
+				#pragma omp parallel for schedule(static)
+				for(int i = 1; i <= rows; i++)
+				{
+					touch_cells(grid, columns, i, i, 0, columns + 1);
+				}
+				break;
+			case GRID_PARTITION_NESTED_ROWS:
+				// The hybrid CPU version enables nested parallelism too, before its first iteration
+				omp_set_nested(1);
+				#pragma omp parallel num_threads(2)
+				{
+					if(omp_get_thread_num() == 0)
+					{
+						touch_cells(grid, columns, 1, partition->outer_rows, 0, columns + 1);
+						touch_cells(grid, columns, rows - partition->outer_rows + 1, rows, 0, columns + 1);
+					}
+					else
+					{
+						#pragma omp parallel for num_threads(omp_get_max_threads()-1)
+						for(int i = partition->outer_rows + 1; i <= rows - partition->outer_rows; i++)
+						{
+							touch_cells(grid, columns, i, i, 0, columns + 1);
+						}
+					}
+				}
+				break;
+			case GRID_PARTITION_TILES:
+				#pragma omp parallel for collapse(2) schedule(static)
+				for(int tile_row = 1; tile_row <= rows; tile_row += partition->tile_rows)
+				{
+					for(int tile_column = 1; tile_column <= columns; tile_column += partition->tile_columns)
+					{
+						int last_row = (tile_row + partition->tile_rows - 1 < rows) ? tile_row + partition->tile_rows - 1 : rows;
+						int last_column = (tile_column + partition->tile_columns - 1 < columns) ? tile_column + partition->tile_columns - 1 : columns;
+						touch_cells(grid, columns, tile_row, last_row, tile_column, last_column);
+					}
+				}
+				// The boundary columns, in pages the tiles next to them faulted in already
+				for(int i = 1; i <= rows; i++)
+				{
+					touch_cells(grid, columns, i, i, 0, 0);
+					touch_cells(grid, columns, i, i, columns + 1, columns + 1);
+				}
+				break;
+		}
+		touch_cells(grid, columns, 0, 0, 0, columns + 1);
+		touch_cells(grid, columns, rows + 1, rows + 1, 0, columns + 1);
+	#else
+		// A single thread computes every cell
+		(void)partition;
+		memset(grid, 0, size);
+	#endif
+
+	return grid;
+}
+
+void free_grid(void* grid)
+{
+	free(grid);
+}
@@ -0,0 +1,61 @@
+/**
+ * @file grid.h
+ * @brief This file contains the allocation of temperature grids on the heap, used by the optional mode HEAP_GRIDS.
+ * @details By default the grids are automatic arrays declared in main(), which places them on the stack and lets the thread that initialises them, alone, fault all their pages in. On multi-socket nodes all the memory then ends up on the first socket.
+ **/
+
+#ifndef GRID_H_INCLUDED
+#define GRID_H_INCLUDED
+
+/// Alignment of the grids allocated, in bytes.
+#define GRID_ALIGNMENT 64
+/// Size of a huge page, in bytes.
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/// How the compute loops share the cells of a grid out among OpenMP threads, which the first touch of the grid reproduces.
+enum grid_partition_kind_t
+{
+	/// The rows, by a loop of the whole team with a static schedule. That of the OpenMP version.
+	GRID_PARTITION_ROWS,
+	/// The outer rows by the first thread of a team of two, the rows between them by a loop of all threads but one nested in the second thread. That of the hybrid CPU version.
+	GRID_PARTITION_NESTED_ROWS,
+	/// Tiles of rows and columns, by a loop of the whole team collapsed over both with a static schedule. That of TEMPORAL_BLOCKING.
+	GRID_PARTITION_TILES
+};
+
+/// The partition of a grid among OpenMP threads.
+struct grid_partition_t
+{
+	/// How the cells are shared out.
+	enum grid_partition_kind_t kind;
+	/// With GRID_PARTITION_NESTED_ROWS, the number of rows at each end taken by the first thread.
+	int outer_rows;
+	/// With GRID_PARTITION_TILES, the number of rows of a tile.
+	int tile_rows;
+	/// With GRID_PARTITION_TILES, the number of columns of a tile.
+	int tile_columns;
+};
+
+/**
+ * @brief Allocates a temperature grid of (rows+2) x (columns+2) cells on the heap, cells being temperature_t, see precision.h.
+ * @details The grid is aligned on GRID_ALIGNMENT bytes. If the setting LAPLACE_HUGE_PAGES is 1, it is instead aligned on a huge page and the kernel is advised to back it with transparent huge pages. All cells are set to 0, rows being first touched in parallel with the static row partition of GRID_PARTITION_ROWS, so that each row is placed on the NUMA node of the thread that will compute it.
+ * @param[in] rows The number of rows of the grid, excluding boundaries. It is ROWS, except for the tiles of the mode CARTESIAN_2D.
+ * @param[in] columns The number of columns of the grid, excluding boundaries. It is COLUMNS, except for the tiles of the mode CARTESIAN_2D.
+ * @return The grid allocated, to release with free_grid(). The program is stopped if the allocation fails.
+ **/
+void* allocate_grid(int rows, int columns);
+/**
+ * @brief Allocates a temperature grid like allocate_grid(), first touched with the partition of the compute loops that sweep it.
+ * @param[in] rows The number of rows of the grid, excluding boundaries.
+ * @param[in] columns The number of columns of the grid, excluding boundaries.
+ * @param[in] partition How the compute loops share the cells out. The boundaries, and the boundary columns of tiles, are touched by the calling thread once the cells next to them are.
+ * @return The grid allocated, to release with free_grid(). The program is stopped if the allocation fails.
+ **/
+void* allocate_partitioned_grid(int rows, int columns, const struct grid_partition_t* partition);
+/**
+ * @brief Releases a grid allocated with allocate_grid().
+ * @param[in] grid The grid to release.
+ **/
+void free_grid(void* grid);
+
+#endif
@@ -0,0 +1,289 @@
+/**
+ * @file halo.c
+ **/
+
+#include "halo.h"
+#include "util.h"
+#include <string.h> // memcpy
+#include <mpi.h> // MPI_*
+
+#if defined(PERSISTENT_HALO) && !defined(CARTESIAN_2D)
+void create_halo_swaps(MPI_Request requests[HALO_SWAP_SETS][HALO_SWAP_REQUESTS], double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2])
+{
+	// Retrieve my MPI information
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+	int top = (my_rank == 0) ? MPI_PROC_NULL : my_rank - 1;
+	int bottom = (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1;
+
+	// The grid sent from, and that whose halos receive
+	#ifdef FUSED_SWAP
+		double (*sent[HALO_SWAP_SETS])[COLUMNS+2] = {temperature, temperature_last};
+		double (*received[HALO_SWAP_SETS])[COLUMNS+2] = {temperature, temperature_last};
+	#else
+		double (*sent[HALO_SWAP_SETS])[COLUMNS+2] = {temperature};
+		double (*received[HALO_SWAP_SETS])[COLUMNS+2] = {temperature_last};
+	#endif
+
+	for(int s = 0; s < HALO_SWAP_SETS; s++)
+	{
+		// Rows travelling to the bottom neighbour are tagged 0, those travelling to the top one 1
+		MPI_Recv_init(&received[s][1 - HALO_WIDTH][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, top, 0, MPI_COMM_WORLD, &requests[s][0]);
+		MPI_Send_init(&sent[s][1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, top, 1, MPI_COMM_WORLD, &requests[s][1]);
+		MPI_Recv_init(&received[s][ROWS + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, bottom, 1, MPI_COMM_WORLD, &requests[s][2]);
+		MPI_Send_init(&sent[s][ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, bottom, 0, MPI_COMM_WORLD, &requests[s][3]);
+	}
+}
+#endif
+
+#ifdef PERSISTENT_HALO
+void free_halo_swaps(MPI_Request requests[HALO_SWAP_SETS][HALO_SWAP_REQUESTS])
+{
+	for(int s = 0; s < HALO_SWAP_SETS; s++)
+	{
+		for(int r = 0; r < HALO_SWAP_REQUESTS; r++)
+		{
+			MPI_Request_free(&requests[s][r]);
+		}
+	}
+}
+#endif
+
+#ifdef RMA_HALO
+
+/// Displacement, in a window, of a cell of the grid exposed in it.
+#define RMA_DISPLACEMENT(row, column) ((MPI_Aint)((row) + HALO_OFFSET) * (COLUMNS + 2) + (column))
+
+void create_rma_halos(struct rma_halo_t* rma, double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2])
+{
+	// Retrieve my MPI information
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+	rma->top = (my_rank == 0) ? MPI_PROC_NULL : my_rank - 1;
+	rma->bottom = (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1;
+
+	// The grids whose halos receive
+	#ifdef FUSED_SWAP
+		double (*received[RMA_HALO_WINDOWS])[COLUMNS+2] = {temperature, temperature_last};
+	#else
+		// Only the last grid receives halos when the swap is not fused
+		(void)temperature;
+		double (*received[RMA_HALO_WINDOWS])[COLUMNS+2] = {temperature_last};
+	#endif
+
+	// Windows are only ever synchronised with post-start-complete-wait
+	MPI_Info info;
+	MPI_Info_create(&info);
+	MPI_Info_set(info, "no_locks", "true");
+	for(int w = 0; w < RMA_HALO_WINDOWS; w++)
+	{
+		rma->bases[w] = &received[w][-HALO_OFFSET][0];
+		MPI_Win_create(rma->bases[w], sizeof(double) * (ROWS + 2 * HALO_WIDTH) * (COLUMNS + 2), sizeof(double), info, MPI_COMM_WORLD, &rma->windows[w]);
+	}
+	MPI_Info_free(&info);
+
+	int neighbours[2];
+	int neighbour_count = 0;
+	if(rma->top != MPI_PROC_NULL)
+	{
+		neighbours[neighbour_count++] = rma->top;
+	}
+	if(rma->bottom != MPI_PROC_NULL)
+	{
+		neighbours[neighbour_count++] = rma->bottom;
+	}
+	MPI_Group world_group;
+	MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+	MPI_Group_incl(world_group, neighbour_count, neighbours, &rma->neighbours);
+	MPI_Group_free(&world_group);
+}
+
+void swap_rma_halos(const struct rma_halo_t* rma, double (*temperature)[COLUMNS+2], double (*temperature_next)[COLUMNS+2])
+{
+	// The neighbours play the same roles as mine to their grids
+	MPI_Win window = rma->windows[0];
+	for(int w = 1; w < RMA_HALO_WINDOWS; w++)
+	{
+		if(rma->bases[w] == &temperature_next[-HALO_OFFSET][0])
+		{
+			window = rma->windows[w];
+		}
+	}
+
+	// My halos may be written once I have read them, and I write those of my neighbours once they have read theirs
+	MPI_Win_post(rma->neighbours, 0, window);
+	MPI_Win_start(rma->neighbours, 0, window);
+	if(rma->top != MPI_PROC_NULL)
+	{
+		// My top rows into the bottom halo of my top neighbour
+		MPI_Put(&temperature[1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, rma->top, RMA_DISPLACEMENT(GRID_ROWS_OF(rma->top) + 1, HALO_FIRST_COLUMN), HALO_CELLS, MPI_DOUBLE, window);
+	}
+	if(rma->bottom != MPI_PROC_NULL)
+	{
+		// My bottom rows into the top halo of my bottom neighbour
+		MPI_Put(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, rma->bottom, RMA_DISPLACEMENT(1 - HALO_WIDTH, HALO_FIRST_COLUMN), HALO_CELLS, MPI_DOUBLE, window);
+	}
+	MPI_Win_complete(window);
+	MPI_Win_wait(window);
+}
+
+void free_rma_halos(struct rma_halo_t* rma)
+{
+	for(int w = 0; w < RMA_HALO_WINDOWS; w++)
+	{
+		MPI_Win_free(&rma->windows[w]);
+	}
+	MPI_Group_free(&rma->neighbours);
+}
+
+#endif
+
+#ifdef SHARED_HALO
+
+/// The grid of an MPI process of my node that plays the same role as one of mine.
+#define NEIGHBOUR_GRID(neighbour_base, base, grid) ((double (*)[COLUMNS+2])((neighbour_base) + ((double*)(grid) - (base))))
+
+void create_shared_grids(struct shared_grids_t* shared, double (**temperature)[COLUMNS+2], double (**temperature_last)[COLUMNS+2])
+{
+	// Retrieve my MPI information
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+
+	// Ranks are kept in order, so that consecutive ranks placed on a node are neighbours there too
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &shared->node);
+	MPI_Comm_rank(shared->node, &shared->node_rank);
+	MPI_Comm_split(MPI_COMM_WORLD, (shared->node_rank == 0) ? 0 : MPI_UNDEFINED, my_rank, &shared->leaders);
+
+	// Each MPI process gets its own segment, which lets it sit on the memory closest to the MPI process first touching it
+	MPI_Info info;
+	MPI_Info_create(&info);
+	MPI_Info_set(info, "alloc_shared_noncontig", "true");
+	// Every grid is as big as the biggest, so that those of my neighbours are laid out like mine
+	MPI_Aint grid_cells = (MPI_Aint)(GRID_ROWS_MAX + 2 * HALO_WIDTH) * (COLUMNS + 2);
+	MPI_Win_allocate_shared(2 * grid_cells * sizeof(double), sizeof(double), info, shared->node, &shared->base, &shared->window);
+	MPI_Info_free(&info);
+	*temperature = (double (*)[COLUMNS+2])shared->base + HALO_OFFSET;
+	*temperature_last = (double (*)[COLUMNS+2])(shared->base + grid_cells) + HALO_OFFSET;
+
+	// My neighbours on my node, if any
+	int neighbours[2] = {(my_rank == 0) ? MPI_PROC_NULL : my_rank - 1, (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1};
+	int node_neighbours[2];
+	MPI_Group world_group;
+	MPI_Group node_group;
+	MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+	MPI_Comm_group(shared->node, &node_group);
+	MPI_Group_translate_ranks(world_group, 2, neighbours, node_group, node_neighbours);
+	MPI_Group_free(&world_group);
+	MPI_Group_free(&node_group);
+
+	double* neighbour_bases[2] = {NULL, NULL};
+	int remotes[2] = {MPI_PROC_NULL, MPI_PROC_NULL};
+	for(int n = 0; n < 2; n++)
+	{
+		if(node_neighbours[n] == MPI_UNDEFINED)
+		{
+			remotes[n] = neighbours[n];
+		}
+		else if(node_neighbours[n] != MPI_PROC_NULL)
+		{
+			MPI_Aint size;
+			int displacement_unit;
+			MPI_Win_shared_query(shared->window, node_neighbours[n], &size, &displacement_unit, &neighbour_bases[n]);
+		}
+	}
+	shared->top_base = neighbour_bases[0];
+	shared->bottom_base = neighbour_bases[1];
+	shared->top_remote = remotes[0];
+	shared->bottom_remote = remotes[1];
+	shared->top_rows = (my_rank == 0) ? 0 : GRID_ROWS_OF(my_rank - 1);
+
+	// A single passive epoch for the whole run, in which MPI_Win_sync() orders the accesses to the window
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, shared->window);
+}
+
+void swap_shared_halos(const struct shared_grids_t* shared, double (*temperature)[COLUMNS+2], double (*temperature_next)[COLUMNS+2])
+{
+	// Messages with the neighbours on other nodes, tagged like the default halo swap
+	MPI_Request requests[HALO_SWAP_REQUESTS];
+	MPI_Irecv(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, shared->top_remote, 0, MPI_COMM_WORLD, &requests[0]);
+	MPI_Isend(&temperature[1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, shared->top_remote, 1, MPI_COMM_WORLD, &requests[1]);
+	MPI_Irecv(&temperature_next[ROWS + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, shared->bottom_remote, 1, MPI_COMM_WORLD, &requests[2]);
+	MPI_Isend(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_DOUBLE, shared->bottom_remote, 0, MPI_COMM_WORLD, &requests[3]);
+
+	// My rows are written, the rows of the neighbours on my node are read once they have written theirs
+	MPI_Win_sync(shared->window);
+	MPI_Barrier(shared->node);
+	MPI_Win_sync(shared->window);
+	if(shared->top_base != NULL)
+	{
+		memcpy(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN], &NEIGHBOUR_GRID(shared->top_base, shared->base, temperature)[shared->top_rows - HALO_WIDTH + 1][HALO_FIRST_COLUMN], sizeof(double) * HALO_CELLS);
+	}
+	if(shared->bottom_base != NULL)
+	{
+		memcpy(&temperature_next[ROWS + 1][HALO_FIRST_COLUMN], &NEIGHBOUR_GRID(shared->bottom_base, shared->base, temperature)[1][HALO_FIRST_COLUMN], sizeof(double) * HALO_CELLS);
+	}
+	#if defined(DEFERRED_CONVERGENCE) && !defined(FUSED_SWAP)
+		// Without a reduction at every iteration, nothing else keeps the neighbours from computing over those rows before they are read.
+		// With FUSED_SWAP they are only overwritten two iterations later, after the next halo swap.
+		MPI_Barrier(shared->node);
+	#endif
+
+	MPI_Waitall(HALO_SWAP_REQUESTS, requests, MPI_STATUSES_IGNORE);
+}
+
+double reduce_shared(const struct shared_grids_t* shared, double dt)
+{
+	// The maximum is exact whatever the order, so this finds the same value as a single reduction
+	double dt_node;
+	double dt_global;
+	MPI_Reduce(&dt, &dt_node, 1, MPI_DOUBLE, MPI_MAX, 0, shared->node);
+	if(shared->node_rank == 0)
+	{
+		MPI_Allreduce(&dt_node, &dt_global, 1, MPI_DOUBLE, MPI_MAX, shared->leaders);
+	}
+	MPI_Bcast(&dt_global, 1, MPI_DOUBLE, 0, shared->node);
+	return dt_global;
+}
+
+void free_shared_grids(struct shared_grids_t* shared)
+{
+	MPI_Win_unlock_all(shared->window);
+	MPI_Win_free(&shared->window);
+	if(shared->leaders != MPI_COMM_NULL)
+	{
+		MPI_Comm_free(&shared->leaders);
+	}
+	MPI_Comm_free(&shared->node);
+}
+
+#endif
+
+#ifdef DEEP_HALO
+
+void initialise_halos(double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2])
+{
+	// Retrieve my MPI information
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+	int top = (my_rank == 0) ? MPI_PROC_NULL : my_rank - 1;
+	int bottom = (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1;
+
+	// Bottom rows to the bottom neighbour, top halo from the top one, and the other way round
+	MPI_Sendrecv(&temperature_last[ROWS - HALO_WIDTH + 1][0], HALO_CELLS, MPI_DOUBLE, bottom, 0,
+				 &temperature_last[1 - HALO_WIDTH][0], HALO_CELLS, MPI_DOUBLE, top, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(&temperature_last[1][0], HALO_CELLS, MPI_DOUBLE, top, 1,
+				 &temperature_last[ROWS + 1][0], HALO_CELLS, MPI_DOUBLE, bottom, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+	memcpy(temperature[1 - HALO_WIDTH], temperature_last[1 - HALO_WIDTH], sizeof(double) * HALO_CELLS);
+	memcpy(temperature[ROWS + 1], temperature_last[ROWS + 1], sizeof(double) * HALO_CELLS);
+}
+
+#endif
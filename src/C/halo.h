@@ -0,0 +1,207 @@
+/**
+ * @file halo.h
+ * @brief This file contains the layout and schedule of the halos swapped by the 1D decomposition of the MPI versions, and the persistent requests that can swap them.
+ * @details By default each MPI process has one halo row per neighbour, swapped at every iteration. With the optional mode DEEP_HALO it has HALO_WIDTH of them, swapped every HALO_WIDTH iterations only. In between, the halo rows are computed redundantly, one less at every iteration, as the neighbour computes them too. Rows 1-HALO_WIDTH to 0 and ROWS+1 to ROWS+HALO_WIDTH of a grid are its halos, which is why grids are declared with HALO_OFFSET extra rows on each side.
+ * With the optional mode PERSISTENT_HALO, the requests of the halo swap are created once, before the first iteration, and only started and completed at every iteration, which saves MPI matching its arguments again. This applies to the 2D decomposition too, see decomposition.h.
+ * With the optional mode RMA_HALO, the halo swap can be done with one-sided communications instead: the halo rows of each grid are exposed in an MPI window, into which the neighbours put their rows. Each swap is a post-start-complete-wait epoch between an MPI process and its neighbours only, so there is neither tag matching nor rendezvous handshake. The setting LAPLACE_HALO_TRANSPORT picks the transport at runtime: 1, the default, for one-sided communications, 2 for the MPI_Send/MPI_Recv of the default halo swap.
+ * With the optional mode SHARED_HALO, the grids of all the MPI processes of a node are allocated in a single MPI-3 shared memory window. A neighbour on the same node has its rows copied straight from its grid once the node has synchronised, only neighbours on other nodes exchange messages. The temperature change is reduced within each node first, then across nodes.
+ **/
+
+#ifndef HALO_H_INCLUDED
+#define HALO_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef DEEP_HALO
+	#ifdef CARTESIAN_2D
+		#error "DEEP_HALO does not support CARTESIAN_2D."
+	#endif
+	#ifndef HALO_WIDTH
+		/// Number of halo rows per neighbour, can be overriden with a define at compilation time.
+		#define HALO_WIDTH 4
+	#endif
+	/// First column swapped. The halo rows are computed, so they need the boundary columns of the neighbour too.
+	#define HALO_FIRST_COLUMN 0
+	/// Number of cells swapped with each neighbour.
+	#define HALO_CELLS (HALO_WIDTH * (COLUMNS + 2))
+#else
+	/// Number of halo rows per neighbour.
+	#define HALO_WIDTH 1
+	/// First column swapped.
+	#define HALO_FIRST_COLUMN 1
+	/// Number of cells swapped with each neighbour.
+	#define HALO_CELLS COLUMNS
+#endif
+
+// Checked by initialise_dimensions() when ROWS is only known at runtime
+#if !defined(DIMENSIONS_AT_RUNTIME) && ROWS < 2 * HALO_WIDTH
+	#error "Each MPI process must have at least 2 * HALO_WIDTH rows."
+#endif
+
+/// Number of rows a grid has on each side, beyond its row 0 and row ROWS+1.
+#define HALO_OFFSET (HALO_WIDTH - 1)
+/// Tells whether halos are swapped at the end of an iteration. The first cycle is only 1 iteration long, during which the halos set by initialise_temperatures() are valid.
+#define HALO_SWAP_DUE(iteration) ((((iteration) - 1) % HALO_WIDTH) == 0)
+/// Number of halo rows, on each side, computed during an iteration. They are read during the next one.
+#define HALO_EXTENSION(iteration) (HALO_WIDTH - 1 - ((iteration) + HALO_WIDTH - 2) % HALO_WIDTH)
+
+#ifdef CARTESIAN_2D
+	/// Number of requests used by a halo swap: a receive and a send per neighbour.
+	#define HALO_SWAP_REQUESTS 8
+#else
+	/// Number of requests used by a halo swap: a receive and a send per neighbour. In order: top receive, top send, bottom receive, bottom send.
+	#define HALO_SWAP_REQUESTS 4
+#endif
+
+#ifdef PERSISTENT_HALO
+	#include <mpi.h> // MPI_*
+
+	#ifdef FUSED_SWAP
+		/// Number of sets of persistent requests. A persistent request is bound to its buffer, and FUSED_SWAP alternates the roles of the grids, so each grid has its own set.
+		#define HALO_SWAP_SETS 2
+	#else
+		/// Number of sets of persistent requests.
+		#define HALO_SWAP_SETS 1
+	#endif
+	/// The set of persistent requests that swaps the halos at the end of an iteration.
+	#define HALO_SWAP_SET(iteration) ((iteration) % HALO_SWAP_SETS)
+
+	/**
+	 * @brief Creates the persistent requests of the halo swap of the 1D decomposition.
+	 * @details Neighbours beyond the plate boundaries are MPI_PROC_NULL, the matching requests complete straight away. The requests are created inactive, so completing a set that was never started returns straight away too.
+	 * @param[out] requests The sets of requests to start with MPI_Startall() and to release with free_halo_swaps().
+	 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[in] temperature_last The 2D array that contains the previous iteration temperatures.
+	 **/
+	void create_halo_swaps(MPI_Request requests[HALO_SWAP_SETS][HALO_SWAP_REQUESTS], double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2]);
+	/**
+	 * @brief Releases the persistent requests of the halo swap.
+	 * @param[inout] requests The sets of requests to release, none of which may be active.
+	 **/
+	void free_halo_swaps(MPI_Request requests[HALO_SWAP_SETS][HALO_SWAP_REQUESTS]);
+#endif
+
+#ifdef RMA_HALO
+	#include <mpi.h> // MPI_*
+
+	#if defined(CARTESIAN_2D) || defined(OVERLAP) || defined(PERSISTENT_HALO) || defined(SHARED_HALO)
+		#error "RMA_HALO supports none of CARTESIAN_2D, OVERLAP, PERSISTENT_HALO and SHARED_HALO."
+	#endif
+
+	#ifdef FUSED_SWAP
+		/// Number of grids receiving halos, each exposed in its own window. FUSED_SWAP alternates the roles of the grids.
+		#define RMA_HALO_WINDOWS 2
+	#else
+		/// Number of grids receiving halos, each exposed in its own window.
+		#define RMA_HALO_WINDOWS 1
+	#endif
+
+	/// The windows in which the neighbours of an MPI process put their rows.
+	struct rma_halo_t
+	{
+		/// The window of each grid receiving halos.
+		MPI_Win windows[RMA_HALO_WINDOWS];
+		/// The first row, halo rows included, of each grid receiving halos.
+		double* bases[RMA_HALO_WINDOWS];
+		/// My neighbours, which are both the origins and the targets of my epochs.
+		MPI_Group neighbours;
+		/// The rank of my top neighbour, MPI_PROC_NULL if I am the first MPI process.
+		int top;
+		/// The rank of my bottom neighbour, MPI_PROC_NULL if I am the last MPI process.
+		int bottom;
+	};
+
+	/**
+	 * @brief Exposes the grids receiving halos in windows.
+	 * @param[out] rma The windows, to release with free_rma_halos().
+	 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[in] temperature_last The 2D array that contains the previous iteration temperatures.
+	 **/
+	void create_rma_halos(struct rma_halo_t* rma, double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2]);
+	/**
+	 * @brief Swaps the halos of the 1D decomposition by putting my outer rows into the halos of my neighbours.
+	 * @param[in] rma The windows.
+	 * @param[in] temperature The 2D array whose outer rows are sent.
+	 * @param[out] temperature_next The 2D array whose halos receive those of the neighbours. Its role in the neighbours is that of one of the grids given to create_rma_halos().
+	 **/
+	void swap_rma_halos(const struct rma_halo_t* rma, double (*temperature)[COLUMNS+2], double (*temperature_next)[COLUMNS+2]);
+	/**
+	 * @brief Releases the windows and the group of neighbours.
+	 * @param[inout] rma The windows.
+	 **/
+	void free_rma_halos(struct rma_halo_t* rma);
+#endif
+
+#ifdef SHARED_HALO
+	#include <mpi.h> // MPI_*
+
+	#if defined(CARTESIAN_2D) || defined(OVERLAP) || defined(PERSISTENT_HALO) || defined(IN_PLACE)
+		#error "SHARED_HALO supports none of CARTESIAN_2D, OVERLAP, PERSISTENT_HALO and IN_PLACE."
+	#endif
+
+	/// The node of an MPI process, and the grids it shares with the other MPI processes of that node.
+	struct shared_grids_t
+	{
+		/// The MPI processes of my node.
+		MPI_Comm node;
+		/// My rank in the communicator node.
+		int node_rank;
+		/// The first MPI process of every node, MPI_COMM_NULL on the other MPI processes.
+		MPI_Comm leaders;
+		/// The window holding the two grids of every MPI process of the node.
+		MPI_Win window;
+		/// My two grids, halo rows included, one after the other.
+		double* base;
+		/// The two grids of my top neighbour if it is on my node, NULL otherwise.
+		double* top_base;
+		/// The two grids of my bottom neighbour if it is on my node, NULL otherwise.
+		double* bottom_base;
+		/// The rank of my top neighbour if it is on another node, MPI_PROC_NULL otherwise.
+		int top_remote;
+		/// The rank of my bottom neighbour if it is on another node, MPI_PROC_NULL otherwise.
+		int bottom_remote;
+		/// The number of rows of my top neighbour, which may differ from mine with RUNTIME_GRID.
+		int top_rows;
+	};
+
+	/**
+	 * @brief Finds the MPI processes of my node and allocates my two grids in the window they share.
+	 * @param[out] shared The node and the window, to release with free_shared_grids().
+	 * @param[out] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[out] temperature_last The 2D array that contains the previous iteration temperatures.
+	 **/
+	void create_shared_grids(struct shared_grids_t* shared, double (**temperature)[COLUMNS+2], double (**temperature_last)[COLUMNS+2]);
+	/**
+	 * @brief Swaps the halos of the 1D decomposition, copying those of the neighbours on my node and exchanging messages with the others.
+	 * @details Every MPI process of the node must call it, since the rows of neighbours are only read once the whole node has computed them.
+	 * @param[in] shared The node and the window.
+	 * @param[in] temperature The 2D array whose outer rows are sent.
+	 * @param[out] temperature_next The 2D array whose halos receive those of the neighbours.
+	 **/
+	void swap_shared_halos(const struct shared_grids_t* shared, double (*temperature)[COLUMNS+2], double (*temperature_next)[COLUMNS+2]);
+	/**
+	 * @brief Finds the largest temperature change across all MPI processes, within my node first and then across nodes.
+	 * @param[in] shared The node.
+	 * @param[in] dt My temperature change.
+	 * @return The largest temperature change, on every MPI process.
+	 **/
+	double reduce_shared(const struct shared_grids_t* shared, double dt);
+	/**
+	 * @brief Releases the window and the communicators, the grids of the window are no longer valid afterwards.
+	 * @param[inout] shared The node and the window.
+	 **/
+	void free_shared_grids(struct shared_grids_t* shared);
+#endif
+
+#ifdef DEEP_HALO
+	/**
+	 * @brief Fills the halo rows of both grids with the rows of the neighbours.
+	 * @details The halo rows computed redundantly read the boundary columns of the neighbour, which never change but which are only swapped into one grid at a time. This swaps them once into both, before the first iteration.
+	 * @param[inout] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[inout] temperature_last The 2D array that contains the previous iteration temperatures.
+	 * @pre Both grids have been initialised with initialise_temperatures().
+	 **/
+	void initialise_halos(double (*temperature)[COLUMNS+2], double (*temperature_last)[COLUMNS+2]);
+#endif
+
+#endif
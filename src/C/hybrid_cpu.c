@@ -11,19 +11,202 @@
 #include <math.h> // fabs
 #include <mpi.h> // MPI_*
 #include <string.h> // strcmp
+#include <omp.h>
 #include "util.h"
+#include "grid.h"
+#include "precision.h"
+#include "stencil.h"
+#include "frontier.h"
+#include "halo.h"
+#include "decomposition.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "checkpoint.h"
+#include "placement.h"
+#include "checksum.h"
+
+#ifdef CARTESIAN_2D
+	// The west and east columns read halos too, they are computed by the communication thread
+	#define FIRST_INTERIOR_COLUMN 2
+	#define LAST_INTERIOR_COLUMN (LOCAL_COLUMNS - 1)
+#else
+	#define FIRST_INTERIOR_COLUMN 1
+	#define LAST_INTERIOR_COLUMN COLUMNS
+#endif
+
+#ifdef TASK_GRAPH
+	#if defined(CARTESIAN_2D) || defined(DEEP_HALO)
+		#error "TASK_GRAPH supports neither CARTESIAN_2D nor DEEP_HALO."
+	#endif
+	/// Default number of rows of a block, the unit of work of a task, overridden by the environment variable LAPLACE_TASK_ROWS.
+	#ifndef TASK_BLOCK_ROWS
+		#define TASK_BLOCK_ROWS 32
+	#endif
+
+/**
+ * @brief Averages the four neighbours of the cells of a block of rows.
+ * @param[out] temperature The grid written.
+ * @param[in] temperature_last The grid read.
+ * @param[in] first_row The first row of the block.
+ * @param[in] last_row The last row of the block.
+ * @param[in] iteration The current iteration, only read with the mode ACTIVE_FRONTIER.
+ * @param[in] row_offset The row, in the plate, of row 0 of the grids, only read with the mode ACTIVE_FRONTIER.
+ * @return The largest temperature change of the block with FUSED_SWAP, 0 otherwise.
+ **/
+static double stencil_block(temperature_t (*temperature)[COLUMNS+2], temperature_t (*temperature_last)[COLUMNS+2], int first_row, int last_row, int iteration, int row_offset)
+{
+	// Only read with ACTIVE_FRONTIER
+	(void)iteration;
+	(void)row_offset;
+
+	double dt = 0.0;
+	for(int i = first_row; i <= last_row; i++)
+	{
+		const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, 0, 1, COLUMNS);
+		#ifdef ROW_KERNELS
+			#ifdef FUSED_SWAP
+				dt = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column, dt);
+			#else
+				stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column);
+			#endif
+		#else
+			#pragma omp simd reduction(max:dt)
+			for(unsigned int j = first_column; j <= COLUMNS; j++)
+			{
+				temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+											temperature_last[i - 1][j] +
+											temperature_last[i][j + 1] +
+											temperature_last[i][j - 1]);
+				#ifdef FUSED_SWAP
+					dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+				#endif
+			}
+		#endif
+	}
+	return dt;
+}
+
+#ifndef FUSED_SWAP
+/**
+ * @brief Finds the largest temperature change of a block of rows, and copies them to the grid of the last iteration.
+ * @param[inout] temperature_last The grid of the last iteration.
+ * @param[in] temperature The grid of the current iteration.
+ * @param[in] first_row The first row of the block.
+ * @param[in] last_row The last row of the block.
+ * @param[in] iteration The current iteration, only read with the mode ACTIVE_FRONTIER.
+ * @param[in] row_offset The row, in the plate, of row 0 of the grids, only read with the mode ACTIVE_FRONTIER.
+ * @return The largest temperature change of the block.
+ **/
+static double delta_copy_block(temperature_t (*temperature_last)[COLUMNS+2], temperature_t (*temperature)[COLUMNS+2], int first_row, int last_row, int iteration, int row_offset)
+{
+	// Only read with ACTIVE_FRONTIER
+	(void)iteration;
+	(void)row_offset;
+
+	double dt = 0.0;
+	for(int i = first_row; i <= last_row; i++)
+	{
+		const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, 0, 1, COLUMNS);
+		#ifdef ROW_KERNELS
+			dt = delta_copy_row(&temperature_last[i][first_column], &temperature[i][first_column], COLUMNS + 1 - first_column, dt);
+		#else
+			#pragma omp simd reduction(max:dt)
+			for(unsigned int j = first_column; j <= COLUMNS; j++)
+			{
+				dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+				temperature_last[i][j] = temperature[i][j];
+			}
+		#endif
+	}
+	return dt;
+}
+#endif
+
+/**
+ * @brief Completes requests from within a task, letting the thread run other tasks until they complete.
+ * @param[in] count The number of requests.
+ * @param[inout] requests The requests to complete.
+ **/
+static void complete_in_task(int count, MPI_Request* requests)
+{
+	int completed = 0;
+	MPI_Testall(count, requests, &completed, MPI_STATUSES_IGNORE);
+	while(!completed)
+	{
+		#pragma omp taskyield
+		MPI_Testall(count, requests, &completed, MPI_STATUSES_IGNORE);
+	}
+}
+#endif
 
 /**
  * @brief Runs the experiment.
  * @pre The macro 'ROWS' contains the number of rows (excluding boundaries) per MPI process. It is a define passed as a compilation flag, see makefile.
  * @pre The macro 'COLUMNS' contains the number of columns (excluding boundaries). It is a define passed as a compilation flag, see makefile.
+ * @note With RUNTIME_GRID, ROWS and COLUMNS are set at startup instead, see dimensions.h.
+ * @note With CARTESIAN_2D, each MPI process works on a tile of LOCAL_ROWS x LOCAL_COLUMNS cells instead, see decomposition.h.
  **/
 int main(int argc, char *argv[])
 {
-	// Temperature grid.
-	double temperature[ROWS+2][COLUMNS+2];
-	// Temperature grid from last iteration
-	double temperature_last[ROWS+2][COLUMNS+2];
+	#ifdef DIMENSIONS_AT_RUNTIME
+		// The grids below are sized from the dimensions, which need my rank
+		int provided;
+		MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+		initialise_dimensions();
+	#endif
+	#if defined(HEAP_GRIDS) && !defined(TASK_GRAPH)
+		// The outer rows, halos included, are computed by the communication thread, the others by the nested team
+		const struct grid_partition_t partition = {GRID_PARTITION_NESTED_ROWS, HALO_WIDTH + HALO_OFFSET, 0, 0};
+		// Temperature grid.
+		temperature_t (*temperature)[LOCAL_COLUMNS+2] = (temperature_t (*)[LOCAL_COLUMNS+2])allocate_partitioned_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS, &partition) + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = (temperature_t (*)[LOCAL_COLUMNS+2])allocate_partitioned_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS, &partition) + HALO_OFFSET;
+	#elif defined(HEAP_GRIDS)
+		// Temperature grid.
+		temperature_t (*temperature)[LOCAL_COLUMNS+2] = (temperature_t (*)[LOCAL_COLUMNS+2])allocate_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS) + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = (temperature_t (*)[LOCAL_COLUMNS+2])allocate_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS) + HALO_OFFSET;
+	#elif defined(FUSED_SWAP) || defined(DEEP_HALO)
+		// The two temperature grids, including all their halo rows. Their roles alternate at every iteration with FUSED_SWAP.
+		temperature_t temperature_grids[2][LOCAL_ROWS+2*HALO_WIDTH][LOCAL_COLUMNS+2];
+		// Temperature grid.
+		temperature_t (*temperature)[LOCAL_COLUMNS+2] = temperature_grids[0] + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = temperature_grids[1] + HALO_OFFSET;
+	#else
+		// Temperature grid.
+		temperature_t temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2];
+		// Temperature grid from last iteration
+		temperature_t temperature_last[LOCAL_ROWS+2][LOCAL_COLUMNS+2];
+	#endif
+	#ifdef FUSED_SWAP
+		// Used to swap the two grids above.
+		temperature_t (*temperature_swap)[LOCAL_COLUMNS+2];
+		#ifndef TASK_GRAPH
+			// Temperature change of the rows computed by the communication thread
+			double dt_boundaries;
+			// Temperature change of the rows computed by the other threads
+			double dt_interior;
+		#endif
+	#endif
+	#if !defined(PERSISTENT_HALO) || defined(TASK_GRAPH)
+		#ifdef FUSED_SWAP
+			// Grid read during the next iteration, in which halos must be received.
+			temperature_t (*temperature_next)[LOCAL_COLUMNS+2];
+		#else
+			// Grid read during the next iteration, in which halos must be received.
+			temperature_t (*temperature_next)[LOCAL_COLUMNS+2] = temperature_last;
+		#endif
+	#endif
+	#ifdef DEEP_HALO
+		// First and last rows computed during an iteration, halo rows included
+		int first_row;
+		int last_row;
+	#elif !defined(TASK_GRAPH)
+		// First and last rows computed during an iteration
+		const int first_row = 1;
+		const int last_row = LOCAL_ROWS;
+	#endif
 	// Current iteration.
     int iteration = 0;
     // Temperature change for our MPI process
@@ -34,17 +217,23 @@ int main(int argc, char *argv[])
     int comm_size;
     // The rank of my MPI process
     int my_rank;
-    // Status returned by MPI calls
-    MPI_Status status[2];
-
-    // Request returned by MPI calls
-    MPI_Request request[4] = MPI_REQUEST_NULL;
+    #if defined(ACTIVE_FRONTIER) && !defined(TASK_GRAPH)
+        // Row and column, in the plate, of my cell [0][0]. The tasks are given their row straight away.
+        int row_offset;
+        int column_offset;
+    #endif
+    #ifdef CHECKPOINT
+        // The checkpoint file, written every few iterations
+        struct checkpoint_t checkpoint;
+    #endif
 
     MPI_Datatype column;
     // The usual MPI startup routines
-	int provided;
-	MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
-        MPI_Type_contiguous(COLUMNS, MPI_DOUBLE, &column);
+	#ifndef DIMENSIONS_AT_RUNTIME
+		int provided;
+		MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+	#endif
+        MPI_Type_contiguous(HALO_CELLS, MPI_TEMPERATURE, &column);
         MPI_Type_commit(&column);
 	if(provided < MPI_THREAD_MULTIPLE)
     {
@@ -53,17 +242,29 @@ int main(int argc, char *argv[])
     }
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
-
-    if(strcmp(VERSION_RUN, "hybrid_small") == 0 && comm_size != 2)
-    {
-        printf("The small version is meant to be run with 2 MPI processes, not %d.\n", comm_size);
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-    }
-    else if(strcmp(VERSION_RUN, "hybrid_big") == 0 && comm_size != 8)
-    {
-        printf("The big version is meant to be run with 8 MPI processes, not %d.\n", comm_size);
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-    }
+    #ifdef PLACEMENT
+        // Each MPI process is bound to its share of the node before the grids are first touched, see placement.h
+        #ifdef TASK_GRAPH
+            initialise_placement(1);
+        #else
+            // The threads of the nested teams would inherit the single CPU of their parent thread, they are left free
+            initialise_placement(0);
+        #endif
+    #endif
+
+    // With RUNTIME_GRID, initialise_dimensions() shares the rows between any number of MPI processes
+    #ifndef DIMENSIONS_AT_RUNTIME
+        if(strcmp(VERSION_RUN, "hybrid_small") == 0 && comm_size != 2)
+        {
+            printf("The small version is meant to be run with 2 MPI processes, not %d.\n", comm_size);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        else if(strcmp(VERSION_RUN, "hybrid_big") == 0 && comm_size != 8)
+        {
+            printf("The big version is meant to be run with 8 MPI processes, not %d.\n", comm_size);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    #endif
 
     if(my_rank == 0)
     {
@@ -71,17 +272,83 @@ int main(int argc, char *argv[])
     }
 
     // Initialise temperatures and temperature_last including boundary conditions
-    initialise_temperatures(temperature, temperature_last);
-
-    // nonblocking requests
-    MPI_Request top_recv = MPI_REQUEST_NULL;
-    MPI_Request top_send = MPI_REQUEST_NULL;
-    MPI_Request bottom_recv = MPI_REQUEST_NULL;
-    MPI_Request bottom_send = MPI_REQUEST_NULL;
+    #ifdef CARTESIAN_2D
+        // My position in the process grid
+        struct decomposition_t decomposition;
+        create_decomposition(&decomposition);
+        initialise_temperatures_decomposed(&decomposition, temperature, temperature_last);
+    #elif defined(DIMENSIONS_AT_RUNTIME)
+        initialise_temperatures_shared(temperature, temperature_last);
+    #else
+        INITIALISE_TEMPERATURES(temperature, temperature_last);
+        #ifdef DEEP_HALO
+            initialise_halos(temperature, temperature_last);
+        #endif
+    #endif
+    #ifdef CHECKPOINT
+        // Resume from the last checkpoint if asked to, then keep writing them
+        restart_from_checkpoint(temperature, temperature_last, &iteration, &dt_global);
+        create_checkpoints(&checkpoint);
+    #endif
+
+    #ifdef PERSISTENT_HALO
+        // Persistent requests of the halo swap, one set per grid
+        MPI_Request halo_swaps[HALO_SWAP_SETS][HALO_SWAP_REQUESTS];
+        #ifdef CARTESIAN_2D
+            create_halo_swaps_decomposed(&decomposition, halo_swaps, temperature, temperature_last);
+        #else
+            create_halo_swaps(halo_swaps, temperature, temperature_last);
+        #endif
+        // The set of requests last started. Inactive sets complete straight away.
+        MPI_Request* halo_requests = halo_swaps[0];
+    #elif defined(CARTESIAN_2D)
+        // nonblocking requests of the halo swap
+        MPI_Request halo_requests[HALO_SWAP_REQUESTS];
+        for(int r = 0; r < HALO_SWAP_REQUESTS; r++)
+        {
+            halo_requests[r] = MPI_REQUEST_NULL;
+        }
+    #else
+        // nonblocking requests
+        MPI_Request top_recv = MPI_REQUEST_NULL;
+        MPI_Request top_send = MPI_REQUEST_NULL;
+        MPI_Request bottom_recv = MPI_REQUEST_NULL;
+        MPI_Request bottom_send = MPI_REQUEST_NULL;
+    #endif
 
     MPI_Request reduce = MPI_REQUEST_NULL;
 
-    omp_set_nested();
+    #ifdef TASK_GRAPH
+        // Number of rows of a block, the unit of work of a task
+        int block_rows = get_setting("LAPLACE_TASK_ROWS", TASK_BLOCK_ROWS);
+        // Number of blocks
+        int block_count = (ROWS + block_rows - 1) / block_rows;
+        // Temperature change of each block
+        double* dt_blocks = malloc(sizeof(double) * block_count);
+    #endif
+
+    omp_set_nested(1);
+
+    #if defined(ACTIVE_FRONTIER) && !defined(TASK_GRAPH)
+        #ifdef CARTESIAN_2D
+            row_offset = decomposition.coordinates[0] * LOCAL_ROWS;
+            column_offset = decomposition.coordinates[1] * LOCAL_COLUMNS;
+        #else
+            row_offset = GRID_ROW_OFFSET(my_rank);
+            column_offset = 0;
+        #endif
+    #endif
+
+    #ifdef ROW_KERNELS
+        initialise_stencil_kernels();
+    #endif
+
+    #ifdef PHASE_TIMERS
+        initialise_phase_timers();
+    #endif
+    #ifdef TELEMETRY
+        initialise_telemetry();
+    #endif
 
     ///////////////////////////////////
     // -- Code from here is timed -- //
@@ -91,130 +358,473 @@ int main(int argc, char *argv[])
         start_timer(&timer_simulation);
     }
 
+    #ifdef TASK_GRAPH
+    // A single team lives through all iterations: one thread creates the tasks of an iteration, and all threads run them.
+    // A block is computed as soon as the blocks it reads are ready, the halo swap runs behind the interior blocks.
+    #if defined(PERSISTENT_HALO) && !defined(FUSED_SWAP)
+        // Only named by the depend clauses of the halo swap tasks, which gcc does not count as a use
+        (void)temperature_next;
+    #endif
+    #pragma omp parallel
+    #pragma omp single
     while(dt_global > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
     {
         iteration++;
 
-        #pragma omp parallel num_threads(2)
+        #ifdef FUSED_SWAP
+            // The grid computed during last iteration becomes the one we read from
+            temperature_swap = temperature_last;
+            temperature_last = temperature;
+            temperature = temperature_swap;
+            temperature_next = temperature;
+        #endif
+        #ifdef PERSISTENT_HALO
+            halo_requests = halo_swaps[HALO_SWAP_SET(iteration)];
+        #endif
+
+        // The outer blocks first, then the halo swap, then the interior blocks. The first row of a block stands for it in dependencies.
+        for(int k = 0; k < block_count; k++)
         {
+            int block = (k == 0) ? 0 : ((k == 1) ? block_count - 1 : k - 1);
+            int first = 1 + block * block_rows;
+            int last = (first + block_rows - 1 < ROWS) ? first + block_rows - 1 : ROWS;
+            // The blocks above and below, or the halos on the edges
+            int above = (block == 0) ? 0 : first - block_rows;
+            int below = (block == block_count - 1) ? ROWS + 1 : last + 1;
+
+            #pragma omp task depend(in: temperature_last[above][0], temperature_last[first][0], temperature_last[below][0]) depend(out: temperature[first][0])
+            {
+                PHASE_BEGIN(PHASE_STENCIL);
+                #ifdef FUSED_SWAP
+                    dt_blocks[block] = stencil_block(temperature, temperature_last, first, last, iteration, GRID_ROW_OFFSET(my_rank));
+                #else
+                    stencil_block(temperature, temperature_last, first, last, iteration, GRID_ROW_OFFSET(my_rank));
+                #endif
+                PHASE_END(PHASE_STENCIL);
+            }
 
-            if(omp_get_thread_num() == 0)
+            if(k == ((block_count > 1) ? 1 : 0))
             {
-                // make sure ghost cells are done updating and then compute the upper line
-                MPI_Wait(&top_send,MPI_STATUS_IGNORE);
-                MPI_Wait(&top_recv,MPI_STATUS_IGNORE);
-                int i = 1;
-                for(unsigned int j = 1; j <= COLUMNS; j++)
+                // First row of the last block
+                int last_block = 1 + (block_count - 1) * block_rows;
+
+                // The top halo swap, once my first rows are computed and the top halo read
+                #pragma omp task depend(in: temperature[1][0]) depend(inout: temperature_next[0][0])
                 {
-                    temperature[i][j] = 0.25 * (temperature_last[i + 1][j] +
-                                                temperature_last[i - 1][j] +
-                                                temperature_last[i][j + 1] +
-                                                temperature_last[i][j - 1]);
+                    #ifdef PERSISTENT_HALO
+                        MPI_Startall(2, &halo_requests[0]);
+                        complete_in_task(2, &halo_requests[0]);
+                    #else
+                        MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+                        // If we are not the first MPI process, we have a top neighbour
+                        if(my_rank != 0)
+                        {
+                            MPI_Irecv(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN],1,column,my_rank - 1,0,MPI_COMM_WORLD,&requests[0]);
+                            MPI_Isend(&temperature[1][HALO_FIRST_COLUMN],1,column,my_rank - 1,1,MPI_COMM_WORLD,&requests[1]);
+                        }
+                        complete_in_task(2, requests);
+                    #endif
                 }
 
-                // make sure ghost cells are done updating and then compute the last line
-                MPI_Wait(&bottom_send,MPI_STATUS_IGNORE);
-                MPI_Wait(&bottom_recv,MPI_STATUS_IGNORE);
-                i = ROWS;
-                for(unsigned int j = 1; j <= COLUMNS; j++)
+                // The bottom halo swap, once my last rows are computed and the bottom halo read
+                #pragma omp task depend(in: temperature[last_block][0]) depend(inout: temperature_next[ROWS+1][0])
                 {
-                    temperature[i][j] = 0.25 * (temperature_last[i + 1][j] +
-                                                temperature_last[i - 1][j] +
-                                                temperature_last[i][j + 1] +
-                                                temperature_last[i][j - 1]);
+                    #ifdef PERSISTENT_HALO
+                        MPI_Startall(2, &halo_requests[2]);
+                        complete_in_task(2, &halo_requests[2]);
+                    #else
+                        MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+                        // If we are not the last MPI process, we have a bottom neighbour
+                        if(my_rank != comm_size - 1)
+                        {
+                            MPI_Irecv(&temperature_next[ROWS + 1][HALO_FIRST_COLUMN],1,column,my_rank + 1,1,MPI_COMM_WORLD,&requests[0]);
+                            MPI_Isend(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN],1,column,my_rank + 1,0,MPI_COMM_WORLD,&requests[1]);
+                        }
+                        complete_in_task(2, requests);
+                    #endif
                 }
+            }
+        }
 
-                // now start all non blocking comm
+        #ifndef FUSED_SWAP
+            // A block is copied back once it is computed, and once the blocks around it no longer read it
+            for(int block = 0; block < block_count; block++)
+            {
+                int first = 1 + block * block_rows;
+                int last = (first + block_rows - 1 < ROWS) ? first + block_rows - 1 : ROWS;
 
-                // If we are not the first MPI process, we have a top neighbour
-                if(my_rank != 0)
+                #pragma omp task depend(in: temperature[first][0]) depend(inout: temperature_last[first][0])
                 {
-                    // We receive the bottom row from that neighbour into our top halo
-                    MPI_Irecv(&temperature_last[0][1],1,column,my_rank - 1,0,MPI_COMM_WORLD,&top_recv);
+                    PHASE_BEGIN(PHASE_DELTA_COPY);
+                    dt_blocks[block] = delta_copy_block(temperature_last, temperature, first, last, iteration, GRID_ROW_OFFSET(my_rank));
+                    PHASE_END(PHASE_DELTA_COPY);
                 }
+            }
+        #endif
 
-                // If we are not the first MPI process, we have a top neighbour
-                if(my_rank != 0)
-                {
-                    // Send out top row to our top neighbour
-                    MPI_Isend(&temperature[1][1],1,column,my_rank - 1,1,MPI_COMM_WORLD,&top_send);
-                }
+        #pragma omp taskwait
+        dt = 0.0;
+        for(int block = 0; block < block_count; block++)
+        {
+            dt = fmax(dt_blocks[block], dt);
+        }
 
-                // If we are not the last MPI process, we have a bottom neighbour
-                if(my_rank != comm_size - 1)
-                {
-                    // We send our bottom row to our bottom neighbour
-                    MPI_Isend(&temperature[ROWS][1],1,column,my_rank + 1,0,MPI_COMM_WORLD,&bottom_send);
-                }
+        // We know our temperature delta, we now need to sum it with that of other MPI processes
+        PHASE_BEGIN(PHASE_REDUCTION);
+        MPI_Iallreduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD, &reduce);
+        PHASE_END(PHASE_REDUCTION);
 
-                // If we are not the last MPI process, we have a bottom neighbour
-                if(my_rank != comm_size - 1)
-                {
-                    // We receive the top row from that neighbour into our bottom halo
-                    MPI_Irecv(&temperature_last[ROWS + 1][1],1,column,my_rank + 1,1,MPI_COMM_WORLD,&bottom_recv);
-                }
+        // Periodically print test values
+        if((iteration % PRINT_FREQUENCY) == 0)
+        {
+            PHASE_BEGIN(PHASE_PRINT);
+            if(my_rank == comm_size - 1)
+            {
+                TRACK_PROGRESS(iteration, temperature);
+            }
+            PHASE_END(PHASE_PRINT);
+        }
+        PHASE_BEGIN(PHASE_REDUCTION);
+        MPI_Wait(&reduce, MPI_STATUS_IGNORE);
+        PHASE_END(PHASE_REDUCTION);
 
-            } else
+        TELEMETRY_RECORD(iteration, dt, dt_global);
+
+        #ifdef CHECKPOINT
+            // Written behind the next iterations
+            if(CHECKPOINT_DUE(&checkpoint, iteration))
             {
-                // Main calculation: average my four neighbours
-                #pragma omp parallel for num_threads(omp_get_max_threads()-1)
-                for(unsigned int i = 2; i <= ROWS - 1; i++)
-                {
-                    #pragma omp simd
-                    for(unsigned int j = 1; j <= COLUMNS; j++)
+                save_checkpoint(&checkpoint, temperature, iteration, dt_global);
+            }
+            else
+            {
+                // The checkpoint in progress advances, its header is written once every MPI process wrote its rows
+                progress_checkpoint(&checkpoint);
+            }
+        #endif
+    }
+    #else
+    while(dt_global > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
+    {
+        iteration++;
+
+        #ifdef DEEP_HALO
+            // The halo rows still valid are computed too, unless we are on the plate boundary
+            first_row = (my_rank == 0) ? 1 : 1 - HALO_EXTENSION(iteration);
+            last_row = (my_rank == comm_size - 1) ? ROWS : ROWS + HALO_EXTENSION(iteration);
+        #endif
+
+        #ifdef FUSED_SWAP
+            // The grid computed during last iteration becomes the one we read from
+            temperature_swap = temperature_last;
+            temperature_last = temperature;
+            temperature = temperature_swap;
+            #ifndef PERSISTENT_HALO
+                temperature_next = temperature;
+            #endif
+            dt_boundaries = 0.0;
+            dt_interior = 0.0;
+        #endif
+
+        #pragma omp parallel num_threads(2)
+        {
+
+            if(omp_get_thread_num() == 0)
+            {
+                #ifdef CARTESIAN_2D
+                    // make sure ghost cells are done updating and then compute the outer rows and columns
+                    PHASE_BEGIN(PHASE_HALO_WAIT);
+                    MPI_Waitall(HALO_SWAP_REQUESTS, halo_requests, MPI_STATUSES_IGNORE);
+                    PHASE_END(PHASE_HALO_WAIT);
+                    PHASE_BEGIN(PHASE_STENCIL);
+                    for(unsigned int i = 1; i <= LOCAL_ROWS; i += LOCAL_ROWS - 1)
                     {
-                        temperature[i][j] = 0.25 * (temperature_last[i + 1][j] +
-                                                    temperature_last[i - 1][j] +
-                                                    temperature_last[i][j + 1] +
-                                                    temperature_last[i][j - 1]);
+                        const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                        #ifdef ROW_KERNELS
+                            #ifdef FUSED_SWAP
+                                dt_boundaries = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column, dt_boundaries);
+                            #else
+                                stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column);
+                            #endif
+                        #else
+                            for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                            {
+                                temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+                                                            temperature_last[i - 1][j] +
+                                                            temperature_last[i][j + 1] +
+                                                            temperature_last[i][j - 1]);
+                                #ifdef FUSED_SWAP
+                                    dt_boundaries = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_boundaries);
+                                #endif
+                            }
+                        #endif
                     }
-                }
+                    for(unsigned int i = 2; i <= LOCAL_ROWS - 1; i++)
+                    {
+                        for(unsigned int j = 1; j <= LOCAL_COLUMNS; j += LOCAL_COLUMNS - 1)
+                        {
+                            temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+                                                        temperature_last[i - 1][j] +
+                                                        temperature_last[i][j + 1] +
+                                                        temperature_last[i][j - 1]);
+                            #ifdef FUSED_SWAP
+                                dt_boundaries = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_boundaries);
+                            #endif
+                        }
+                    }
+                    PHASE_END(PHASE_STENCIL);
+
+                    // now start all non blocking comm
+                    PHASE_BEGIN(PHASE_HALO_POST);
+                    #ifdef PERSISTENT_HALO
+                        halo_requests = halo_swaps[HALO_SWAP_SET(iteration)];
+                        MPI_Startall(HALO_SWAP_REQUESTS, halo_requests);
+                    #else
+                        start_halo_swap(&decomposition, temperature, temperature_next, halo_requests);
+                    #endif
+                    PHASE_END(PHASE_HALO_POST);
+                #else
+                    // make sure ghost cells are done updating and then compute the upper lines, one per halo row
+                    PHASE_BEGIN(PHASE_HALO_WAIT);
+                    #ifdef PERSISTENT_HALO
+                        MPI_Waitall(2, &halo_requests[0], MPI_STATUSES_IGNORE);
+                    #else
+                        MPI_Wait(&top_send,MPI_STATUS_IGNORE);
+                        MPI_Wait(&top_recv,MPI_STATUS_IGNORE);
+                    #endif
+                    PHASE_END(PHASE_HALO_WAIT);
+                    PHASE_BEGIN(PHASE_STENCIL);
+                    for(int i = first_row; i <= HALO_WIDTH; i++)
+                    {
+                        const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                        #ifdef ROW_KERNELS
+                            #ifdef FUSED_SWAP
+                                dt_boundaries = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column, dt_boundaries);
+                            #else
+                                stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column);
+                            #endif
+                        #else
+                            for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                            {
+                                temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+                                                            temperature_last[i - 1][j] +
+                                                            temperature_last[i][j + 1] +
+                                                            temperature_last[i][j - 1]);
+                                #ifdef FUSED_SWAP
+                                    dt_boundaries = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_boundaries);
+                                #endif
+                            }
+                        #endif
+                    }
+                    PHASE_END(PHASE_STENCIL);
+
+                    // make sure ghost cells are done updating and then compute the last lines, one per halo row
+                    PHASE_BEGIN(PHASE_HALO_WAIT);
+                    #ifdef PERSISTENT_HALO
+                        MPI_Waitall(2, &halo_requests[2], MPI_STATUSES_IGNORE);
+                    #else
+                        MPI_Wait(&bottom_send,MPI_STATUS_IGNORE);
+                        MPI_Wait(&bottom_recv,MPI_STATUS_IGNORE);
+                    #endif
+                    PHASE_END(PHASE_HALO_WAIT);
+                    PHASE_BEGIN(PHASE_STENCIL);
+                    for(int i = ROWS - HALO_WIDTH + 1; i <= last_row; i++)
+                    {
+                        const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                        #ifdef ROW_KERNELS
+                            #ifdef FUSED_SWAP
+                                dt_boundaries = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column, dt_boundaries);
+                            #else
+                                stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column);
+                            #endif
+                        #else
+                            for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                            {
+                                temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+                                                            temperature_last[i - 1][j] +
+                                                            temperature_last[i][j + 1] +
+                                                            temperature_last[i][j - 1]);
+                                #ifdef FUSED_SWAP
+                                    dt_boundaries = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_boundaries);
+                                #endif
+                            }
+                        #endif
+                    }
+                    PHASE_END(PHASE_STENCIL);
 
+                    // now start all non blocking comm, every HALO_WIDTH iterations only (always by default)
+                    PHASE_BEGIN(PHASE_HALO_POST);
+                    #ifdef PERSISTENT_HALO
+                    if(HALO_SWAP_DUE(iteration))
+                    {
+                        halo_requests = halo_swaps[HALO_SWAP_SET(iteration)];
+                        MPI_Startall(HALO_SWAP_REQUESTS, halo_requests);
+                    }
+                    #else
+                    if(HALO_SWAP_DUE(iteration))
+                    {
+                        // If we are not the first MPI process, we have a top neighbour
+                        if(my_rank != 0)
+                        {
+                            // We receive the bottom rows from that neighbour into our top halo
+                            MPI_Irecv(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN],1,column,my_rank - 1,0,MPI_COMM_WORLD,&top_recv);
+                        }
+
+                        // If we are not the first MPI process, we have a top neighbour
+                        if(my_rank != 0)
+                        {
+                            // Send out top rows to our top neighbour
+                            MPI_Isend(&temperature[1][HALO_FIRST_COLUMN],1,column,my_rank - 1,1,MPI_COMM_WORLD,&top_send);
+                        }
+
+                        // If we are not the last MPI process, we have a bottom neighbour
+                        if(my_rank != comm_size - 1)
+                        {
+                            // We send our bottom rows to our bottom neighbour
+                            MPI_Isend(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN],1,column,my_rank + 1,0,MPI_COMM_WORLD,&bottom_send);
+                        }
+
+                        // If we are not the last MPI process, we have a bottom neighbour
+                        if(my_rank != comm_size - 1)
+                        {
+                            // We receive the top rows from that neighbour into our bottom halo
+                            MPI_Irecv(&temperature_next[ROWS + 1][HALO_FIRST_COLUMN],1,column,my_rank + 1,1,MPI_COMM_WORLD,&bottom_recv);
+                        }
+                    }
+                    #endif
+                    PHASE_END(PHASE_HALO_POST);
+                #endif
+            } else
+            {
+                PHASE_BEGIN(PHASE_STENCIL);
+                #ifdef FUSED_SWAP
+                    // Main calculation: average my four neighbours and find latest dt in the same sweep
+                    #pragma omp parallel for num_threads(omp_get_max_threads()-1) reduction(max:dt_interior)
+                    for(unsigned int i = HALO_WIDTH + 1; i <= LOCAL_ROWS - HALO_WIDTH; i++)
+                    {
+                        const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, FIRST_INTERIOR_COLUMN, LAST_INTERIOR_COLUMN);
+                        #ifdef ROW_KERNELS
+                            dt_interior = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LAST_INTERIOR_COLUMN + 1 - first_column, dt_interior);
+                        #else
+                            #pragma omp simd reduction(max:dt_interior)
+                            for(unsigned int j = first_column; j <= LAST_INTERIOR_COLUMN; j++)
+                            {
+                                temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+                                                            temperature_last[i - 1][j] +
+                                                            temperature_last[i][j + 1] +
+                                                            temperature_last[i][j - 1]);
+                                dt_interior = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_interior);
+                            }
+                        #endif
+                    }
+                #else
+                    // Main calculation: average my four neighbours
+                    #pragma omp parallel for num_threads(omp_get_max_threads()-1)
+                    for(unsigned int i = HALO_WIDTH + 1; i <= LOCAL_ROWS - HALO_WIDTH; i++)
+                    {
+                        const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, FIRST_INTERIOR_COLUMN, LAST_INTERIOR_COLUMN);
+                        #ifdef ROW_KERNELS
+                            stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LAST_INTERIOR_COLUMN + 1 - first_column);
+                        #else
+                            #pragma omp simd
+                            for(unsigned int j = first_column; j <= LAST_INTERIOR_COLUMN; j++)
+                            {
+                                temperature[i][j] = 0.25 * ((double)temperature_last[i + 1][j] +
+                                                            temperature_last[i - 1][j] +
+                                                            temperature_last[i][j + 1] +
+                                                            temperature_last[i][j - 1]);
+                            }
+                        #endif
+                    }
+                #endif
+                PHASE_END(PHASE_STENCIL);
             }
 
-            //////////////////////////////////////
-            // FIND MAXIMAL TEMPERATURE CHANGE //
-            ////////////////////////////////////
-            #pragma omp single nowait
-            dt = 0.0;
+            #ifndef FUSED_SWAP
+                //////////////////////////////////////
+                // FIND MAXIMAL TEMPERATURE CHANGE //
+                ////////////////////////////////////
+                #pragma omp single nowait
+                dt = 0.0;
 
-            #pragma omp barrier // make sure all temperatures are updated
+                #pragma omp barrier // make sure all temperatures are updated
 
-            #pragma omp for reduction(max:dt)
-            for(unsigned int i = 1; i <= ROWS; i++)
-            {
-                #pragma omp simd reduction(max:dt)
-                for(unsigned int j = 1; j <= COLUMNS; j++)
+                PHASE_BEGIN(PHASE_DELTA_COPY);
+                #pragma omp for reduction(max:dt)
+                for(int i = first_row; i <= last_row; i++)
                 {
-                    dt = fmax(fabs(temperature[i][j]-temperature_last[i][j]), dt);
-                    temperature_last[i][j] = temperature[i][j];
+                    const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                    #ifdef ROW_KERNELS
+                        dt = delta_copy_row(&temperature_last[i][first_column], &temperature[i][first_column], LOCAL_COLUMNS + 1 - first_column, dt);
+                    #else
+                        #pragma omp simd reduction(max:dt)
+                        for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                        {
+                            dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+                            temperature_last[i][j] = temperature[i][j];
+                        }
+                    #endif
                 }
-            }
-
+                PHASE_END(PHASE_DELTA_COPY);
+            #endif
         }
 
+        #ifdef FUSED_SWAP
+            dt = fmax(dt_boundaries, dt_interior);
+        #endif
+
         // We know our temperature delta, we now need to sum it with that of other MPI processes
         //MPI_Reduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
         //MPI_Bcast(&dt_global, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        PHASE_BEGIN(PHASE_REDUCTION);
         MPI_Iallreduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD, &reduce);
+        PHASE_END(PHASE_REDUCTION);
 
         // Periodically print test values
         if((iteration % PRINT_FREQUENCY) == 0)
         {
-            if(my_rank == comm_size - 1)
-            {
-                track_progress(iteration, temperature);
-    	    }
+            PHASE_BEGIN(PHASE_PRINT);
+            #ifdef CARTESIAN_2D
+                track_progress_decomposed(&decomposition, iteration, temperature);
+            #else
+                if(my_rank == comm_size - 1)
+                {
+                    TRACK_PROGRESS(iteration, temperature);
+                }
+            #endif
+            PHASE_END(PHASE_PRINT);
         }
+        PHASE_BEGIN(PHASE_REDUCTION);
         MPI_Wait(&reduce, MPI_STATUS_IGNORE);
+        PHASE_END(PHASE_REDUCTION);
+
+        TELEMETRY_RECORD(iteration, dt, dt_global);
+
+        #ifdef CHECKPOINT
+            // Written behind the next iterations
+            if(CHECKPOINT_DUE(&checkpoint, iteration))
+            {
+                save_checkpoint(&checkpoint, temperature, iteration, dt_global);
+            }
+            else
+            {
+                // The checkpoint in progress advances, its header is written once every MPI process wrote its rows
+                progress_checkpoint(&checkpoint);
+            }
+        #endif
     }
+    #endif
 
     // Slightly more accurate timing and cleaner output
 
-    MPI_Wait(&top_send,MPI_STATUS_IGNORE);
-    MPI_Wait(&top_recv,MPI_STATUS_IGNORE);
-    MPI_Wait(&bottom_send,MPI_STATUS_IGNORE);
-    MPI_Wait(&bottom_recv,MPI_STATUS_IGNORE);
+    #if defined(CARTESIAN_2D) || defined(PERSISTENT_HALO)
+        MPI_Waitall(HALO_SWAP_REQUESTS, halo_requests, MPI_STATUSES_IGNORE);
+    #else
+        MPI_Wait(&top_send,MPI_STATUS_IGNORE);
+        MPI_Wait(&top_recv,MPI_STATUS_IGNORE);
+        MPI_Wait(&bottom_send,MPI_STATUS_IGNORE);
+        MPI_Wait(&bottom_recv,MPI_STATUS_IGNORE);
+    #endif
 
     MPI_Barrier(MPI_COMM_WORLD);
 
@@ -226,12 +836,47 @@ int main(int argc, char *argv[])
         stop_timer(&timer_simulation);
         print_summary(iteration, dt_global, timer_simulation);
     }
+    #ifdef CHECKSUM
+        // Every MPI process sums its own cells
+        #ifdef CARTESIAN_2D
+            print_checksum(&temperature[0][0], LOCAL_COLUMNS + 2, LOCAL_ROWS, LOCAL_COLUMNS, decomposition.coordinates[0] * LOCAL_ROWS, decomposition.coordinates[1] * LOCAL_COLUMNS);
+        #else
+            print_checksum(&temperature[0][0], COLUMNS + 2, ROWS, COLUMNS, GRID_ROW_OFFSET(my_rank), 0);
+        #endif
+    #endif
+    #ifdef PHASE_TIMERS
+        print_phase_timers();
+    #endif
+    #ifdef TELEMETRY
+        close_telemetry();
+    #endif
+	#ifdef CHECKPOINT
+		// The field reached is written in any case
+		close_checkpoints(&checkpoint, temperature, iteration, dt_global);
+	#endif
+
+	#ifdef PERSISTENT_HALO
+		free_halo_swaps(halo_swaps);
+	#endif
+	#ifdef TASK_GRAPH
+		free(dt_blocks);
+	#endif
 
 	// Print the halo swap verification cell value
 	MPI_Barrier(MPI_COMM_WORLD);
-	if(my_rank == comm_size - 2)
-	{
-		printf("Value of halo swap verification cell [%d][%d] is %.18f\n", ROWS_GLOBAL - ROWS - 1, COLUMNS - 1, temperature[ROWS][COLUMNS]);
-	}
+	#ifdef CARTESIAN_2D
+		print_verification_cell_decomposed(&decomposition, temperature);
+		free_decomposition(&decomposition);
+	#else
+		if(my_rank == comm_size - 2)
+		{
+			printf("Value of halo swap verification cell [%d][%d] is %.18f\n", GRID_ROW_OFFSET(my_rank) + ROWS - 1, COLUMNS - 1, temperature[ROWS][COLUMNS]);
+		}
+	#endif
+	#ifdef HEAP_GRIDS
+		free_grid(temperature - HALO_OFFSET);
+		free_grid(temperature_last - HALO_OFFSET);
+	#endif
+
     MPI_Finalize();
 }
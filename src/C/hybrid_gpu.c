@@ -12,6 +12,27 @@
 #include <mpi.h> // MPI_*
 #include <string.h> // strcmp
 #include "util.h"  
+#include "grid.h"
+#include "precision.h"
+#include "schedule.h"
+#include "halo.h"
+#include "checkpoint.h"
+#include "placement.h"
+#include "checksum.h"
+
+#if defined(DEEP_HALO) || defined(GPU_DIRECT) || defined(ASYNC_QUEUES)
+	#ifndef DEVICE_RESIDENT
+		/// The grids stay on the device for the whole run. DEEP_HALO, GPU_DIRECT and ASYNC_QUEUES rely on it.
+		#define DEVICE_RESIDENT
+	#endif
+#endif
+
+#ifdef ASYNC_QUEUES
+	/// OpenACC queue of the outer rows, of the rows sent and of the halos received.
+	#define QUEUE_BOUNDARY 1
+	/// OpenACC queue of the interior rows.
+	#define QUEUE_INTERIOR 2
+#endif
 
 /**
  * @brief Runs the experiment.
@@ -20,10 +41,46 @@
  **/
 int main(int argc, char *argv[])
 {
-	// Temperature grid.
-	double temperature[ROWS+2][COLUMNS+2];
-	// Temperature grid from last iteration
-	double temperature_last[ROWS+2][COLUMNS+2]; 
+	#ifdef HEAP_GRIDS
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = (temperature_t (*)[COLUMNS+2])allocate_grid(ROWS + 2 * HALO_OFFSET, COLUMNS) + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = (temperature_t (*)[COLUMNS+2])allocate_grid(ROWS + 2 * HALO_OFFSET, COLUMNS) + HALO_OFFSET;
+	#elif defined(FUSED_SWAP) || defined(DEEP_HALO)
+		// The two temperature grids, including all their halo rows. Their roles alternate at every iteration with FUSED_SWAP.
+		temperature_t temperature_grids[2][ROWS+2*HALO_WIDTH][COLUMNS+2];
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = temperature_grids[0] + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = temperature_grids[1] + HALO_OFFSET;
+	#else
+		// Temperature grid.
+		temperature_t temperature[ROWS+2][COLUMNS+2];
+		// Temperature grid from last iteration
+		temperature_t temperature_last[ROWS+2][COLUMNS+2]; 
+	#endif
+	#ifdef FUSED_SWAP
+		// Used to swap the two grids above.
+		temperature_t (*temperature_swap)[COLUMNS+2];
+	#endif
+	#if !defined(PERSISTENT_HALO) || (defined(DEVICE_RESIDENT) && !defined(GPU_DIRECT))
+		#ifdef FUSED_SWAP
+			// Grid read during the next iteration, in which halos must be received.
+			temperature_t (*temperature_next)[COLUMNS+2];
+		#else
+			// Grid read during the next iteration, in which halos must be received.
+			temperature_t (*temperature_next)[COLUMNS+2] = temperature_last;
+		#endif
+	#endif
+	#ifdef DEEP_HALO
+		// First and last rows computed during an iteration, halo rows included
+		int first_row;
+		int last_row;
+	#else
+		// First and last rows computed during an iteration
+		const int first_row = 1;
+		const int last_row = ROWS;
+	#endif
 	// Current iteration.
     int iteration = 0;
     // Temperature change for our MPI process
@@ -34,8 +91,36 @@ int main(int argc, char *argv[])
     int comm_size;
     // The rank of my MPI process
     int my_rank;
-    // Status returned by MPI calls
-    MPI_Status status;
+    #ifdef PERSISTENT_HALO
+        // Persistent requests of the halo swap, one set per grid
+        MPI_Request halo_swaps[HALO_SWAP_SETS][HALO_SWAP_REQUESTS];
+    #elif defined(ASYNC_QUEUES)
+        // Requests of the halo swap
+        MPI_Request halo_requests[4];
+        // The rank of my top neighbour, MPI_PROC_NULL if I am the first MPI process
+        int top;
+        // The rank of my bottom neighbour, MPI_PROC_NULL if I am the last MPI process
+        int bottom;
+    #else
+        // Status returned by MPI calls
+        MPI_Status status;
+    #endif
+    #ifdef ASYNC_QUEUES
+        // Number of outer rows computed at the top of my strip during an iteration
+        int outer_rows_top;
+        // Number of outer rows computed during an iteration, top and bottom
+        int outer_rows;
+        #ifdef FUSED_SWAP
+            // Temperature change of the outer rows, computed on QUEUE_BOUNDARY
+            double dt_boundaries;
+            // Temperature change of the interior rows, computed on QUEUE_INTERIOR
+            double dt_interior;
+        #endif
+    #endif
+    #ifdef CHECKPOINT
+        // The checkpoint file, written every few iterations
+        struct checkpoint_t checkpoint;
+    #endif
 
     // The usual MPI startup routines
     MPI_Init(&argc, &argv);
@@ -46,6 +131,10 @@ int main(int argc, char *argv[])
 	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &local_comm);
 	int my_local_rank;
 	MPI_Comm_rank(local_comm, &my_local_rank);
+	#ifdef PLACEMENT
+		// Each MPI process is bound to its share of the node and given the device closest to it, before the first OpenACC call, see placement.h
+		initialise_placement(1);
+	#endif
 
     if(strcmp(VERSION_RUN, "mpi_small") == 0 && comm_size != 2)
     {
@@ -64,7 +153,26 @@ int main(int argc, char *argv[])
     }
 
     // Initialise temperatures and temperature_last including boundary conditions
-    initialise_temperatures(temperature, temperature_last);
+    INITIALISE_TEMPERATURES(temperature, temperature_last);
+    #ifdef DEEP_HALO
+        initialise_halos(temperature, temperature_last);
+    #endif
+    #ifdef CHECKPOINT
+        // Resume from the last checkpoint if asked to, before the grids go to the device, then keep writing them
+        restart_from_checkpoint(temperature, temperature_last, &iteration, &dt_global);
+        create_checkpoints(&checkpoint);
+    #endif
+
+    #ifdef TUNED_SCHEDULES
+	// The schedule is picked on my own device, hence selected before the timer starts, see below
+	int number_of_acc_devices = acc_get_num_devices(1);
+	#ifdef PLACEMENT
+		acc_set_device_num(get_placed_device(number_of_acc_devices), 1);
+	#else
+		acc_set_device_num(my_local_rank % number_of_acc_devices, 1);
+	#endif
+	initialise_schedule(temperature_last);
+    #endif
 
     ///////////////////////////////////
     // -- Code from here is timed -- //
@@ -74,24 +182,115 @@ int main(int argc, char *argv[])
         start_timer(&timer_simulation);
     }
 
+	#ifndef TUNED_SCHEDULES
 	// 2 MPI processes per node, 2 GPUs per node, this makes sure that the 2 MPI processes don't use the same GPU
 	int number_of_acc_devices = acc_get_num_devices(1);
-	acc_set_device_num(my_local_rank % number_of_acc_devices, 1);
+	#ifdef PLACEMENT
+		acc_set_device_num(get_placed_device(number_of_acc_devices), 1);
+	#else
+		acc_set_device_num(my_local_rank % number_of_acc_devices, 1);
+	#endif
+	#endif
 
+	#ifdef DEVICE_RESIDENT
+		// The grids stay on the device, only the halo rows travel and only when they are swapped. The copy clauses of the kernels below find them present and copy nothing.
+		#pragma acc enter data copyin(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2])
+	#endif
+	#ifdef PERSISTENT_HALO
+		#ifdef GPU_DIRECT
+			// The requests are bound to the device copies of the grids
+			#pragma acc host_data use_device(temperature, temperature_last)
+			{
+				create_halo_swaps(halo_swaps, temperature, temperature_last);
+			}
+		#else
+			create_halo_swaps(halo_swaps, temperature, temperature_last);
+		#endif
+		#if defined(DEVICE_RESIDENT) && !defined(GPU_DIRECT) && !defined(FUSED_SWAP)
+			// Only named by the update directives that bring the halos to the device, which gcc does not count as a use
+			(void)temperature_next;
+		#endif
+	#endif
+
+	#ifdef ASYNC_QUEUES
+	#ifndef PERSISTENT_HALO
+		top = (my_rank == 0) ? MPI_PROC_NULL : my_rank - 1;
+		bottom = (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1;
+	#endif
+
+	// The outer rows are computed and shipped on one queue while the interior is computed on another. The host only waits
+	// for the rows it sends, and for the temperature deltas at the end of the iteration.
 	while(dt_global > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
 	{
 		iteration++;
 
-		// Main calculation: average my four neighbours
-		#pragma acc kernels
-		for(unsigned int i = 1; i <= ROWS; i++)
+		#ifdef DEEP_HALO
+			// The halo rows still valid are computed too, unless we are on the plate boundary
+			first_row = (my_rank == 0) ? 1 : 1 - HALO_EXTENSION(iteration);
+			last_row = (my_rank == comm_size - 1) ? ROWS : ROWS + HALO_EXTENSION(iteration);
+		#endif
+
+		#ifdef FUSED_SWAP
+			// The grid computed during last iteration becomes the one we read from
+			temperature_swap = temperature_last;
+			temperature_last = temperature;
+			temperature = temperature_swap;
+			temperature_next = temperature;
+			dt_boundaries = 0.0;
+			dt_interior = 0.0;
+		#else
+			dt = 0.0;
+		#endif
+
+		// The outer rows, from first_row to HALO_WIDTH and from ROWS-HALO_WIDTH+1 to last_row, in a single kernel
+		outer_rows_top = HALO_WIDTH - first_row + 1;
+		outer_rows = outer_rows_top + last_row - (ROWS - HALO_WIDTH);
+		#ifdef FUSED_SWAP
+			#pragma acc kernels present(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2]) copy(dt_boundaries) async(QUEUE_BOUNDARY)
+		#else
+			#pragma acc kernels present(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2]) async(QUEUE_BOUNDARY)
+		#endif
+		for(int k = 0; k < outer_rows; k++)
+		{
+			int i = (k < outer_rows_top) ? first_row + k : ROWS - HALO_WIDTH + 1 + k - outer_rows_top;
+			for(unsigned int j = 1; j <= COLUMNS; j++)
+			{
+				temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+											temperature_last[i-1][j  ] +
+											temperature_last[i  ][j+1] +
+											temperature_last[i  ][j-1]);
+				#ifdef FUSED_SWAP
+					dt_boundaries = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_boundaries);
+				#endif
+			}
+		}
+
+		#ifndef GPU_DIRECT
+			if(HALO_SWAP_DUE(iteration))
+			{
+				// Only the rows sent come back to the host, right behind the kernel that computes them
+				#pragma acc update host(temperature[1:HALO_WIDTH][0:COLUMNS+2]) async(QUEUE_BOUNDARY)
+				#pragma acc update host(temperature[ROWS-HALO_WIDTH+1:HALO_WIDTH][0:COLUMNS+2]) async(QUEUE_BOUNDARY)
+			}
+		#endif
+
+		// Main calculation: average my four neighbours, for the interior rows, which neither the halo swap nor the outer rows touch
+		#ifdef FUSED_SWAP
+			#pragma acc kernels present(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2]) copy(dt_interior) async(QUEUE_INTERIOR)
+		#else
+			#pragma acc kernels present(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2]) async(QUEUE_INTERIOR)
+		#endif
+		for(int i = HALO_WIDTH + 1; i <= ROWS - HALO_WIDTH; i++)
 		{
 			for(unsigned int j = 1; j <= COLUMNS; j++)
 			{
-				temperature[i][j] = 0.25 * (temperature_last[i+1][j  ] +
+				temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
 											temperature_last[i-1][j  ] +
 											temperature_last[i  ][j+1] +
 											temperature_last[i  ][j-1]);
+				#ifdef FUSED_SWAP
+					dt_interior = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_interior);
+				#endif
 			}
 		}
 
@@ -99,49 +298,229 @@ int main(int argc, char *argv[])
 		// HALO SWAP PHASE //
 		////////////////////
 
-		// If we are not the last MPI process, we have a bottom neighbour
-		if(my_rank != comm_size-1)
+		// Every HALO_WIDTH iterations only, always by default, while the interior kernel runs
+		if(HALO_SWAP_DUE(iteration))
 		{
-			// We send our bottom row to our bottom neighbour
-			MPI_Send(&temperature[ROWS][1], COLUMNS, MPI_DOUBLE, my_rank+1, 0, MPI_COMM_WORLD);
-		}
+			#pragma acc wait(QUEUE_BOUNDARY)
 
-		// If we are not the first MPI process, we have a top neighbour
-		if(my_rank != 0)
-		{
-			// We receive the bottom row from that neighbour into our top halo
-			MPI_Recv(&temperature_last[0][1], COLUMNS, MPI_DOUBLE, my_rank-1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+			#if defined(GPU_DIRECT) && !defined(PERSISTENT_HALO)
+			// The MPI library reads and writes the device copies of the grids directly; persistent requests are bound to them already
+			#pragma acc host_data use_device(temperature, temperature_next)
+			{
+			#endif
+			#ifdef PERSISTENT_HALO
+			// The requests already know their buffers and neighbours
+			MPI_Startall(HALO_SWAP_REQUESTS, halo_swaps[HALO_SWAP_SET(iteration)]);
+			MPI_Waitall(HALO_SWAP_REQUESTS, halo_swaps[HALO_SWAP_SET(iteration)], MPI_STATUSES_IGNORE);
+			#else
+			// Neighbours past the plate boundaries are MPI_PROC_NULL
+			MPI_Irecv(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, top, 0, MPI_COMM_WORLD, &halo_requests[0]);
+			MPI_Irecv(&temperature_next[ROWS+1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, bottom, 1, MPI_COMM_WORLD, &halo_requests[1]);
+			MPI_Isend(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, bottom, 0, MPI_COMM_WORLD, &halo_requests[2]);
+			MPI_Isend(&temperature[1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, top, 1, MPI_COMM_WORLD, &halo_requests[3]);
+			MPI_Waitall(4, halo_requests, MPI_STATUSES_IGNORE);
+			#endif
+			#if defined(GPU_DIRECT) && !defined(PERSISTENT_HALO)
+			}
+			#endif
+			#ifndef GPU_DIRECT
+				// Only the halos received go to the device
+				#pragma acc update device(temperature_next[1-HALO_WIDTH:HALO_WIDTH][0:COLUMNS+2]) async(QUEUE_BOUNDARY)
+				#pragma acc update device(temperature_next[ROWS+1:HALO_WIDTH][0:COLUMNS+2]) async(QUEUE_BOUNDARY)
+			#endif
 		}
 
-		// If we are not the first MPI process, we have a top neighbour
-		if(my_rank != 0)
+		#ifndef FUSED_SWAP
+			//////////////////////////////////////
+			// FIND MAXIMAL TEMPERATURE CHANGE //
+			////////////////////////////////////
+			// Once both queues are done with the grids
+			#pragma acc kernels present(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2]) copy(dt) async(QUEUE_INTERIOR) wait(QUEUE_BOUNDARY)
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(unsigned int j = 1; j <= COLUMNS; j++)
+				{
+					dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+					temperature_last[i][j] = temperature[i][j];
+				}
+			}
+		#endif
+
+		// Only the temperature deltas come back to the host
+		#pragma acc wait
+		#ifdef FUSED_SWAP
+			dt = fmax(dt_boundaries, dt_interior);
+		#endif
+
+		// We know our temperature delta, we now need to sum it with that of other MPI processes
+		MPI_Reduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+		MPI_Bcast(&dt_global, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+		// Periodically print test values
+		if((iteration % PRINT_FREQUENCY) == 0)
 		{
-			// Send out top row to our top neighbour
-			MPI_Send(&temperature[1][1], COLUMNS, MPI_DOUBLE, my_rank-1, 0, MPI_COMM_WORLD);
+			if(my_rank == comm_size - 1)
+			{
+				// Only the rows printed come back to the host
+				#pragma acc update host(temperature[ROWS-5:6][0:COLUMNS+2])
+				TRACK_PROGRESS(iteration, temperature);
+			}
 		}
 
-		// If we are not the last MPI process, we have a bottom neighbour
-		if(my_rank != comm_size-1)
-		{   
-			// We receive the top row from that neighbour into our bottom halo
-			MPI_Recv(&temperature_last[ROWS+1][1], COLUMNS, MPI_DOUBLE, my_rank+1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-		}
+		#ifdef CHECKPOINT
+			// Only my rows come back to the host, and are written behind the next iterations
+			if(CHECKPOINT_DUE(&checkpoint, iteration))
+			{
+				#pragma acc update host(temperature[1:ROWS][0:COLUMNS+2])
+				save_checkpoint(&checkpoint, temperature, iteration, dt_global);
+			}
+			else
+			{
+				// The checkpoint in progress advances, its header is written once every MPI process wrote its rows
+				progress_checkpoint(&checkpoint);
+			}
+		#endif
+	}
+	#else
+	while(dt_global > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
+	{
+		iteration++;
+
+		#ifdef DEEP_HALO
+			// The halo rows still valid are computed too, unless we are on the plate boundary
+			first_row = (my_rank == 0) ? 1 : 1 - HALO_EXTENSION(iteration);
+			last_row = (my_rank == comm_size - 1) ? ROWS : ROWS + HALO_EXTENSION(iteration);
+		#endif
 
-		//////////////////////////////////////
-		// FIND MAXIMAL TEMPERATURE CHANGE //
-		////////////////////////////////////
-		dt = 0.0;
+		#ifdef FUSED_SWAP
+			// The grid computed during last iteration becomes the one we read from
+			temperature_swap = temperature_last;
+			temperature_last = temperature;
+			temperature = temperature_swap;
+			#if !defined(PERSISTENT_HALO) || (defined(DEVICE_RESIDENT) && !defined(GPU_DIRECT))
+				temperature_next = temperature;
+			#endif
 
-		#pragma acc kernels
-		for(unsigned int i = 1; i <= ROWS; i++)
+			#ifdef TUNED_SCHEDULES
+			// Main calculation: average my four neighbours and find latest dt in a single kernel, scheduled for the device
+			dt = scheduled_sweep(temperature, temperature_last, first_row, last_row);
+			#else
+			// Main calculation: average my four neighbours and find latest dt in the same sweep
+			dt = 0.0;
+
+			#pragma acc kernels copyin(temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2]) copy(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(unsigned int j = 1; j <= COLUMNS; j++)
+				{
+					temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+												temperature_last[i-1][j  ] +
+												temperature_last[i  ][j+1] +
+												temperature_last[i  ][j-1]);
+					dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+				}
+			}
+			#endif
+		#elif defined(TUNED_SCHEDULES)
+			// Main calculation: average my four neighbours and find latest dt in a single kernel, scheduled for the device. The halo swap below only writes the halos of temperature_last, outside of the rows the change is found in.
+			dt = scheduled_sweep(temperature, temperature_last, first_row, last_row);
+		#else
+			// Main calculation: average my four neighbours
+			#pragma acc kernels copy(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(unsigned int j = 1; j <= COLUMNS; j++)
+				{
+					temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+												temperature_last[i-1][j  ] +
+												temperature_last[i  ][j+1] +
+												temperature_last[i  ][j-1]);
+				}
+			}
+		#endif
+
+		//////////////////////
+		// HALO SWAP PHASE //
+		////////////////////
+
+		// Every HALO_WIDTH iterations only, always by default
+		if(HALO_SWAP_DUE(iteration))
 		{
-			for(unsigned int j = 1; j <= COLUMNS; j++)
+			#if defined(DEVICE_RESIDENT) && !defined(GPU_DIRECT)
+				// Only the rows sent come back to the host
+				#pragma acc update host(temperature[1:HALO_WIDTH][0:COLUMNS+2])
+				#pragma acc update host(temperature[ROWS-HALO_WIDTH+1:HALO_WIDTH][0:COLUMNS+2])
+			#endif
+
+			#if defined(GPU_DIRECT) && !defined(PERSISTENT_HALO)
+			// The MPI library reads and writes the device copies of the grids directly; persistent requests are bound to them already
+			#pragma acc host_data use_device(temperature, temperature_next)
+			{
+			#endif
+			#ifdef PERSISTENT_HALO
+			// The requests already know their buffers and neighbours
+			MPI_Startall(HALO_SWAP_REQUESTS, halo_swaps[HALO_SWAP_SET(iteration)]);
+			MPI_Waitall(HALO_SWAP_REQUESTS, halo_swaps[HALO_SWAP_SET(iteration)], MPI_STATUSES_IGNORE);
+			#else
+			// If we are not the last MPI process, we have a bottom neighbour
+			if(my_rank != comm_size-1)
+			{
+				// We send our bottom rows to our bottom neighbour
+				MPI_Send(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank+1, 0, MPI_COMM_WORLD);
+			}
+
+			// If we are not the first MPI process, we have a top neighbour
+			if(my_rank != 0)
+			{
+				// We receive the bottom rows from that neighbour into our top halo
+				MPI_Recv(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank-1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+			}
+
+			// If we are not the first MPI process, we have a top neighbour
+			if(my_rank != 0)
 			{
-				dt = fmax(fabs(temperature[i][j]-temperature_last[i][j]), dt);
-				temperature_last[i][j] = temperature[i][j];
+				// Send out top rows to our top neighbour
+				MPI_Send(&temperature[1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank-1, 0, MPI_COMM_WORLD);
+			}
+
+			// If we are not the last MPI process, we have a bottom neighbour
+			if(my_rank != comm_size-1)
+			{   
+				// We receive the top rows from that neighbour into our bottom halo
+				MPI_Recv(&temperature_next[ROWS+1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank+1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
 			}
+			#endif
+			#if defined(GPU_DIRECT) && !defined(PERSISTENT_HALO)
+			}
+			#endif
+
+			#if defined(DEVICE_RESIDENT) && !defined(GPU_DIRECT)
+				// Only the halos received go to the device
+				#pragma acc update device(temperature_next[1-HALO_WIDTH:HALO_WIDTH][0:COLUMNS+2])
+				#pragma acc update device(temperature_next[ROWS+1:HALO_WIDTH][0:COLUMNS+2])
+			#endif
 		}
 
+		#if !defined(FUSED_SWAP) && defined(TUNED_SCHEDULES)
+			// The temperature change is already found, only the copy is left
+			scheduled_copy(temperature_last, temperature, first_row, last_row);
+		#elif !defined(FUSED_SWAP)
+			//////////////////////////////////////
+			// FIND MAXIMAL TEMPERATURE CHANGE //
+			////////////////////////////////////
+			dt = 0.0;
+
+			#pragma acc kernels copy(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(unsigned int j = 1; j <= COLUMNS; j++)
+				{
+					dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+					temperature_last[i][j] = temperature[i][j];
+				}
+			}
+		#endif
+
 		// We know our temperature delta, we now need to sum it with that of other MPI processes
 		MPI_Reduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 		MPI_Bcast(&dt_global, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
@@ -151,11 +530,38 @@ int main(int argc, char *argv[])
 		{
 			if(my_rank == comm_size - 1)
 			{
-				track_progress(iteration, temperature);
+				#ifdef DEVICE_RESIDENT
+					// Only the rows printed come back to the host
+					#pragma acc update host(temperature[ROWS-5:6][0:COLUMNS+2])
+				#endif
+				TRACK_PROGRESS(iteration, temperature);
 			}
 		}
+
+		#ifdef CHECKPOINT
+			// Written behind the next iterations
+			if(CHECKPOINT_DUE(&checkpoint, iteration))
+			{
+				#ifdef DEVICE_RESIDENT
+					// Only my rows come back to the host
+					#pragma acc update host(temperature[1:ROWS][0:COLUMNS+2])
+				#endif
+				save_checkpoint(&checkpoint, temperature, iteration, dt_global);
+			}
+			else
+			{
+				// The checkpoint in progress advances, its header is written once every MPI process wrote its rows
+				progress_checkpoint(&checkpoint);
+			}
+		#endif
 	}
 
+	#endif
+
+	#ifdef DEVICE_RESIDENT
+		#pragma acc exit data copyout(temperature[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2], temperature_last[1-HALO_WIDTH:ROWS+2*HALO_WIDTH][0:COLUMNS+2])
+	#endif
+
     // Slightly more accurate timing and cleaner output 
     MPI_Barrier(MPI_COMM_WORLD);
 
@@ -167,6 +573,18 @@ int main(int argc, char *argv[])
         stop_timer(&timer_simulation);
         print_summary(iteration, dt_global, timer_simulation);
     }
+    #ifdef CHECKSUM
+        // Every MPI process sums its own cells, copied out of the device
+        print_checksum(&temperature[0][0], COLUMNS + 2, ROWS, COLUMNS, GRID_ROW_OFFSET(my_rank), 0);
+    #endif
+	#ifdef CHECKPOINT
+		// The field reached is written in any case, from the grids copied out of the device
+		close_checkpoints(&checkpoint, temperature, iteration, dt_global);
+	#endif
+
+	#ifdef PERSISTENT_HALO
+		free_halo_swaps(halo_swaps);
+	#endif
 
 	// Print the halo swap verification cell value 
 	MPI_Barrier(MPI_COMM_WORLD);
@@ -175,5 +593,10 @@ int main(int argc, char *argv[])
 		printf("Value of halo swap verification cell [%d][%d] is %.18f\n", ROWS_GLOBAL - ROWS - 1, COLUMNS - 1, temperature[ROWS][COLUMNS]);
 	}
 
+	#ifdef HEAP_GRIDS
+		free_grid(temperature - HALO_OFFSET);
+		free_grid(temperature_last - HALO_OFFSET);
+	#endif
+
     MPI_Finalize();
 }
@@ -0,0 +1,48 @@
+/**
+ * @file inplace.c
+ **/
+
+#ifdef IN_PLACE
+
+#include "inplace.h"
+#include "stencil.h"
+#include "frontier.h"
+#include <math.h> // fabs, fmax
+#include <string.h> // memcpy
+
+double sweep_in_place(double (*temperature)[COLUMNS+2], int first_row, int last_row, const double* above, const double* below, double window[2][COLUMNS+2], int iteration, int row_offset, double dt)
+{
+	// Only read with ACTIVE_FRONTIER
+	(void)iteration;
+	(void)row_offset;
+
+	// The row above the one computed, as it was before the iteration
+	const double* north = above;
+	for(int i = first_row; i <= last_row; i++)
+	{
+		// The row computed, as it was before the iteration; it overwrites the row above that of the last one
+		double* centre = window[(i - first_row) % 2];
+		memcpy(centre, temperature[i], sizeof(double) * (COLUMNS + 2));
+		// The row below, untouched yet unless it belongs to the next block
+		const double* south = (i == last_row) ? below : temperature[i+1];
+
+		const int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, 0, 1, COLUMNS);
+		#ifdef ROW_KERNELS
+			dt = stencil_row_delta(&temperature[i][first_column], &north[first_column], &centre[first_column], &south[first_column], COLUMNS + 1 - first_column, dt);
+		#else
+			for(int j = first_column; j <= COLUMNS; j++)
+			{
+				temperature[i][j] = 0.25 * (south[j  ] +
+											north[j  ] +
+											centre[j+1] +
+											centre[j-1]);
+				dt = fmax(fabs(temperature[i][j]-centre[j]), dt);
+			}
+		#endif
+
+		north = centre;
+	}
+	return dt;
+}
+
+#endif
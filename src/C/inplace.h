@@ -0,0 +1,37 @@
+/**
+ * @file inplace.h
+ * @brief This file contains the in-place sweep used by the optional mode IN_PLACE of the serial, OpenMP and MPI versions.
+ * @details By default every version keeps two full grids, the stencil reading one and writing the other, which is then copied back. With IN_PLACE there is a single grid, overwritten row by row. The stencil of a row needs the row above and the row itself as they were before the iteration, so both are kept in a rolling window of two rows, the row below being still untouched. A block of rows swept by a thread also needs the rows just above and below it as they were, which may be overwritten by the neighbouring blocks: they are copied aside before the sweep starts. This halves the memory used by the grids, and the memory traffic per cell. The temperature change is found in the same sweep, and cells are added in the same order as the default loops, so results are bit-identical.
+ * @note initialise_temperatures() must not be altered and wants two grids: the second one is a temporary grid, released before the first iteration.
+ **/
+
+#ifndef INPLACE_H_INCLUDED
+#define INPLACE_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef IN_PLACE
+	#ifdef FUSED_SWAP
+		#error "IN_PLACE keeps a single grid, it is not compatible with FUSED_SWAP."
+	#endif
+	#if defined(OVERLAP) || defined(DEEP_HALO) || defined(CARTESIAN_2D) || defined(TEMPORAL_BLOCKING)
+		#error "IN_PLACE supports none of OVERLAP, DEEP_HALO, CARTESIAN_2D and TEMPORAL_BLOCKING."
+	#endif
+
+	/**
+	 * @brief Computes a block of rows in place, and finds their largest temperature change.
+	 * @param[inout] temperature The 2D array that contains the temperatures, those of the previous iteration for the rows of the block on entry and those of the current iteration on return.
+	 * @param[in] first_row The first row of the block.
+	 * @param[in] last_row The last row of the block.
+	 * @param[in] above The row first_row-1, as it was before the iteration. It may be that of \p temperature if nobody writes it during the sweep.
+	 * @param[in] below The row last_row+1, as it was before the iteration. It may be that of \p temperature if nobody writes it during the sweep.
+	 * @param[out] window The rolling window of two rows, whose contents are scratch.
+	 * @param[in] iteration The iteration, only read with the mode ACTIVE_FRONTIER.
+	 * @param[in] row_offset The row, in the plate, of row 0 of \p temperature, only read with the mode ACTIVE_FRONTIER.
+	 * @param[in] dt The largest temperature change found so far.
+	 * @return The largest of \p dt and of the temperature changes of the block.
+	 **/
+	double sweep_in_place(double (*temperature)[COLUMNS+2], int first_row, int last_row, const double* above, const double* below, double window[2][COLUMNS+2], int iteration, int row_offset, double dt);
+#endif
+
+#endif
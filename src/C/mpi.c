@@ -12,18 +12,112 @@
 #include <mpi.h> // MPI_*
 #include <string.h> // strcmp
 #include "util.h"  
+#include "grid.h"
+#include "precision.h"
+#include "stencil.h"
+#include "frontier.h"
+#include "inplace.h"
+#include "halo.h"
+#include "decomposition.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "solver.h"
+#include "checkpoint.h"
+#include "placement.h"
+#include "checksum.h"
+
+#ifdef OVERLAP
+	#if defined(CARTESIAN_2D) || defined(DEEP_HALO)
+		#error "OVERLAP supports neither CARTESIAN_2D nor DEEP_HALO."
+	#endif
+#endif
+
+#ifdef DEFERRED_CONVERGENCE
+	#ifdef OVERLAP
+		#error "DEFERRED_CONVERGENCE is not compatible with OVERLAP, which hides the reduction already."
+	#endif
+	/// Default number of iterations between two global convergence checks, overridden by the environment variable LAPLACE_CHECK_INTERVAL.
+	#ifndef CONVERGENCE_CHECK_INTERVAL
+		#define CONVERGENCE_CHECK_INTERVAL 10
+	#endif
+#endif
 
 /**
  * @brief Runs the experiment.
  * @pre The macro 'ROWS' contains the number of rows (excluding boundaries) per MPI process. It is a define passed as a compilation flag, see makefile.
  * @pre The macro 'COLUMNS' contains the number of columns (excluding boundaries). It is a define passed as a compilation flag, see makefile.
+ * @note With RUNTIME_GRID, ROWS and COLUMNS are set at startup instead, see dimensions.h.
+ * @note With CARTESIAN_2D, each MPI process works on a tile of LOCAL_ROWS x LOCAL_COLUMNS cells instead, see decomposition.h.
  **/
 int main(int argc, char *argv[])
 {
-	// Temperature grid.
-	double temperature[ROWS+2][COLUMNS+2];
-	// Temperature grid from last iteration
-	double temperature_last[ROWS+2][COLUMNS+2]; 
+	#ifdef DIMENSIONS_AT_RUNTIME
+		// The grids below are sized from the dimensions, which need my rank
+		MPI_Init(&argc, &argv);
+		initialise_dimensions();
+	#endif
+	#ifdef SHARED_HALO
+		// Temperature grid, in the window shared with the MPI processes of my node, allocated once MPI is initialised.
+		temperature_t (*temperature)[LOCAL_COLUMNS+2] = NULL;
+		// Temperature grid from last iteration, in the same window.
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = NULL;
+	#elif defined(IN_PLACE)
+		#ifdef HEAP_GRIDS
+			// Temperature grid, updated in place.
+			temperature_t (*temperature)[LOCAL_COLUMNS+2] = allocate_grid(LOCAL_ROWS, LOCAL_COLUMNS);
+		#else
+			// Temperature grid, updated in place.
+			temperature_t temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2];
+		#endif
+		// Second grid wanted by initialise_temperatures(), released before the first iteration
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = allocate_grid(LOCAL_ROWS, LOCAL_COLUMNS);
+		// Rolling window of the rows of the previous iteration
+		double window[2][LOCAL_COLUMNS+2];
+	#elif defined(HEAP_GRIDS)
+		// Temperature grid.
+		temperature_t (*temperature)[LOCAL_COLUMNS+2] = (temperature_t (*)[LOCAL_COLUMNS+2])allocate_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS) + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = (temperature_t (*)[LOCAL_COLUMNS+2])allocate_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS) + HALO_OFFSET;
+	#elif defined(FUSED_SWAP) || defined(DEEP_HALO)
+		// The two temperature grids, including all their halo rows. Their roles alternate at every iteration with FUSED_SWAP.
+		temperature_t temperature_grids[2][LOCAL_ROWS+2*HALO_WIDTH][LOCAL_COLUMNS+2];
+		// Temperature grid.
+		temperature_t (*temperature)[LOCAL_COLUMNS+2] = temperature_grids[0] + HALO_OFFSET;
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[LOCAL_COLUMNS+2] = temperature_grids[1] + HALO_OFFSET;
+	#else
+		// Temperature grid.
+		temperature_t temperature[LOCAL_ROWS+2][LOCAL_COLUMNS+2];
+		// Temperature grid from last iteration
+		temperature_t temperature_last[LOCAL_ROWS+2][LOCAL_COLUMNS+2]; 
+	#endif
+	#ifdef FUSED_SWAP
+		// Used to swap the two grids above.
+		temperature_t (*temperature_swap)[LOCAL_COLUMNS+2];
+	#endif
+	#if !defined(PERSISTENT_HALO) || defined(DEFERRED_CONVERGENCE)
+		// Persistent requests know the grids receiving halos already, only the snapshots of DEFERRED_CONVERGENCE need it then
+		#if defined(FUSED_SWAP) || defined(IN_PLACE) || defined(RED_BLACK_SOR)
+			// Grid read during the next iteration, in which halos must be received.
+			temperature_t (*temperature_next)[LOCAL_COLUMNS+2] = temperature;
+		#else
+			// Grid read during the next iteration, in which halos must be received.
+			temperature_t (*temperature_next)[LOCAL_COLUMNS+2] = temperature_last;
+		#endif
+	#endif
+	#ifdef DEEP_HALO
+		// First and last rows computed during an iteration, halo rows included
+		int first_row;
+		int last_row;
+	#elif !defined(OVERLAP) && !defined(RED_BLACK_SOR)
+		// First and last rows computed during an iteration
+		const int first_row = 1;
+		const int last_row = LOCAL_ROWS;
+	#endif
+	#ifdef RED_BLACK_SOR
+		// Relaxation factor, read once the dimensions are known
+		double omega = get_relaxation_factor();
+	#endif
 	// Current iteration
     int iteration = 0;
     // Temperature change for our MPI process
@@ -34,32 +128,178 @@ int main(int argc, char *argv[])
     int comm_size;
     // The rank of my MPI process
     int my_rank;
-    // Status returned by MPI calls
-    MPI_Status status;
+    #if defined(ACTIVE_FRONTIER) && !defined(IN_PLACE)
+        // Row and column, in the plate, of my cell [0][0]. The in-place sweep is given its row straight away.
+        int row_offset;
+        int column_offset;
+    #endif
+    #ifdef CARTESIAN_2D
+        // My position in the process grid
+        struct decomposition_t decomposition;
+        #ifndef PERSISTENT_HALO
+            // Requests of the halo swap
+            MPI_Request halo_requests[HALO_SWAP_REQUESTS];
+        #endif
+    #elif defined(OVERLAP)
+        #ifndef PERSISTENT_HALO
+            // Requests of the halo swap, completed during the next iteration
+            MPI_Request halo_requests[4] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+        #endif
+        // Request of the reduction of the temperature change, completed during the next iteration
+        MPI_Request reduce_request = MPI_REQUEST_NULL;
+        // Temperature change for our MPI process, left untouched while being reduced
+        double dt_reduced;
+        #ifndef PERSISTENT_HALO
+            // The rank of my top neighbour, MPI_PROC_NULL if I am the first MPI process
+            int top;
+            // The rank of my bottom neighbour, MPI_PROC_NULL if I am the last MPI process
+            int bottom;
+        #endif
+    #elif !defined(PERSISTENT_HALO) && !defined(SHARED_HALO) && !defined(RED_BLACK_SOR)
+        // Status returned by MPI calls
+        MPI_Status status;
+    #endif
+    #ifdef CHECKPOINT
+        // The checkpoint file, written every few iterations
+        struct checkpoint_t checkpoint;
+    #endif
+    #ifdef RMA_HALO
+        // The windows exposing the halos of my grids to my neighbours
+        struct rma_halo_t rma_halo;
+        // Whether halos are swapped with one-sided communications rather than messages
+        int use_rma_halo;
+    #endif
+    #ifdef SHARED_HALO
+        // My node, and the window in which the MPI processes of my node have their grids
+        struct shared_grids_t shared;
+    #endif
+    #ifdef PERSISTENT_HALO
+        // Persistent requests of the halo swap, one set per grid
+        MPI_Request halo_swaps[HALO_SWAP_SETS][HALO_SWAP_REQUESTS];
+        #ifdef OVERLAP
+            // The set of requests last started, completed during the next iteration. Inactive sets complete straight away.
+            MPI_Request* halo_requests = halo_swaps[0];
+        #endif
+    #endif
+
+    #ifdef DEFERRED_CONVERGENCE
+        // Number of iterations between two global convergence checks
+        int check_interval = get_setting("LAPLACE_CHECK_INTERVAL", CONVERGENCE_CHECK_INTERVAL);
+        // First and last iterations of the current window, at the end of which convergence is checked
+        int window_first = 1;
+        int window_last = 0;
+        // My temperature change at each iteration of the window
+        double* dt_history = malloc(sizeof(double) * check_interval);
+        // Temperature change across all MPI processes at each iteration of the window
+        double* dt_history_global = malloc(sizeof(double) * check_interval);
+        // The grid read by the first iteration of the window, restored if the threshold was reached before its end
+        temperature_t (*snapshot)[LOCAL_COLUMNS+2] = allocate_grid(LOCAL_ROWS + 2 * HALO_OFFSET, LOCAL_COLUMNS);
+        // Size of a grid, halo rows included, in bytes
+        size_t grid_size = sizeof(temperature_t) * (LOCAL_ROWS + 2 * HALO_WIDTH) * (LOCAL_COLUMNS + 2);
+    #endif
 
     // The usual MPI startup routines
-    MPI_Init(&argc, &argv);
+    #ifndef DIMENSIONS_AT_RUNTIME
+        MPI_Init(&argc, &argv);
+    #endif
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    #ifdef PLACEMENT
+        // Each MPI process is bound to its share of the node before the grids are first touched, see placement.h
+        initialise_placement(1);
+    #endif
 
-    if(strcmp(VERSION_RUN, "mpi_small") == 0 && comm_size != 4)
-    {
-        printf("The small version is meant to be run with 4 MPI processes, not %d.\n", comm_size);
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-    }
-    else if(strcmp(VERSION_RUN, "mpi_big") == 0 && comm_size != 112)
-    {
-        printf("The big version is meant to be run with 112 MPI processes, not %d.\n", comm_size);
-        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
-    }
+    // With RUNTIME_GRID, initialise_dimensions() shares the rows between any number of MPI processes
+    #ifndef DIMENSIONS_AT_RUNTIME
+        if(strcmp(VERSION_RUN, "mpi_small") == 0 && comm_size != 4)
+        {
+            printf("The small version is meant to be run with 4 MPI processes, not %d.\n", comm_size);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        else if(strcmp(VERSION_RUN, "mpi_big") == 0 && comm_size != 112)
+        {
+            printf("The big version is meant to be run with 112 MPI processes, not %d.\n", comm_size);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    #endif
 
     if(my_rank == 0)
     {
         printf("Running on %d MPI processes\n\n", comm_size);
     }
 
+    #ifdef SHARED_HALO
+        create_shared_grids(&shared, &temperature, &temperature_last);
+        #ifdef FUSED_SWAP
+            temperature_next = temperature;
+        #else
+            temperature_next = temperature_last;
+        #endif
+    #endif
+
     // Initialise temperatures and temperature_last including boundary conditions
-    initialise_temperatures(temperature, temperature_last);
+    #ifdef CARTESIAN_2D
+        create_decomposition(&decomposition);
+        initialise_temperatures_decomposed(&decomposition, temperature, temperature_last);
+    #elif defined(DIMENSIONS_AT_RUNTIME)
+        initialise_temperatures_shared(temperature, temperature_last);
+    #else
+        INITIALISE_TEMPERATURES(temperature, temperature_last);
+    #endif
+    #ifdef DEEP_HALO
+        initialise_halos(temperature, temperature_last);
+    #endif
+    #ifdef CHECKPOINT
+        // Resume from the last checkpoint if asked to, then keep writing them
+        restart_from_checkpoint(temperature, temperature_last, &iteration, &dt_global);
+        create_checkpoints(&checkpoint);
+    #endif
+    #ifdef RMA_HALO
+        use_rma_halo = (get_setting("LAPLACE_HALO_TRANSPORT", 1) == 1);
+        if(use_rma_halo)
+        {
+            #ifdef IN_PLACE
+                // The halos are received straight into the single grid
+                create_rma_halos(&rma_halo, temperature, temperature);
+            #else
+                create_rma_halos(&rma_halo, temperature, temperature_last);
+            #endif
+        }
+    #endif
+    #ifdef PERSISTENT_HALO
+        #ifdef CARTESIAN_2D
+            create_halo_swaps_decomposed(&decomposition, halo_swaps, temperature, temperature_last);
+        #elif defined(IN_PLACE)
+            // The halos are received straight into the single grid
+            create_halo_swaps(halo_swaps, temperature, temperature);
+        #else
+            create_halo_swaps(halo_swaps, temperature, temperature_last);
+        #endif
+    #endif
+    #ifdef IN_PLACE
+        free_grid(temperature_last);
+    #endif
+
+    #if defined(ACTIVE_FRONTIER) && !defined(IN_PLACE)
+        #ifdef CARTESIAN_2D
+            row_offset = decomposition.coordinates[0] * LOCAL_ROWS;
+            column_offset = decomposition.coordinates[1] * LOCAL_COLUMNS;
+        #else
+            row_offset = GRID_ROW_OFFSET(my_rank);
+            column_offset = 0;
+        #endif
+    #endif
+
+    #ifdef ROW_KERNELS
+        initialise_stencil_kernels();
+    #endif
+
+    #ifdef PHASE_TIMERS
+        initialise_phase_timers();
+    #endif
+    #ifdef TELEMETRY
+        initialise_telemetry();
+    #endif
 
     ///////////////////////////////////
     // -- Code from here is timed -- //
@@ -69,82 +309,442 @@ int main(int argc, char *argv[])
         start_timer(&timer_simulation);
     }
 
-    while(dt_global > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
+    #ifdef OVERLAP
+    #ifndef PERSISTENT_HALO
+        top = (my_rank == 0) ? MPI_PROC_NULL : my_rank - 1;
+        bottom = (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1;
+    #endif
+
+    // The temperature delta of an iteration is reduced behind the next one, which is therefore started before knowing
+    // whether it is needed. It is dropped once the reduction tells the threshold was reached.
+    while(iteration <= MAX_NUMBER_OF_ITERATIONS)
     {
         iteration++;
 
-        // Main calculation: average my four neighbours
-        for(unsigned int i = 1; i <= ROWS; i++)
+        #ifdef FUSED_SWAP
+            // The grid computed during last iteration becomes the one we read from
+            temperature_swap = temperature_last;
+            temperature_last = temperature;
+            temperature = temperature_swap;
+            #ifndef PERSISTENT_HALO
+                temperature_next = temperature;
+            #endif
+        #endif
+
+        dt = 0.0;
+
+        // Make sure our halos arrived and our outer rows left, then compute the outer rows; they are all our neighbours need
+        PHASE_BEGIN(PHASE_HALO_WAIT);
+        MPI_Waitall(4, halo_requests, MPI_STATUSES_IGNORE);
+        PHASE_END(PHASE_HALO_WAIT);
+        PHASE_BEGIN(PHASE_STENCIL);
+        for(unsigned int i = 1; i <= ROWS; i += ROWS - 1)
         {
-            for(unsigned int j = 1; j <= COLUMNS; j++)
-            {
-                temperature[i][j] = 0.25 * (temperature_last[i+1][j  ] +
-                                            temperature_last[i-1][j  ] +
-                                            temperature_last[i  ][j+1] +
-                                            temperature_last[i  ][j-1]);
-            }
+            const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, COLUMNS);
+            #ifdef ROW_KERNELS
+                #ifdef FUSED_SWAP
+                    dt = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column, dt);
+                #else
+                    stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column);
+                #endif
+            #else
+                for(unsigned int j = first_column; j <= COLUMNS; j++)
+                {
+                    temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+                                                temperature_last[i-1][j  ] +
+                                                temperature_last[i  ][j+1] +
+                                                temperature_last[i  ][j-1]);
+                    #ifdef FUSED_SWAP
+                        dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+                    #endif
+                }
+            #endif
         }
+        PHASE_END(PHASE_STENCIL);
 
         //////////////////////
         // HALO SWAP PHASE //
         ////////////////////
 
-        // If we are not the last MPI process, we have a bottom neighbour
-        if(my_rank != comm_size-1)
-        {
-			// We send our bottom row to our bottom neighbour
-            MPI_Send(&temperature[ROWS][1], COLUMNS, MPI_DOUBLE, my_rank+1, 0, MPI_COMM_WORLD);
-        }
+        // In flight while we compute the interior. Neighbours past the plate boundaries are MPI_PROC_NULL.
+        PHASE_BEGIN(PHASE_HALO_POST);
+        #ifdef PERSISTENT_HALO
+            halo_requests = halo_swaps[HALO_SWAP_SET(iteration)];
+            MPI_Startall(HALO_SWAP_REQUESTS, halo_requests);
+        #else
+            MPI_Irecv(&temperature_next[0][1], COLUMNS, MPI_TEMPERATURE, top, 0, MPI_COMM_WORLD, &halo_requests[0]);
+            MPI_Irecv(&temperature_next[ROWS+1][1], COLUMNS, MPI_TEMPERATURE, bottom, 1, MPI_COMM_WORLD, &halo_requests[1]);
+            MPI_Isend(&temperature[ROWS][1], COLUMNS, MPI_TEMPERATURE, bottom, 0, MPI_COMM_WORLD, &halo_requests[2]);
+            MPI_Isend(&temperature[1][1], COLUMNS, MPI_TEMPERATURE, top, 1, MPI_COMM_WORLD, &halo_requests[3]);
+        #endif
+        PHASE_END(PHASE_HALO_POST);
 
-        // If we are not the first MPI process, we have a top neighbour
-        if(my_rank != 0)
+        // Main calculation: average my four neighbours
+        PHASE_BEGIN(PHASE_STENCIL);
+        for(unsigned int i = 2; i <= ROWS - 1; i++)
         {
-            // We receive the bottom row from that neighbour into our top halo
-            MPI_Recv(&temperature_last[0][1], COLUMNS, MPI_DOUBLE, my_rank-1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+            const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, COLUMNS);
+            #ifdef ROW_KERNELS
+                #ifdef FUSED_SWAP
+                    dt = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column, dt);
+                #else
+                    stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column);
+                #endif
+            #else
+                for(unsigned int j = first_column; j <= COLUMNS; j++)
+                {
+                    temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+                                                temperature_last[i-1][j  ] +
+                                                temperature_last[i  ][j+1] +
+                                                temperature_last[i  ][j-1]);
+                    #ifdef FUSED_SWAP
+                        dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+                    #endif
+                }
+            #endif
         }
+        PHASE_END(PHASE_STENCIL);
 
-        // If we are not the first MPI process, we have a top neighbour
-        if(my_rank != 0)
+        // The reduction of the last iteration completed behind this one; if the threshold was reached then, drop this iteration
+        PHASE_BEGIN(PHASE_REDUCTION);
+        MPI_Wait(&reduce_request, MPI_STATUS_IGNORE);
+        PHASE_END(PHASE_REDUCTION);
+        if(dt_global <= MAX_TEMP_ERROR)
         {
-            // Send out top row to our top neighbour
-            MPI_Send(&temperature[1][1], COLUMNS, MPI_DOUBLE, my_rank-1, 0, MPI_COMM_WORLD);
+            iteration--;
+            #ifdef FUSED_SWAP
+                temperature_swap = temperature;
+                temperature = temperature_last;
+                temperature_last = temperature_swap;
+            #else
+                // Our outer rows may still be leaving from the grid restored
+                PHASE_BEGIN(PHASE_HALO_WAIT);
+                MPI_Waitall(4, halo_requests, MPI_STATUSES_IGNORE);
+                PHASE_END(PHASE_HALO_WAIT);
+                for(unsigned int i = 1; i <= ROWS; i++)
+                {
+                    for(unsigned int j = 1; j <= COLUMNS; j++)
+                    {
+                        temperature[i][j] = temperature_last[i][j];
+                    }
+                }
+            #endif
+            break;
         }
 
-        // If we are not the last MPI process, we have a bottom neighbour
-        if(my_rank != comm_size-1)
-        {   
-            // We receive the top row from that neighbour into our bottom halo
-            MPI_Recv(&temperature_last[ROWS+1][1], COLUMNS, MPI_DOUBLE, my_rank+1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        }
+        #ifndef FUSED_SWAP
+            //////////////////////////////////////
+            // FIND MAXIMAL TEMPERATURE CHANGE //
+            ////////////////////////////////////
+            PHASE_BEGIN(PHASE_DELTA_COPY);
+            for(unsigned int i = 1; i <= ROWS; i++)
+            {
+                const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, COLUMNS);
+                #ifdef ROW_KERNELS
+                    dt = delta_copy_row(&temperature_last[i][first_column], &temperature[i][first_column], COLUMNS + 1 - first_column, dt);
+                #else
+                    for(unsigned int j = first_column; j <= COLUMNS; j++)
+                    {
+                        dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+                        temperature_last[i][j] = temperature[i][j];
+                    }
+                #endif
+            }
+            PHASE_END(PHASE_DELTA_COPY);
+        #endif
 
-        //////////////////////////////////////
-        // FIND MAXIMAL TEMPERATURE CHANGE //
-        ////////////////////////////////////
-        dt = 0.0;
+        // The reduction of this iteration is not complete yet, that of the last one is
+        TELEMETRY_RECORD(iteration, dt, dt_global);
+
+        // We know our temperature delta, its maximum across MPI processes will be known during the next iteration
+        dt_reduced = dt;
+        PHASE_BEGIN(PHASE_REDUCTION);
+        MPI_Iallreduce(&dt_reduced, &dt_global, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD, &reduce_request);
+        PHASE_END(PHASE_REDUCTION);
 
-        for(unsigned int i = 1; i <= ROWS; i++)
+        // Periodically print test values
+        if((iteration % PRINT_FREQUENCY) == 0)
         {
-            for(unsigned int j = 1; j <= COLUMNS; j++)
+            PHASE_BEGIN(PHASE_PRINT);
+            if(my_rank == comm_size - 1)
             {
-    	        dt = fmax(fabs(temperature[i][j]-temperature_last[i][j]), dt);
-    	        temperature_last[i][j] = temperature[i][j];
+                TRACK_PROGRESS(iteration, temperature);
             }
+            PHASE_END(PHASE_PRINT);
         }
+    }
+
+    // Reduction of the last iteration, if we stopped on the number of iterations, and last halo swap
+    MPI_Wait(&reduce_request, MPI_STATUS_IGNORE);
+    MPI_Waitall(4, halo_requests, MPI_STATUSES_IGNORE);
+    #else
+    while(dt_global > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
+    {
+        #ifdef DEFERRED_CONVERGENCE
+            if(iteration == window_last)
+            {
+                // Open the next window. The output depends on convergence, so it never goes past a printing iteration, nor past the last iteration.
+                window_first = iteration + 1;
+                window_last = iteration + check_interval;
+                if(window_last > (iteration / PRINT_FREQUENCY + 1) * PRINT_FREQUENCY)
+                {
+                    window_last = (iteration / PRINT_FREQUENCY + 1) * PRINT_FREQUENCY;
+                }
+                if(window_last > MAX_NUMBER_OF_ITERATIONS + 1)
+                {
+                    window_last = MAX_NUMBER_OF_ITERATIONS + 1;
+                }
+                memcpy(snapshot, temperature_next - HALO_OFFSET, grid_size);
+            }
+        #endif
 
-        // We know our temperature delta, we now need to sum it with that of other MPI processes
-        MPI_Reduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-        MPI_Bcast(&dt_global, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        iteration++;
+
+        #ifdef DEEP_HALO
+            // The halo rows still valid are computed too, unless we are on the plate boundary
+            first_row = (my_rank == 0) ? 1 : 1 - HALO_EXTENSION(iteration);
+            last_row = (my_rank == comm_size - 1) ? ROWS : ROWS + HALO_EXTENSION(iteration);
+        #endif
+
+        PHASE_BEGIN(PHASE_STENCIL);
+        #ifdef RED_BLACK_SOR
+            // Main calculation: relax the red cells in place, then the black cells from the red cells just relaxed, those of my neighbours included, and find latest dt in the same sweeps
+            dt = sor_sweep(temperature, SOR_RED, GRID_ROW_OFFSET(my_rank), omega, 0.0);
+            PHASE_END(PHASE_STENCIL);
+            PHASE_BEGIN(PHASE_HALO_WAIT);
+            swap_sor_halos(temperature, temperature_next);
+            PHASE_END(PHASE_HALO_WAIT);
+            PHASE_BEGIN(PHASE_STENCIL);
+            dt = sor_sweep(temperature, SOR_BLACK, GRID_ROW_OFFSET(my_rank), omega, dt);
+        #elif defined(IN_PLACE)
+            // Main calculation: average my four neighbours in place and find latest dt in the same sweep. The halos are only written by the swap.
+            dt = sweep_in_place(temperature, first_row, last_row, temperature[first_row-1], temperature[last_row+1], window, iteration, GRID_ROW_OFFSET(my_rank), 0.0);
+        #elif defined(FUSED_SWAP)
+            // The grid computed during last iteration becomes the one we read from
+            temperature_swap = temperature_last;
+            temperature_last = temperature;
+            temperature = temperature_swap;
+            #if !defined(PERSISTENT_HALO) || defined(DEFERRED_CONVERGENCE)
+                temperature_next = temperature;
+            #endif
+
+            // Main calculation: average my four neighbours and find latest dt in the same sweep
+            dt = 0.0;
+
+            for(int i = first_row; i <= last_row; i++)
+            {
+                const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                #ifdef ROW_KERNELS
+                    dt = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column, dt);
+                #else
+                    for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                    {
+                        temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+                                                    temperature_last[i-1][j  ] +
+                                                    temperature_last[i  ][j+1] +
+                                                    temperature_last[i  ][j-1]);
+                        dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+                    }
+                #endif
+            }
+        #else
+            // Main calculation: average my four neighbours
+            for(int i = first_row; i <= last_row; i++)
+            {
+                const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                #ifdef ROW_KERNELS
+                    stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], LOCAL_COLUMNS + 1 - first_column);
+                #else
+                    for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                    {
+                        temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+                                                    temperature_last[i-1][j  ] +
+                                                    temperature_last[i  ][j+1] +
+                                                    temperature_last[i  ][j-1]);
+                    }
+                #endif
+            }
+        #endif
+        PHASE_END(PHASE_STENCIL);
+
+        //////////////////////
+        // HALO SWAP PHASE //
+        ////////////////////
+
+        PHASE_BEGIN(PHASE_HALO_WAIT);
+        #ifdef RED_BLACK_SOR
+            // The black cells just relaxed, read by the red cells of my neighbours during the next iteration
+            swap_sor_halos(temperature, temperature_next);
+        #elif defined(PERSISTENT_HALO)
+            // Every HALO_WIDTH iterations only, always by default. The requests already know their buffers and neighbours.
+            if(HALO_SWAP_DUE(iteration))
+            {
+                MPI_Startall(HALO_SWAP_REQUESTS, halo_swaps[HALO_SWAP_SET(iteration)]);
+                MPI_Waitall(HALO_SWAP_REQUESTS, halo_swaps[HALO_SWAP_SET(iteration)], MPI_STATUSES_IGNORE);
+            }
+        #elif defined(CARTESIAN_2D)
+            // Rows with the north and south neighbours, columns with the west and east ones
+            start_halo_swap(&decomposition, temperature, temperature_next, halo_requests);
+            MPI_Waitall(HALO_SWAP_REQUESTS, halo_requests, MPI_STATUSES_IGNORE);
+        #elif defined(SHARED_HALO)
+            // Every HALO_WIDTH iterations only, always by default. Copies on my node, messages across nodes.
+            if(HALO_SWAP_DUE(iteration))
+            {
+                swap_shared_halos(&shared, temperature, temperature_next);
+            }
+        #else
+            #ifdef RMA_HALO
+                // Picked at runtime, so that both transports can be compared with the same binary
+                if(use_rma_halo)
+                {
+                    if(HALO_SWAP_DUE(iteration))
+                    {
+                        swap_rma_halos(&rma_halo, temperature, temperature_next);
+                    }
+                }
+                else
+            #endif
+            // Every HALO_WIDTH iterations only, always by default
+            if(HALO_SWAP_DUE(iteration))
+            {
+                // If we are not the last MPI process, we have a bottom neighbour
+                if(my_rank != comm_size-1)
+                {
+                    // We send our bottom rows to our bottom neighbour
+                    MPI_Send(&temperature[ROWS - HALO_WIDTH + 1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank+1, 0, MPI_COMM_WORLD);
+                }
+
+                // If we are not the first MPI process, we have a top neighbour
+                if(my_rank != 0)
+                {
+                    // We receive the bottom rows from that neighbour into our top halo
+                    MPI_Recv(&temperature_next[1 - HALO_WIDTH][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank-1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+                }
+
+                // If we are not the first MPI process, we have a top neighbour
+                if(my_rank != 0)
+                {
+                    // Send out top rows to our top neighbour
+                    MPI_Send(&temperature[1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank-1, 0, MPI_COMM_WORLD);
+                }
+
+                // If we are not the last MPI process, we have a bottom neighbour
+                if(my_rank != comm_size-1)
+                {   
+                    // We receive the top rows from that neighbour into our bottom halo
+                    MPI_Recv(&temperature_next[ROWS+1][HALO_FIRST_COLUMN], HALO_CELLS, MPI_TEMPERATURE, my_rank+1, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+                }
+            }
+        #endif
+        PHASE_END(PHASE_HALO_WAIT);
+
+        #if !defined(FUSED_SWAP) && !defined(IN_PLACE) && !defined(RED_BLACK_SOR)
+            //////////////////////////////////////
+            // FIND MAXIMAL TEMPERATURE CHANGE //
+            ////////////////////////////////////
+            dt = 0.0;
+
+            PHASE_BEGIN(PHASE_DELTA_COPY);
+            for(int i = first_row; i <= last_row; i++)
+            {
+                const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i + row_offset, column_offset, 1, LOCAL_COLUMNS);
+                #ifdef ROW_KERNELS
+                    dt = delta_copy_row(&temperature_last[i][first_column], &temperature[i][first_column], LOCAL_COLUMNS + 1 - first_column, dt);
+                #else
+                    for(unsigned int j = first_column; j <= LOCAL_COLUMNS; j++)
+                    {
+                        dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+                        temperature_last[i][j] = temperature[i][j];
+                    }
+                #endif
+            }
+            PHASE_END(PHASE_DELTA_COPY);
+        #endif
+
+        #ifdef DEFERRED_CONVERGENCE
+            // We know our temperature delta, its maximum across MPI processes is only found at the end of the window
+            dt_history[iteration - window_first] = dt;
+            if(iteration == window_last)
+            {
+                int window_size = window_last - window_first + 1;
+                PHASE_BEGIN(PHASE_REDUCTION);
+                MPI_Allreduce(dt_history, dt_history_global, window_size, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+                PHASE_END(PHASE_REDUCTION);
+
+                // The first iteration of the window that reached the threshold, if any
+                int converged = 0;
+                while(converged < window_size - 1 && dt_history_global[converged] > MAX_TEMP_ERROR)
+                {
+                    converged++;
+                }
+                dt_global = dt_history_global[converged];
+
+                if(converged < window_size - 1)
+                {
+                    // Reached before the end of the window: go back to its start, and replay it up to that iteration
+                    memcpy(temperature - HALO_OFFSET, snapshot, grid_size);
+                    #ifndef IN_PLACE
+                        memcpy(temperature_last - HALO_OFFSET, snapshot, grid_size);
+                    #endif
+                    #ifdef FUSED_SWAP
+                        // The grids must play the roles they had, persistent requests are bound to them
+                        if(window_size % 2 == 1)
+                        {
+                            temperature_swap = temperature;
+                            temperature = temperature_last;
+                            temperature_last = temperature_swap;
+                        }
+                    #endif
+                    iteration = window_first - 1;
+                    window_last = window_first + converged;
+                    dt_global = 100;
+                    continue;
+                }
+            }
+        #else
+            // We know our temperature delta, we now need to sum it with that of other MPI processes
+            PHASE_BEGIN(PHASE_REDUCTION);
+            #ifdef SHARED_HALO
+                // Within my node first. This also keeps my neighbours from overwriting their rows before my halo swap has read them.
+                dt_global = reduce_shared(&shared, dt);
+            #else
+                MPI_Reduce(&dt, &dt_global, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+                MPI_Bcast(&dt_global, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+            #endif
+            PHASE_END(PHASE_REDUCTION);
+        #endif
 
         // Periodically print test values
         if((iteration % PRINT_FREQUENCY) == 0)
         {
-            if(my_rank == comm_size - 1)
-            {
-                track_progress(iteration, temperature);
-    	    }
+            PHASE_BEGIN(PHASE_PRINT);
+            #ifdef CARTESIAN_2D
+                track_progress_decomposed(&decomposition, iteration, temperature);
+            #else
+                if(my_rank == comm_size - 1)
+                {
+                    TRACK_PROGRESS(iteration, temperature);
+                }
+            #endif
+            PHASE_END(PHASE_PRINT);
         }
-    }
 
+        TELEMETRY_RECORD(iteration, dt, dt_global);
+
+        #ifdef CHECKPOINT
+            // Written behind the next iterations
+            if(CHECKPOINT_DUE(&checkpoint, iteration))
+            {
+                save_checkpoint(&checkpoint, temperature, iteration, dt_global);
+            }
+            else
+            {
+                // The checkpoint in progress advances, its header is written once every MPI process wrote its rows
+                progress_checkpoint(&checkpoint);
+            }
+        #endif
+    }
+    #endif
 
     // Slightly more accurate timing and cleaner output 
     MPI_Barrier(MPI_COMM_WORLD);
@@ -157,13 +757,60 @@ int main(int argc, char *argv[])
         stop_timer(&timer_simulation);
         print_summary(iteration, dt_global, timer_simulation);
     }
+    #ifdef CHECKSUM
+        // Every MPI process sums its own cells
+        #ifdef CARTESIAN_2D
+            print_checksum(&temperature[0][0], LOCAL_COLUMNS + 2, LOCAL_ROWS, LOCAL_COLUMNS, decomposition.coordinates[0] * LOCAL_ROWS, decomposition.coordinates[1] * LOCAL_COLUMNS);
+        #else
+            print_checksum(&temperature[0][0], COLUMNS + 2, ROWS, COLUMNS, GRID_ROW_OFFSET(my_rank), 0);
+        #endif
+    #endif
+    #ifdef PHASE_TIMERS
+        print_phase_timers();
+    #endif
+    #ifdef TELEMETRY
+        close_telemetry();
+    #endif
+	#ifdef CHECKPOINT
+		// The field reached is written in any case
+		close_checkpoints(&checkpoint, temperature, iteration, dt_global);
+	#endif
 	
+	#ifdef PERSISTENT_HALO
+		free_halo_swaps(halo_swaps);
+	#endif
+	#ifdef RMA_HALO
+		if(use_rma_halo)
+		{
+			free_rma_halos(&rma_halo);
+		}
+	#endif
+	#ifdef DEFERRED_CONVERGENCE
+		free(dt_history);
+		free(dt_history_global);
+		free_grid(snapshot);
+	#endif
+
 	// Print the halo swap verification cell value 
 	MPI_Barrier(MPI_COMM_WORLD);
-	if(my_rank == comm_size - 2)
-	{
-		printf("Value of halo swap verification cell [%d][%d] is %.18f\n", ROWS_GLOBAL - ROWS - 1, COLUMNS - 1, temperature[ROWS][COLUMNS]);
-	}
+	#ifdef CARTESIAN_2D
+		print_verification_cell_decomposed(&decomposition, temperature);
+		free_decomposition(&decomposition);
+	#else
+		if(my_rank == comm_size - 2)
+		{
+			printf("Value of halo swap verification cell [%d][%d] is %.18f\n", GRID_ROW_OFFSET(my_rank) + ROWS - 1, COLUMNS - 1, temperature[ROWS][COLUMNS]);
+		}
+	#endif
+
+	#ifdef SHARED_HALO
+		free_shared_grids(&shared);
+	#elif defined(HEAP_GRIDS)
+		free_grid(temperature - HALO_OFFSET);
+		#ifndef IN_PLACE
+			free_grid(temperature_last - HALO_OFFSET);
+		#endif
+	#endif
 
     MPI_Finalize();
 }
@@ -7,13 +7,34 @@
  **/
 
 #include "util.h"
+#include "grid.h"
+#include "precision.h"
+#include "schedule.h"
+#include "checksum.h"
 #include <math.h> // fabs
 #include <stdlib.h> // EXIT_SUCCESS
 
+#ifdef MULTI_GPU
+	#include <openacc.h> // acc_*
+	#include <omp.h> // omp_get_thread_num
+	#ifdef ASYNC_QUEUES
+		#error "MULTI_GPU does not support ASYNC_QUEUES."
+	#endif
+	#if defined(_OPENACC) && !defined(__PGI) && !defined(__NVCOMPILER)
+		#error "MULTI_GPU launches OpenACC constructs from an OpenMP parallel region, which only the PGI and NVIDIA HPC compilers accept; gcc rejects them."
+	#endif
+#endif
+
+#ifdef ASYNC_QUEUES
+	/// OpenACC queue of the kernels. There is no halo to ship here, so a single queue lets the kernels of an iteration follow one another without the host waiting in between.
+	#define QUEUE_COMPUTE 1
+#endif
+
 /**
  * @brief Runs the experiment.
  * @pre The macro 'ROWS' contains the number of rows (excluding boundaries). It is a define passed as a compilation flag, see makefile.
  * @pre The macro 'COLUMNS' contains the number of columns (excluding boundaries). It is a define passed as a compilation flag, see makefile.
+ * @note With MULTI_GPU, the grid is cut in slabs of rows, one per device, each driven by its own OpenMP thread. The setting LAPLACE_DEVICES lowers the number of slabs, which defaults to, and cannot exceed, the number of devices visible. Only the PGI and NVIDIA HPC compilers build it.
  **/
 int main(int argc, char *argv[])
 {
@@ -21,25 +42,187 @@ int main(int argc, char *argv[])
 	(void)argc;
 	// We indicate that we are not going to use argv.
 	(void)argv;
-	// Temperature grid.
-	double temperature[ROWS+2][COLUMNS+2];
-	// Temperature grid from last iteration
-	double temperature_last[ROWS+2][COLUMNS+2]; 
+	#ifdef HEAP_GRIDS
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	#elif defined(FUSED_SWAP)
+		// The two temperature grids, whose roles alternate at every iteration.
+		temperature_t temperature_grids[2][ROWS+2][COLUMNS+2];
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = temperature_grids[0];
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = temperature_grids[1];
+	#else
+		// Temperature grid.
+		temperature_t temperature[ROWS+2][COLUMNS+2];
+		// Temperature grid from last iteration
+		temperature_t temperature_last[ROWS+2][COLUMNS+2]; 
+	#endif
+	#ifdef FUSED_SWAP
+		// Used to swap the two grids above.
+		temperature_t (*temperature_swap)[COLUMNS+2];
+	#endif
 	// Current iteration.
 	unsigned int iteration = 0;
 	// Largest change in temperature. 
 	double dt = 100;
 
 	// Initialise temperatures and temperature_last including boundary conditions
-	initialise_temperatures(temperature, temperature_last);	
+	INITIALISE_TEMPERATURES(temperature, temperature_last);	
+
+	#ifdef TUNED_SCHEDULES
+		initialise_schedule(temperature_last);
+	#endif
 
 	///////////////////////////////////
 	// -- Code from here is timed -- //
 	///////////////////////////////////
 	start_timer(&timer_simulation);
 
+	#ifdef MULTI_GPU
+	// Number of devices visible, each computing one slab
+	int number_of_acc_devices = acc_get_num_devices(acc_device_default);
+	// Number of slabs, one per device by default
+	int slab_count = get_setting("LAPLACE_DEVICES", (number_of_acc_devices > 0) ? number_of_acc_devices : 1);
+	// A device computes a single slab: two slabs on the same device would alias the halo rows they share there
+	if(slab_count > number_of_acc_devices && number_of_acc_devices > 0)
+	{
+		slab_count = number_of_acc_devices;
+	}
+	if(slab_count > ROWS)
+	{
+		slab_count = ROWS;
+	}
+
+	#pragma omp parallel num_threads(slab_count)
+	{
+		// My slab, and the device that computes it
+		const int slab = omp_get_thread_num();
+		if(number_of_acc_devices > 0)
+		{
+			acc_set_device_num(slab, acc_device_default);
+		}
+		const int first_row = 1 + (slab * ROWS) / slab_count;
+		const int last_row = ((slab + 1) * ROWS) / slab_count;
+		const int slab_rows = last_row - first_row + 1;
+		// Largest change in temperature in my slab.
+		double dt_slab;
+		// Grid read during the next iteration, in which halos must be received.
+		temperature_t (*temperature_next)[COLUMNS+2];
+
+		// My slab and its halo rows stay on my device. Both grids are read in turn when swapping, so both need their halos.
+		#pragma acc enter data copyin(temperature[first_row-1:slab_rows+2][0:COLUMNS+2], temperature_last[first_row-1:slab_rows+2][0:COLUMNS+2])
+
+		// Do until error is under threshold or until max iterations is reached
+		while(dt > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
+		{
+			// Every slab has tested the loop condition before it changes
+			#pragma omp barrier
+			#pragma omp single
+			{
+				iteration++;
+
+				// Reset largest temperature change
+				dt = 0.0;
+
+				#ifdef FUSED_SWAP
+					// The grid computed during last iteration becomes the one we read from
+					temperature_swap = temperature_last;
+					temperature_last = temperature;
+					temperature = temperature_swap;
+				#endif
+			}
+			dt_slab = 0.0;
+
+			#ifdef FUSED_SWAP
+				temperature_next = temperature;
+
+				// Main calculation: average my four neighbors and find latest dt in the same sweep
+				#pragma acc kernels present(temperature[first_row-1:slab_rows+2][0:COLUMNS+2], temperature_last[first_row-1:slab_rows+2][0:COLUMNS+2])
+				for(int i = first_row; i <= last_row; i++)
+				{
+					for(unsigned int j = 1; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+						dt_slab = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_slab);
+					}
+				}
+			#else
+				temperature_next = temperature_last;
+
+				// Main calculation: average my four neighbors
+				#pragma acc kernels present(temperature[first_row-1:slab_rows+2][0:COLUMNS+2], temperature_last[first_row-1:slab_rows+2][0:COLUMNS+2])
+				for(int i = first_row; i <= last_row; i++)
+				{
+					for(unsigned int j = 1; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+					}
+				}
+
+				// On a host target the slabs share the grids, my neighbours must be done reading my outer rows
+				#pragma omp barrier
+
+				// Copy grid to old grid for next iteration and find latest dt
+				#pragma acc kernels present(temperature[first_row-1:slab_rows+2][0:COLUMNS+2], temperature_last[first_row-1:slab_rows+2][0:COLUMNS+2])
+				for(int i = first_row; i <= last_row; i++)
+				{
+					for(unsigned int j = 1; j <= COLUMNS; j++)
+					{
+						dt_slab = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt_slab);
+						temperature_last[i][j] = temperature[i][j];
+					}
+				}
+			#endif
+
+			// My outer rows go through the host, where my neighbours fetch them once every slab has put its own
+			#pragma acc update host(temperature_next[first_row:1][0:COLUMNS+2])
+			#pragma acc update host(temperature_next[last_row:1][0:COLUMNS+2])
+			#pragma omp critical
+			dt = fmax(dt_slab, dt);
+			#pragma omp barrier
+
+			// The plate boundaries never change, only the halos between slabs are fetched
+			if(slab > 0)
+			{
+				#pragma acc update device(temperature_next[first_row-1:1][0:COLUMNS+2])
+			}
+			if(slab < slab_count - 1)
+			{
+				#pragma acc update device(temperature_next[last_row+1:1][0:COLUMNS+2])
+			}
+
+			// Periodically print test values
+			if((iteration % PRINT_FREQUENCY) == 0)
+			{
+				#pragma acc update host(temperature[first_row:slab_rows][0:COLUMNS+2])
+				#pragma omp barrier
+				#pragma omp master
+				TRACK_PROGRESS(iteration, temperature);
+			}
+		}
+
+		// My slab goes back to the host, but not my halos which are held by my neighbours
+		#pragma acc update host(temperature[first_row:slab_rows][0:COLUMNS+2])
+		#pragma acc update host(temperature_last[first_row:slab_rows][0:COLUMNS+2])
+		#pragma acc exit data delete(temperature[first_row-1:slab_rows+2][0:COLUMNS+2], temperature_last[first_row-1:slab_rows+2][0:COLUMNS+2])
+	}
+	#else
 	// Do until error is under threshold or until max iterations is reached
-	#pragma acc data copy(temperature_last), create(temperature)
+	// Both grids are read in turn when swapping, so both need their boundaries on the device
+	#ifdef FUSED_SWAP
+		#pragma acc data copy(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2])
+	#else
+		#pragma acc data copy(temperature_last[0:ROWS+2][0:COLUMNS+2]), create(temperature[0:ROWS+2][0:COLUMNS+2])
+	#endif
 	{
 		while(dt > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
 		{
@@ -48,38 +231,92 @@ int main(int argc, char *argv[])
 			// Reset largest temperature change
 			dt = 0.0; 
 
-			// Main calculation: average my four neighbors
-			#pragma acc kernels
-			for(unsigned int i = 1; i <= ROWS; i++)
-			{
-				for(unsigned int j = 1; j <= COLUMNS; j++)
+			#ifdef TUNED_SCHEDULES
+				#ifdef FUSED_SWAP
+					// The grid computed during last iteration becomes the one we read from
+					temperature_swap = temperature_last;
+					temperature_last = temperature;
+					temperature = temperature_swap;
+				#endif
+
+				// Main calculation: average my four neighbors and find latest dt in a single kernel, scheduled for the device
+				dt = scheduled_sweep(temperature, temperature_last, 1, ROWS);
+
+				#ifndef FUSED_SWAP
+					// Copy grid to old grid for next iteration
+					scheduled_copy(temperature_last, temperature, 1, ROWS);
+				#endif
+			#elif defined(FUSED_SWAP)
+				// The grid computed during last iteration becomes the one we read from
+				temperature_swap = temperature_last;
+				temperature_last = temperature;
+				temperature = temperature_swap;
+
+				// Main calculation: average my four neighbors and find latest dt in the same sweep
+				#ifdef ASYNC_QUEUES
+					#pragma acc kernels present(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2]) copy(dt) async(QUEUE_COMPUTE)
+				#else
+					#pragma acc kernels present(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2])
+				#endif
+				for(unsigned int i = 1; i <= ROWS; i++)
 				{
-					temperature[i][j] = 0.25 * (temperature_last[i+1][j  ] +
-												temperature_last[i-1][j  ] +
-												temperature_last[i  ][j+1] +
-												temperature_last[i  ][j-1]);
+					for(unsigned int j = 1; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+						dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+					}
+				}
+			#else
+				// Main calculation: average my four neighbors
+				#ifdef ASYNC_QUEUES
+					#pragma acc kernels present(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2]) async(QUEUE_COMPUTE)
+				#else
+					#pragma acc kernels present(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2])
+				#endif
+				for(unsigned int i = 1; i <= ROWS; i++)
+				{
+					for(unsigned int j = 1; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+					}
 				}
-			}
 
-			// Copy grid to old grid for next iteration and find latest dt
-			#pragma acc kernels
-			for(unsigned int i = 1; i <= ROWS; i++)
-			{
-				for(unsigned int j = 1; j <= COLUMNS; j++)
+				// Copy grid to old grid for next iteration and find latest dt
+				#ifdef ASYNC_QUEUES
+					#pragma acc kernels present(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2]) copy(dt) async(QUEUE_COMPUTE)
+				#else
+					#pragma acc kernels present(temperature[0:ROWS+2][0:COLUMNS+2], temperature_last[0:ROWS+2][0:COLUMNS+2])
+				#endif
+				for(unsigned int i = 1; i <= ROWS; i++)
 				{
-					dt = fmax(fabs(temperature[i][j]-temperature_last[i][j]), dt);
-					temperature_last[i][j] = temperature[i][j];
+					for(unsigned int j = 1; j <= COLUMNS; j++)
+					{
+						dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+						temperature_last[i][j] = temperature[i][j];
+					}
 				}
-			}
+			#endif
+
+			#ifdef ASYNC_QUEUES
+				// Only the temperature delta comes back to the host
+				#pragma acc wait(QUEUE_COMPUTE)
+			#endif
 
 			// Periodically print test values
 			if((iteration % PRINT_FREQUENCY) == 0)
 			{
-				#pragma acc update host(temperature)
-				track_progress(iteration, temperature);
+				#pragma acc update host(temperature[0:ROWS+2][0:COLUMNS+2])
+				TRACK_PROGRESS(iteration, temperature);
 			}
 		}
 	}
+	#endif
 
 	/////////////////////////////////////////////
 	// -- Code from here is no longer timed -- //
@@ -87,6 +324,19 @@ int main(int argc, char *argv[])
 	stop_timer(&timer_simulation);
 
 	print_summary(iteration, dt, timer_simulation);
+	#ifdef CHECKSUM
+		#if defined(FUSED_SWAP) || defined(MULTI_GPU)
+			print_checksum(&temperature[0][0], COLUMNS + 2, ROWS, COLUMNS, 0, 0);
+		#else
+			// The grid computed is only created on the device, its copy came back in the other
+			print_checksum(&temperature_last[0][0], COLUMNS + 2, ROWS, COLUMNS, 0, 0);
+		#endif
+	#endif
+
+	#ifdef HEAP_GRIDS
+		free_grid(temperature);
+		free_grid(temperature_last);
+	#endif
 
 	return EXIT_SUCCESS;
 }
@@ -7,15 +7,152 @@
  **/
 
 #include "util.h"
+#include "grid.h"
+#include "precision.h"
+#include "stencil.h"
+#include "frontier.h"
+#include "inplace.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "solver.h"
+#include "ensemble.h"
+#include "placement.h"
+#include "checksum.h"
 #include <math.h> // fabs
 #include <stdio.h> // printf
 #include <stdlib.h> // EXIT_SUCCESS
+#include <string.h> // memcpy
 #include <omp.h>
 
+#ifdef TEMPORAL_BLOCKING
+	/// Default number of iterations performed on a tile before moving to the next one, overridden by the environment variable LAPLACE_TB_DEPTH.
+	#ifndef TEMPORAL_BLOCKING_DEPTH
+		#define TEMPORAL_BLOCKING_DEPTH 8
+	#endif
+	/// Default number of rows owned by a tile, overridden by the environment variable LAPLACE_TB_TILE_ROWS.
+	#ifndef TEMPORAL_BLOCKING_TILE_ROWS
+		#define TEMPORAL_BLOCKING_TILE_ROWS 64
+	#endif
+	/// Default number of columns owned by a tile, overridden by the environment variable LAPLACE_TB_TILE_COLUMNS.
+	#ifndef TEMPORAL_BLOCKING_TILE_COLUMNS
+		#define TEMPORAL_BLOCKING_TILE_COLUMNS 1024
+	#endif
+
+/**
+ * @brief Advances the grid by several iterations, one cache-sized tile at a time.
+ * @details Each tile copies the cells it owns plus a ghost zone as wide as the number of iterations into a private buffer, performs all the iterations there, then writes its cells back. The ghost zone shrinks by one cell at every iteration, so the cells owned by the tile are computed exactly as the plain sweep would compute them; neighbouring tiles just compute the cells between them redundantly.
+ * @param[in] temperature_last The grid before the block of iterations.
+ * @param[out] temperature The grid after the block of iterations. Its boundaries are left untouched.
+ * @param[in] depth The number of iterations to perform.
+ * @param[out] dt The largest temperature change observed at each of the \p depth iterations.
+ * @param[in] tile_rows The number of rows owned by a tile.
+ * @param[in] tile_columns The number of columns owned by a tile.
+ * @param[in] scratch The private buffers of all threads, 2 buffers of \p scratch_cells cells per thread.
+ * @param[in] scratch_cells The number of cells in each private buffer.
+ **/
+static void advance_tiles(double (*temperature_last)[COLUMNS+2], double (*temperature)[COLUMNS+2], int depth, double* dt, int tile_rows, int tile_columns, double* scratch, size_t scratch_cells)
+{
+	for(int k = 0; k < depth; k++)
+	{
+		dt[k] = 0.0;
+	}
+
+	#pragma omp parallel
+	{
+		// Largest temperature change of each iteration, over the tiles handled by this thread
+		double dt_thread[depth];
+		for(int k = 0; k < depth; k++)
+		{
+			dt_thread[k] = 0.0;
+		}
+		double* buffers = scratch + 2 * scratch_cells * omp_get_thread_num();
+
+		#pragma omp for collapse(2) schedule(static)
+		for(int tile_row = 1; tile_row <= ROWS; tile_row += tile_rows)
+		{
+			for(int tile_column = 1; tile_column <= COLUMNS; tile_column += tile_columns)
+			{
+				// Cells owned by the tile
+				int first_row = tile_row;
+				int last_row = (tile_row + tile_rows - 1 < ROWS) ? tile_row + tile_rows - 1 : ROWS;
+				int first_column = tile_column;
+				int last_column = (tile_column + tile_columns - 1 < COLUMNS) ? tile_column + tile_columns - 1 : COLUMNS;
+
+				// Cells loaded: the owned cells and their ghost zone, which stops at the fixed boundaries
+				int row_offset = (first_row - depth > 0) ? first_row - depth : 0;
+				int last_loaded_row = (last_row + depth < ROWS + 1) ? last_row + depth : ROWS + 1;
+				int column_offset = (first_column - depth > 0) ? first_column - depth : 0;
+				int last_loaded_column = (last_column + depth < COLUMNS + 1) ? last_column + depth : COLUMNS + 1;
+				int width = last_loaded_column - column_offset + 1;
+
+				double (*tile_last)[width] = (double (*)[width])buffers;
+				double (*tile)[width] = (double (*)[width])(buffers + scratch_cells);
+				double (*tile_swap)[width];
+
+				// Both buffers get the loaded cells so that the boundaries are found in either
+				for(int i = row_offset; i <= last_loaded_row; i++)
+				{
+					memcpy(tile_last[i - row_offset], &temperature_last[i][column_offset], sizeof(double) * width);
+					memcpy(tile[i - row_offset], &temperature_last[i][column_offset], sizeof(double) * width);
+				}
+
+				for(int k = 0; k < depth; k++)
+				{
+					// Cells that are still exact at this iteration
+					int i_first = (first_row - depth + k + 1 > 1) ? first_row - depth + k + 1 : 1;
+					int i_last = (last_row + depth - k - 1 < ROWS) ? last_row + depth - k - 1 : ROWS;
+					int j_first = (first_column - depth + k + 1 > 1) ? first_column - depth + k + 1 : 1;
+					int j_last = (last_column + depth - k - 1 < COLUMNS) ? last_column + depth - k - 1 : COLUMNS;
+
+					for(int i = i_first - row_offset; i <= i_last - row_offset; i++)
+					{
+						for(int j = j_first - column_offset; j <= j_last - column_offset; j++)
+						{
+							tile[i][j] = 0.25 * (tile_last[i+1][j  ] +
+												 tile_last[i-1][j  ] +
+												 tile_last[i  ][j+1] +
+												 tile_last[i  ][j-1]);
+						}
+
+						// Only the cells owned by the tile contribute to the temperature change
+						if(i + row_offset >= first_row && i + row_offset <= last_row)
+						{
+							for(int j = first_column - column_offset; j <= last_column - column_offset; j++)
+							{
+								dt_thread[k] = fmax(fabs(tile[i][j]-tile_last[i][j]), dt_thread[k]);
+							}
+						}
+					}
+
+					tile_swap = tile_last;
+					tile_last = tile;
+					tile = tile_swap;
+				}
+
+				// The latest iteration is now in tile_last
+				for(int i = first_row; i <= last_row; i++)
+				{
+					memcpy(&temperature[i][first_column], &tile_last[i - row_offset][first_column - column_offset], sizeof(double) * (last_column - first_column + 1));
+				}
+			}
+		}
+
+		#pragma omp critical
+		{
+			for(int k = 0; k < depth; k++)
+			{
+				dt[k] = fmax(dt[k], dt_thread[k]);
+			}
+		}
+	} // End of OpenMP parallel region
+}
+#endif
+
 /**
  * @brief Runs the experiment.
  * @pre The macro 'ROWS' contains the number of rows (excluding boundaries). It is a define passed as a compilation flag, see makefile.
  * @pre The macro 'COLUMNS' contains the number of columns (excluding boundaries). It is a define passed as a compilation flag, see makefile.
+ * @note With RUNTIME_GRID, ROWS and COLUMNS are set at startup instead, see dimensions.h.
  **/
 int main(int argc, char *argv[])
 {
@@ -23,17 +160,100 @@ int main(int argc, char *argv[])
     (void)argc;
     // We indicate that we are not going to use argv.
     (void)argv;
-	// Temperature grid.
-	double temperature[ROWS+2][COLUMNS+2];
-	// Temperature grid from last iteration
-	double temperature_last[ROWS+2][COLUMNS+2]; 
+	#ifdef PLACEMENT
+		// The threads are pinned before the grids are first touched, see placement.h
+		initialise_placement(1);
+	#endif
+	#ifdef DIMENSIONS_AT_RUNTIME
+		// The grids below are sized from the dimensions
+		initialise_dimensions();
+	#endif
+	#ifdef ENSEMBLE
+		// The plates of the ensemble are solved together instead, see ensemble.h
+		return run_ensemble();
+	#endif
+	#ifdef TEMPORAL_BLOCKING
+		// Number of rows owned by a tile.
+		int tb_tile_rows = get_setting("LAPLACE_TB_TILE_ROWS", TEMPORAL_BLOCKING_TILE_ROWS);
+		// Number of columns owned by a tile.
+		int tb_tile_columns = get_setting("LAPLACE_TB_TILE_COLUMNS", TEMPORAL_BLOCKING_TILE_COLUMNS);
+	#endif
+	#ifdef IN_PLACE
+		#ifdef HEAP_GRIDS
+			// Temperature grid, updated in place.
+			temperature_t (*temperature)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		#else
+			// Temperature grid, updated in place.
+			temperature_t temperature[ROWS+2][COLUMNS+2];
+		#endif
+		// Second grid wanted by initialise_temperatures(), released before the first iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		// Rows of the previous iteration kept by each thread: those just above and below its block, then its rolling window
+		double (*in_place_rows)[4][COLUMNS+2] = malloc(sizeof(double) * 4 * (COLUMNS + 2) * omp_get_max_threads());
+	#elif defined(HEAP_GRIDS) && defined(TEMPORAL_BLOCKING)
+		// The cells are first touched by the threads whose tiles write them back
+		const struct grid_partition_t partition = {GRID_PARTITION_TILES, 0, tb_tile_rows, tb_tile_columns};
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = allocate_partitioned_grid(ROWS, COLUMNS, &partition);
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = allocate_partitioned_grid(ROWS, COLUMNS, &partition);
+	#elif defined(HEAP_GRIDS)
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	#elif defined(FUSED_SWAP) || defined(TEMPORAL_BLOCKING)
+		// The two temperature grids, whose roles alternate at every iteration.
+		temperature_t temperature_grids[2][ROWS+2][COLUMNS+2];
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = temperature_grids[0];
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = temperature_grids[1];
+	#else
+		// Temperature grid.
+		temperature_t temperature[ROWS+2][COLUMNS+2];
+		// Temperature grid from last iteration
+		temperature_t temperature_last[ROWS+2][COLUMNS+2]; 
+	#endif
+	#if defined(FUSED_SWAP) || defined(TEMPORAL_BLOCKING)
+		// Used to swap the two grids above.
+		temperature_t (*temperature_swap)[COLUMNS+2];
+	#endif
+    #ifdef RED_BLACK_SOR
+        // Relaxation factor, read once the dimensions are known
+        double omega = get_relaxation_factor();
+    #endif
     // Current iteration.
     unsigned int iteration = 0;
     // Largest change in temperature. 
     double dt = 100;
+	#ifdef TEMPORAL_BLOCKING
+		// Number of iterations performed on a tile before moving to the next one.
+		int tb_depth = get_setting("LAPLACE_TB_DEPTH", TEMPORAL_BLOCKING_DEPTH);
+		// Number of cells in a tile including its widest ghost zone.
+		size_t tb_scratch_cells = (size_t)(tb_tile_rows + 2 * tb_depth) * (tb_tile_columns + 2 * tb_depth);
+		// The private tile buffers of all threads.
+		double* tb_scratch = malloc(sizeof(double) * 2 * tb_scratch_cells * omp_get_max_threads());
+		// Largest temperature change at each iteration of a block.
+		double* tb_dt = malloc(sizeof(double) * tb_depth);
+	#endif
 
     // Initialise temperatures and temperature_last including boundary conditions
-    initialise_temperatures(temperature, temperature_last);  
+    INITIALISE_TEMPERATURES(temperature, temperature_last);  
+	#ifdef IN_PLACE
+		free_grid(temperature_last);
+	#endif
+
+    #ifdef ROW_KERNELS
+        initialise_stencil_kernels();
+    #endif
+
+    #ifdef PHASE_TIMERS
+        initialise_phase_timers();
+    #endif
+    #ifdef TELEMETRY
+        initialise_telemetry();
+    #endif
 
     ///////////////////////////////////
     // -- Code from here is timed -- //
@@ -49,43 +269,177 @@ int main(int argc, char *argv[])
     } // End of OpenMP parallel region
 
 	// Do until error is under threshold or until max iterations is reached
+	#ifdef TEMPORAL_BLOCKING
 	while(dt > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
 	{
-		iteration++;
+		// A block never goes past the next printing iteration, nor past the last iteration allowed
+		int depth = tb_depth;
+		if(depth > PRINT_FREQUENCY - (int)(iteration % PRINT_FREQUENCY))
+		{
+			depth = PRINT_FREQUENCY - (int)(iteration % PRINT_FREQUENCY);
+		}
+		if(depth > MAX_NUMBER_OF_ITERATIONS + 1 - (int)iteration)
+		{
+			depth = MAX_NUMBER_OF_ITERATIONS + 1 - (int)iteration;
+		}
 
-		// Reset largest temperature change
-		dt = 0.0; 
+		// The grid computed during last block becomes the one we read from
+		temperature_swap = temperature_last;
+		temperature_last = temperature;
+		temperature = temperature_swap;
+
+		PHASE_BEGIN(PHASE_STENCIL);
+		advance_tiles(temperature_last, temperature, depth, tb_dt, tb_tile_rows, tb_tile_columns, tb_scratch, tb_scratch_cells);
+		PHASE_END(PHASE_STENCIL);
 
-		// Main calculation: average my four neighbors
-		#pragma omp parallel for
-		for(unsigned int i = 1; i <= ROWS; i++)
+		// If the threshold was crossed before the end of the block, the block is redone up to that iteration only,
+		// temperature_last still holds the grid from before the block.
+		for(int k = 0; k < depth - 1; k++)
 		{
-			for(unsigned int j = 1; j <= COLUMNS; j++)
+			if(tb_dt[k] <= MAX_TEMP_ERROR)
 			{
-				temperature[i][j] = 0.25 * (temperature_last[i+1][j  ] +
-											temperature_last[i-1][j  ] +
-											temperature_last[i  ][j+1] +
-											temperature_last[i  ][j-1]);
+				depth = k + 1;
+				PHASE_BEGIN(PHASE_STENCIL);
+				advance_tiles(temperature_last, temperature, depth, tb_dt, tb_tile_rows, tb_tile_columns, tb_scratch, tb_scratch_cells);
+				PHASE_END(PHASE_STENCIL);
+				break;
 			}
 		}
 
-		// Copy grid to old grid for next iteration and find latest dt
-		#pragma omp parallel for reduction(max:dt)
-		for(unsigned int i = 1; i <= ROWS; i++)
+		iteration += depth;
+		dt = tb_dt[depth - 1];
+
+		// Periodically print test values
+		if((iteration % PRINT_FREQUENCY) == 0)
 		{
-			for(unsigned int j = 1; j <= COLUMNS; j++)
+			PHASE_BEGIN(PHASE_PRINT);
+			TRACK_PROGRESS(iteration, temperature);
+			PHASE_END(PHASE_PRINT);
+		}
+
+		#ifdef TELEMETRY
+			// One record per iteration of the tiles, all ending when the last one does
+			for(int k = 0; k < depth; k++)
 			{
-				dt = fmax(fabs(temperature[i][j]-temperature_last[i][j]), dt);
-				temperature_last[i][j] = temperature[i][j];
+				TELEMETRY_RECORD(iteration - depth + 1 + k, tb_dt[k], tb_dt[k]);
 			}
-		}
+		#endif
+	}
+
+	free(tb_scratch);
+	free(tb_dt);
+	#else
+	while(dt > MAX_TEMP_ERROR && iteration <= MAX_NUMBER_OF_ITERATIONS)
+	{
+		iteration++;
+
+		// Reset largest temperature change
+		dt = 0.0; 
+
+		#ifdef RED_BLACK_SOR
+			// Main calculation: relax the red cells in place, then the black cells from the red cells just relaxed, and find latest dt in the same sweeps
+			PHASE_BEGIN(PHASE_STENCIL);
+			dt = sor_sweep(temperature, SOR_RED, 0, omega, dt);
+			dt = sor_sweep(temperature, SOR_BLACK, 0, omega, dt);
+			PHASE_END(PHASE_STENCIL);
+		#elif defined(IN_PLACE)
+			// Main calculation: average my four neighbors in place and find latest dt in the same sweep
+			#pragma omp parallel reduction(max:dt)
+			{
+				// My block of rows, split like the static schedule of the other loops does
+				int threads = omp_get_num_threads();
+				int thread = omp_get_thread_num();
+				int first_row = 1 + thread * (ROWS / threads) + ((thread < ROWS % threads) ? thread : ROWS % threads);
+				int last_row = first_row + ROWS / threads - ((thread < ROWS % threads) ? 0 : 1);
+				double (*rows)[COLUMNS+2] = in_place_rows[thread];
+
+				// The rows just above and below my block are overwritten by my neighbours, keep them as they are before anyone starts
+				memcpy(rows[0], temperature[first_row-1], sizeof(double) * (COLUMNS + 2));
+				memcpy(rows[1], temperature[last_row+1], sizeof(double) * (COLUMNS + 2));
+				#pragma omp barrier
+
+				// Timed by each thread, which leaves the barriers out and shows the imbalance between threads
+				PHASE_BEGIN(PHASE_STENCIL);
+				dt = sweep_in_place(temperature, first_row, last_row, rows[0], rows[1], &rows[2], iteration, 0, dt);
+				PHASE_END(PHASE_STENCIL);
+			}
+		#elif defined(FUSED_SWAP)
+			// The grid computed during last iteration becomes the one we read from
+			temperature_swap = temperature_last;
+			temperature_last = temperature;
+			temperature = temperature_swap;
+
+			// Main calculation: average my four neighbors and find latest dt in the same sweep
+			PHASE_BEGIN(PHASE_STENCIL);
+			#pragma omp parallel for reduction(max:dt)
+			for(unsigned int i = 1; i <= ROWS; i++)
+			{
+				const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i, 0, 1, COLUMNS);
+				#ifdef ROW_KERNELS
+					dt = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column, dt);
+				#else
+					for(unsigned int j = first_column; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+						dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+					}
+				#endif
+			}
+			PHASE_END(PHASE_STENCIL);
+		#else
+			// Main calculation: average my four neighbors
+			PHASE_BEGIN(PHASE_STENCIL);
+			#pragma omp parallel for
+			for(unsigned int i = 1; i <= ROWS; i++)
+			{
+				const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i, 0, 1, COLUMNS);
+				#ifdef ROW_KERNELS
+					stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column);
+				#else
+					for(unsigned int j = first_column; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+					}
+				#endif
+			}
+			PHASE_END(PHASE_STENCIL);
+
+			// Copy grid to old grid for next iteration and find latest dt
+			PHASE_BEGIN(PHASE_DELTA_COPY);
+			#pragma omp parallel for reduction(max:dt)
+			for(unsigned int i = 1; i <= ROWS; i++)
+			{
+				const unsigned int first_column = FRONTIER_FIRST_COLUMN(iteration, i, 0, 1, COLUMNS);
+				#ifdef ROW_KERNELS
+					dt = delta_copy_row(&temperature_last[i][first_column], &temperature[i][first_column], COLUMNS + 1 - first_column, dt);
+				#else
+					for(unsigned int j = first_column; j <= COLUMNS; j++)
+					{
+						dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+						temperature_last[i][j] = temperature[i][j];
+					}
+				#endif
+			}
+			PHASE_END(PHASE_DELTA_COPY);
+		#endif
 
 		// Periodically print test values
 		if((iteration % PRINT_FREQUENCY) == 0)
 		{
-			track_progress(iteration, temperature);
+			PHASE_BEGIN(PHASE_PRINT);
+			TRACK_PROGRESS(iteration, temperature);
+			PHASE_END(PHASE_PRINT);
 		}
+
+		TELEMETRY_RECORD(iteration, dt, dt);
 	}
+	#endif
 
     /////////////////////////////////////////////
     // -- Code from here is no longer timed -- //
@@ -93,6 +447,25 @@ int main(int argc, char *argv[])
     stop_timer(&timer_simulation);
 
     print_summary(iteration, dt, timer_simulation);
+    #ifdef CHECKSUM
+        print_checksum(&temperature[0][0], COLUMNS + 2, ROWS, COLUMNS, 0, 0);
+    #endif
+    #ifdef PHASE_TIMERS
+        print_phase_timers();
+    #endif
+    #ifdef TELEMETRY
+        close_telemetry();
+    #endif
+
+	#ifdef HEAP_GRIDS
+		free_grid(temperature);
+		#ifndef IN_PLACE
+			free_grid(temperature_last);
+		#endif
+	#endif
+	#ifdef IN_PLACE
+		free(in_place_rows);
+	#endif
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,462 @@
+/**
+ * @file placement.c
+ **/
+
+/// sched_setaffinity and the CPU_* macros, which strict C99 would hide.
+#define _GNU_SOURCE
+
+#include "placement.h"
+
+#ifdef PLACEMENT
+
+#include "util.h"
+#include <sched.h> // sched_getaffinity, sched_setaffinity, CPU_*
+#include <stdio.h> // fopen, fgets, fprintf, snprintf, sscanf
+#include <stdlib.h> // getenv, setenv, qsort, strtol
+#include <string.h> // memcpy, strcmp, strlen
+#include <dirent.h> // opendir, readdir, closedir
+#include <unistd.h> // gethostname
+#ifdef _OPENMP
+	#include <omp.h> // omp_get_thread_num, omp_get_num_threads
+#endif
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+#endif
+
+/// Length of the line of the map printed for each MPI process.
+#define PLACEMENT_LINE_LENGTH 512
+
+struct placement_t placement;
+
+/// A CPU of the node, and where it sits.
+struct placement_cpu_t
+{
+	/// The number of the CPU for the operating system.
+	int cpu;
+	/// Its NUMA domain.
+	int domain;
+	/// Its socket.
+	int socket;
+	/// Its core, within its socket.
+	int core;
+};
+
+/**
+ * @brief Reads an integer from a sysfs file.
+ * @param[in] path The path of the file.
+ * @param[in] default_value The value to use when the file cannot be read.
+ * @return The integer read.
+ **/
+static int read_sysfs_integer(const char* path, int default_value)
+{
+	FILE* file = fopen(path, "r");
+	if(file == NULL)
+	{
+		return default_value;
+	}
+	char line[64];
+	int value = default_value;
+	if(fgets(line, sizeof(line), file) != NULL)
+	{
+		// Hexadecimal for the PCI class and vendor, decimal otherwise
+		value = (int)strtol(line, NULL, 0);
+	}
+	fclose(file);
+	return value;
+}
+
+/**
+ * @brief Adds the CPUs of a list in the sysfs format, such as "0-13,28-41", to a set.
+ * @param[in] list The list.
+ * @param[inout] set The set.
+ **/
+static void parse_cpu_list(const char* list, cpu_set_t* set)
+{
+	const char* position = list;
+	while(*position != '\0' && *position != '\n')
+	{
+		char* end;
+		int first = (int)strtol(position, &end, 10);
+		int last = first;
+		if(end == position)
+		{
+			return;
+		}
+		if(*end == '-')
+		{
+			position = end + 1;
+			last = (int)strtol(position, &end, 10);
+		}
+		for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+		{
+			CPU_SET(cpu, set);
+		}
+		position = (*end == ',') ? end + 1 : end;
+	}
+}
+
+/**
+ * @brief Writes a list of CPUs in the sysfs format.
+ * @param[in] cpus The CPUs, in increasing order.
+ * @param[in] count The number of CPUs.
+ * @param[out] list The list written.
+ * @param[in] size The size of \p list, in bytes.
+ **/
+static void format_cpu_list(const int* cpus, int count, char* list, size_t size)
+{
+	size_t length = 0;
+	list[0] = '\0';
+	for(int k = 0; k < count && length < size; k++)
+	{
+		int last = k;
+		while(last + 1 < count && cpus[last + 1] == cpus[last] + 1)
+		{
+			last++;
+		}
+		if(last == k)
+		{
+			length += snprintf(list + length, size - length, "%s%d", (k == 0) ? "" : ",", cpus[k]);
+		}
+		else
+		{
+			length += snprintf(list + length, size - length, "%s%d-%d", (k == 0) ? "" : ",", cpus[k], cpus[last]);
+		}
+		k = last;
+	}
+}
+
+/**
+ * @brief Orders CPUs by NUMA domain, socket, core and number, so that the hardware threads of a core are next to each other.
+ * @param[in] a The first CPU.
+ * @param[in] b The second CPU.
+ * @return A negative, zero or positive number as \p a comes before, with or after \p b.
+ **/
+static int compare_cpus(const void* a, const void* b)
+{
+	const struct placement_cpu_t* first = a;
+	const struct placement_cpu_t* second = b;
+	if(first->domain != second->domain)
+	{
+		return first->domain - second->domain;
+	}
+	if(first->socket != second->socket)
+	{
+		return first->socket - second->socket;
+	}
+	if(first->core != second->core)
+	{
+		return first->core - second->core;
+	}
+	return first->cpu - second->cpu;
+}
+
+/**
+ * @brief Orders integers increasingly.
+ * @param[in] a The first integer.
+ * @param[in] b The second integer.
+ * @return A negative, zero or positive number as \p a is below, equal to or above \p b.
+ **/
+static int compare_integers(const void* a, const void* b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/**
+ * @brief Orders PCI addresses, which sysfs pads so that their text order is the order of the bus.
+ * @param[in] a The first address.
+ * @param[in] b The second address.
+ * @return A negative, zero or positive number as \p a comes before, with or after \p b.
+ **/
+static int compare_addresses(const void* a, const void* b)
+{
+	return strcmp((const char*)a, (const char*)b);
+}
+
+/**
+ * @brief Finds the NUMA domain of every CPU.
+ * @param[out] domains The NUMA domain of each CPU, 0 on nodes that expose none.
+ **/
+static void read_cpu_domains(int domains[CPU_SETSIZE])
+{
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		domains[cpu] = 0;
+	}
+
+	DIR* nodes = opendir("/sys/devices/system/node");
+	if(nodes == NULL)
+	{
+		return;
+	}
+	struct dirent* entry;
+	while((entry = readdir(nodes)) != NULL)
+	{
+		int domain;
+		if(sscanf(entry->d_name, "node%d", &domain) != 1)
+		{
+			continue;
+		}
+		char path[512];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+		FILE* file = fopen(path, "r");
+		if(file == NULL)
+		{
+			continue;
+		}
+		char list[4096];
+		if(fgets(list, sizeof(list), file) != NULL)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			parse_cpu_list(list, &set);
+			for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			{
+				if(CPU_ISSET(cpu, &set))
+				{
+					domains[cpu] = domain;
+				}
+			}
+		}
+		fclose(file);
+	}
+	closedir(nodes);
+}
+
+/**
+ * @brief Lists the GPUs on the PCI bus, NVIDIA and AMD display and 3D controllers, in the order of the bus.
+ * @param[out] addresses The PCI address of each GPU.
+ * @param[out] domains The NUMA domain of each GPU, -1 if unknown.
+ * @return The number of GPUs found.
+ **/
+static int read_devices(char addresses[PLACEMENT_MAX_DEVICES][32], int domains[PLACEMENT_MAX_DEVICES])
+{
+	int count = 0;
+	DIR* devices = opendir("/sys/bus/pci/devices");
+	if(devices == NULL)
+	{
+		return 0;
+	}
+	struct dirent* entry;
+	while((entry = readdir(devices)) != NULL && count < PLACEMENT_MAX_DEVICES)
+	{
+		if(entry->d_name[0] == '.' || strlen(entry->d_name) >= 32)
+		{
+			continue;
+		}
+		char path[512];
+		snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/class", entry->d_name);
+		int class = read_sysfs_integer(path, 0) >> 8;
+		snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/vendor", entry->d_name);
+		int vendor = read_sysfs_integer(path, 0);
+		if((class == 0x0300 || class == 0x0302) && (vendor == 0x10de || vendor == 0x1002))
+		{
+			memcpy(addresses[count], entry->d_name, strlen(entry->d_name) + 1);
+			count++;
+		}
+	}
+	closedir(devices);
+
+	qsort(addresses, count, 32, compare_addresses);
+	for(int d = 0; d < count; d++)
+	{
+		char path[512];
+		snprintf(path, sizeof(path), "/sys/bus/pci/devices/%.31s/numa_node", addresses[d]);
+		domains[d] = read_sysfs_integer(path, -1);
+	}
+	return count;
+}
+
+void initialise_placement(int pin_threads)
+{
+	// The MPI processes of my node, which share its CPUs and devices
+	cpu_set_t allowed;
+	sched_getaffinity(0, sizeof(cpu_set_t), &allowed);
+	#ifdef VERSION_RUN_IS_MPI
+		int my_rank;
+		MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+		MPI_Comm node;
+		MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &node);
+		MPI_Comm_rank(node, &placement.local_rank);
+		MPI_Comm_size(node, &placement.local_size);
+		// Whatever share of the node the launcher gave each MPI process, they are dealt again from all of them
+		cpu_set_t node_allowed;
+		MPI_Allreduce(&allowed, &node_allowed, sizeof(cpu_set_t), MPI_BYTE, MPI_BOR, node);
+		allowed = node_allowed;
+	#else
+		placement.local_rank = 0;
+		placement.local_size = 1;
+	#endif
+
+	// The CPUs of the node, grouped by NUMA domain, socket and core
+	static int cpu_domains[CPU_SETSIZE];
+	read_cpu_domains(cpu_domains);
+	static struct placement_cpu_t cpus[PLACEMENT_MAX_CPUS];
+	int cpu_count = 0;
+	for(int cpu = 0; cpu < CPU_SETSIZE && cpu_count < PLACEMENT_MAX_CPUS; cpu++)
+	{
+		if(CPU_ISSET(cpu, &allowed))
+		{
+			char path[512];
+			cpus[cpu_count].cpu = cpu;
+			cpus[cpu_count].domain = cpu_domains[cpu];
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+			cpus[cpu_count].socket = read_sysfs_integer(path, 0);
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+			cpus[cpu_count].core = read_sysfs_integer(path, cpu);
+			cpu_count++;
+		}
+	}
+	qsort(cpus, cpu_count, sizeof(struct placement_cpu_t), compare_cpus);
+
+	// My share: consecutive CPUs, or a single one if there are more MPI processes than CPUs
+	int first = (placement.local_rank * cpu_count) / placement.local_size;
+	int last = ((placement.local_rank + 1) * cpu_count) / placement.local_size;
+	if(last <= first)
+	{
+		first = placement.local_rank % cpu_count;
+		last = first + 1;
+	}
+	placement.cpu_count = last - first;
+	cpu_set_t share;
+	CPU_ZERO(&share);
+	for(int k = 0; k < placement.cpu_count; k++)
+	{
+		placement.cpus[k] = cpus[first + k].cpu;
+		CPU_SET(placement.cpus[k], &share);
+	}
+	placement.domain = cpus[first].domain;
+	placement.socket = cpus[first].socket;
+
+	// The threads created from now on start within my share
+	sched_setaffinity(0, sizeof(cpu_set_t), &share);
+	placement.threads_pinned = pin_threads && (get_setting("LAPLACE_PIN_THREADS", 1) == 1);
+	#ifdef _OPENMP
+		if(placement.threads_pinned)
+		{
+			#pragma omp parallel
+			{
+				// Spread over my share, so that threads fewer than its CPUs land on different cores first
+				const int thread = omp_get_thread_num();
+				const int thread_count = omp_get_num_threads();
+				const int k = (thread_count <= placement.cpu_count) ? (thread * placement.cpu_count) / thread_count : thread % placement.cpu_count;
+				cpu_set_t mine;
+				CPU_ZERO(&mine);
+				CPU_SET(placement.cpus[k], &mine);
+				sched_setaffinity(0, sizeof(cpu_set_t), &mine);
+			}
+		}
+	#else
+		if(placement.threads_pinned)
+		{
+			cpu_set_t mine;
+			CPU_ZERO(&mine);
+			CPU_SET(placement.cpus[0], &mine);
+			sched_setaffinity(0, sizeof(cpu_set_t), &mine);
+		}
+	#endif
+
+	// My device: those of my NUMA domain are dealt in turn to the MPI processes of my domain
+	static char device_addresses[PLACEMENT_MAX_DEVICES][32];
+	static int device_domains[PLACEMENT_MAX_DEVICES];
+	int device_count = read_devices(device_addresses, device_domains);
+	placement.device_count = device_count;
+	int rank_in_domain = 0;
+	#ifdef VERSION_RUN_IS_MPI
+		int* local_domains = malloc(sizeof(int) * placement.local_size);
+		MPI_Allgather(&placement.domain, 1, MPI_INT, local_domains, 1, MPI_INT, node);
+		for(int r = 0; r < placement.local_rank; r++)
+		{
+			if(local_domains[r] == placement.domain)
+			{
+				rank_in_domain++;
+			}
+		}
+		free(local_domains);
+	#endif
+	int domain_devices[PLACEMENT_MAX_DEVICES];
+	int domain_device_count = 0;
+	for(int d = 0; d < device_count; d++)
+	{
+		if(device_domains[d] == placement.domain)
+		{
+			domain_devices[domain_device_count++] = d;
+		}
+	}
+	placement.device = -1;
+	placement.device_domain = -1;
+	placement.device_address[0] = '\0';
+	if(domain_device_count > 0)
+	{
+		placement.device = domain_devices[rank_in_domain % domain_device_count];
+	}
+	else if(device_count > 0)
+	{
+		placement.device = placement.local_rank % device_count;
+	}
+	if(placement.device >= 0)
+	{
+		memcpy(placement.device_address, device_addresses[placement.device], sizeof(placement.device_address));
+		placement.device_domain = device_domains[placement.device];
+		// The devices of the OpenACC runtime are numbered as on the PCI bus, unless told otherwise
+		setenv("CUDA_DEVICE_ORDER", "PCI_BUS_ID", 0);
+	}
+
+	// The map of the node, one line per MPI process
+	char host[256];
+	if(gethostname(host, sizeof(host)) != 0)
+	{
+		host[0] = '\0';
+	}
+	host[sizeof(host) - 1] = '\0';
+	int sorted[PLACEMENT_MAX_CPUS];
+	for(int k = 0; k < placement.cpu_count; k++)
+	{
+		sorted[k] = placement.cpus[k];
+	}
+	qsort(sorted, placement.cpu_count, sizeof(int), compare_integers);
+	char cpu_list[256];
+	format_cpu_list(sorted, placement.cpu_count, cpu_list, sizeof(cpu_list));
+	char line[PLACEMENT_LINE_LENGTH];
+	int length = snprintf(line, sizeof(line), "local rank %d of %d on %s, CPUs %s (NUMA domain %d, socket %d), threads %s", placement.local_rank, placement.local_size, host, cpu_list, placement.domain, placement.socket, placement.threads_pinned ? "pinned one per CPU" : "free within these CPUs");
+	if(placement.device >= 0 && length < PLACEMENT_LINE_LENGTH)
+	{
+		snprintf(line + length, sizeof(line) - length, ", device %d at %s (NUMA domain %d)", placement.device, placement.device_address, placement.device_domain);
+	}
+
+	#ifdef VERSION_RUN_IS_MPI
+		int comm_size;
+		MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+		char* lines = NULL;
+		if(my_rank == 0)
+		{
+			lines = malloc((size_t)PLACEMENT_LINE_LENGTH * comm_size);
+		}
+		MPI_Gather(line, PLACEMENT_LINE_LENGTH, MPI_CHAR, lines, PLACEMENT_LINE_LENGTH, MPI_CHAR, 0, MPI_COMM_WORLD);
+		if(my_rank == 0)
+		{
+			for(int r = 0; r < comm_size; r++)
+			{
+				fprintf(stderr, "MPI process %d placed as %s.\n", r, lines + (size_t)r * PLACEMENT_LINE_LENGTH);
+			}
+			free(lines);
+		}
+		MPI_Comm_free(&node);
+	#else
+		fprintf(stderr, "Process placed as %s.\n", line);
+	#endif
+}
+
+int get_placed_device(int device_count)
+{
+	if(device_count <= 0)
+	{
+		return 0;
+	}
+	if(placement.device < 0 || placement.device_count != device_count)
+	{
+		return placement.local_rank % device_count;
+	}
+	return placement.device;
+}
+
+#endif
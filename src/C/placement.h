@@ -0,0 +1,68 @@
+/**
+ * @file placement.h
+ * @brief This file contains the topology-aware placement of the MPI processes, their threads and their devices, used by the optional mode PLACEMENT.
+ * @details By default processes and threads go wherever the launcher and the operating system put them, and the hybrid GPU version gives each process of a node the device of its local rank, wherever that device is attached. With PLACEMENT, initialise_placement() reads the topology of the node from sysfs, without any library: the NUMA domain, socket and core of every CPU, and the NUMA domain of every GPU on the PCI bus. The CPUs the processes of the node may run on, the union of their affinity masks, are ordered by NUMA domain, socket and core, so that the hardware threads of a core are next to each other, then dealt in equal consecutive shares to the processes of the node in the order of their local ranks. Each process is bound to its share, and its OpenMP threads pinned one per CPU, spread over the share so that they land on different cores first. Each process is then given the device closest to it: those attached to its NUMA domain are dealt in turn to the processes of the domain, and only a domain without any falls back on the device of its local rank. Devices are numbered in the order of the PCI bus, which CUDA_DEVICE_ORDER=PCI_BUS_ID makes the numbering of the CUDA runtime too: it is set, unless already set, before the first OpenACC call.
+ * The grids being first touched once the processes are placed, their pages stay on the NUMA domain of the process computing them, as the halos swapped with the device stay on its PCIe root. The resulting map is printed on the standard error. For the union of the affinity masks to span the node, the launcher must not bind each process to a core, for instance 'mpirun --bind-to none'.
+ *
+ * Settings:
+ * - LAPLACE_PIN_THREADS: 1 by default, which pins each OpenMP thread to a CPU. 2 leaves the threads free within the share of their process. Versions whose threads create nested teams never pin them, the threads of a nested team would inherit the single CPU of the thread creating them.
+ **/
+
+#ifndef PLACEMENT_H_INCLUDED
+#define PLACEMENT_H_INCLUDED
+
+#ifdef PLACEMENT
+	#ifndef PLACEMENT_MAX_CPUS
+		/// Largest number of CPUs of a node, can be overriden with a define at compilation time.
+		#define PLACEMENT_MAX_CPUS 1024
+	#endif
+	#ifndef PLACEMENT_MAX_DEVICES
+		/// Largest number of GPUs of a node, can be overriden with a define at compilation time.
+		#define PLACEMENT_MAX_DEVICES 64
+	#endif
+
+	/// Where my process is placed.
+	struct placement_t
+	{
+		/// My rank among the MPI processes of my node.
+		int local_rank;
+		/// The number of MPI processes of my node.
+		int local_size;
+		/// The CPUs of my share, in the order threads are pinned to them.
+		int cpus[PLACEMENT_MAX_CPUS];
+		/// The number of CPUs of my share.
+		int cpu_count;
+		/// The NUMA domain of my share, that of its first CPU.
+		int domain;
+		/// The socket of my share, that of its first CPU.
+		int socket;
+		/// My device, in the order of the PCI bus, -1 if the node has no GPU.
+		int device;
+		/// The number of GPUs found on the PCI bus.
+		int device_count;
+		/// The PCI address of my device.
+		char device_address[32];
+		/// The NUMA domain of my device, -1 if unknown.
+		int device_domain;
+		/// Whether my threads are pinned one per CPU.
+		int threads_pinned;
+	};
+
+	/// Where my process is placed, set by initialise_placement().
+	extern struct placement_t placement;
+
+	/**
+	 * @brief Discovers the topology of the node, binds my process and its threads to my share of the CPUs, picks my device and prints the map of the node.
+	 * @param[in] pin_threads Whether the threads of the version may be pinned one per CPU, as the setting LAPLACE_PIN_THREADS asks. Versions with nested teams pass 0.
+	 * @pre Called once, before the grids are first touched and before the first OpenACC call, after MPI is initialised in MPI versions. Every MPI process must call it.
+	 **/
+	void initialise_placement(int pin_threads);
+	/**
+	 * @brief Gives the device picked for my process.
+	 * @param[in] device_count The number of devices the OpenACC runtime sees.
+	 * @return The number of the device to select, below \p device_count. When the OpenACC runtime does not see as many devices as there are GPUs on the PCI bus, for instance when CUDA_VISIBLE_DEVICES hides some, the device of my local rank.
+	 **/
+	int get_placed_device(int device_count);
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * @file precision.c
+ **/
+
+#include "precision.h"
+
+#ifdef SINGLE_PRECISION
+
+#include "util.h"
+#include <stdio.h> // printf
+#include <stdlib.h> // EXIT_FAILURE, exit, malloc, free
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+#endif
+
+/// Number of cells printed by track_progress(), on the diagonal of its bottom right corner.
+#define PROGRESS_CELLS 6
+
+/**
+ * @brief Allocates a double grid of ROWS x COLUMNS cells, boundaries included.
+ * @return The grid allocated, to release with free(). The program is stopped if the allocation fails.
+ **/
+static double (*allocate_double_grid(void))[COLUMNS+2]
+{
+	double (*grid)[COLUMNS+2] = malloc(sizeof(double) * (ROWS + 2) * (COLUMNS + 2));
+	if(grid == NULL)
+	{
+		printf("Could not allocate a double grid of %d x %d cells.\n", ROWS + 2, COLUMNS + 2);
+		#ifdef VERSION_RUN_IS_MPI
+			MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+		#else
+			exit(EXIT_FAILURE);
+		#endif
+	}
+	return grid;
+}
+
+void initialise_temperatures_rounded(temperature_t (*temperature)[COLUMNS+2], temperature_t (*temperature_last)[COLUMNS+2])
+{
+	double (*initial)[COLUMNS+2] = allocate_double_grid();
+	double (*initial_last)[COLUMNS+2] = allocate_double_grid();
+	initialise_temperatures(initial, initial_last);
+
+	#pragma omp parallel for schedule(static)
+	for(int i = 0; i <= ROWS + 1; i++)
+	{
+		for(int j = 0; j <= COLUMNS + 1; j++)
+		{
+			temperature[i][j] = (temperature_t)initial[i][j];
+			temperature_last[i][j] = (temperature_t)initial_last[i][j];
+		}
+	}
+
+	free(initial);
+	free(initial_last);
+}
+
+void track_progress_rounded(int iteration, temperature_t (*temperature)[COLUMNS+2])
+{
+	// The double grid handed to track_progress(), of which only the cells printed are ever set
+	static double (*progress)[COLUMNS+2] = NULL;
+	if(progress == NULL)
+	{
+		progress = allocate_double_grid();
+	}
+
+	for(int k = 0; k < PROGRESS_CELLS; k++)
+	{
+		progress[ROWS - k][COLUMNS - k] = temperature[ROWS - k][COLUMNS - k];
+	}
+	track_progress(iteration, progress);
+}
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file precision.h
+ * @brief This file contains the type of the temperatures stored in the grids, which the optional mode SINGLE_PRECISION makes float.
+ * @details The sweeps are bandwidth-bound: every cell update streams its cells through memory and, in the MPI and OpenACC versions, the halos through the network and the device transfers. By default the grids are double. With SINGLE_PRECISION, the grids and the halo messages are float, which halves that traffic and the memory taken by the grids, while the arithmetic stays in double: each cell is widened to double before the four neighbours are added, and the temperature changes are found and reduced in double. Only the storage of each cell computed rounds it to float, by at most half a unit in the last place, about 4e-6 for temperatures below 100.
+ * initialise_temperatures() and track_progress() must not be altered, so they keep taking double grids: the float grids are initialised from double grids given by initialise_temperatures(), and the cells printed are copied to a double grid before track_progress() is called. These rounding errors add up over the iterations, so results are no longer bit-identical to the reference outputs: verify.sh, given a bound as its second argument, checks that they are within it instead.
+ **/
+
+#ifndef PRECISION_H_INCLUDED
+#define PRECISION_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef SINGLE_PRECISION
+	#if defined(IN_PLACE) || defined(SIMD_KERNELS) || defined(RUNTIME_GRID) || defined(RED_BLACK_SOR) || defined(TEMPORAL_BLOCKING) || defined(ENSEMBLE)
+		#error "SINGLE_PRECISION is not supported by the sweeps of IN_PLACE, SIMD_KERNELS, RUNTIME_GRID, RED_BLACK_SOR, TEMPORAL_BLOCKING and ENSEMBLE, which work on double grids."
+	#endif
+	#if defined(CARTESIAN_2D) || defined(DEEP_HALO) || defined(PERSISTENT_HALO) || defined(RMA_HALO) || defined(SHARED_HALO) || defined(CHECKPOINT)
+		#error "SINGLE_PRECISION is not supported by the halo swaps and files of CARTESIAN_2D, DEEP_HALO, PERSISTENT_HALO, RMA_HALO, SHARED_HALO and CHECKPOINT, which work on double grids."
+	#endif
+
+	/// The type of the temperatures stored in the grids.
+	typedef float temperature_t;
+	/// The MPI datatype of the temperatures stored in the grids, that of the halo messages.
+	#define MPI_TEMPERATURE MPI_FLOAT
+
+	/**
+	 * @brief Initialises the float grids with the temperatures given by initialise_temperatures(), rounded to float.
+	 * @param[out] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[out] temperature_last The 2D array that contains the previous iteration temperatures.
+	 **/
+	void initialise_temperatures_rounded(temperature_t (*temperature)[COLUMNS+2], temperature_t (*temperature_last)[COLUMNS+2]);
+	/**
+	 * @brief Copies the cells printed by track_progress() to a double grid, then calls it on that grid.
+	 * @details The double grid is allocated on the first call and kept for the whole run.
+	 * @param[in] iteration The iteration at which printing progress.
+	 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+	 **/
+	void track_progress_rounded(int iteration, temperature_t (*temperature)[COLUMNS+2]);
+
+	/// Initialises the grids, see initialise_temperatures_rounded().
+	#define INITIALISE_TEMPERATURES(temperature, temperature_last) initialise_temperatures_rounded(temperature, temperature_last)
+	/// Prints information used for tracking, see track_progress_rounded().
+	#define TRACK_PROGRESS(iteration, temperature) track_progress_rounded(iteration, temperature)
+#else
+	/// The type of the temperatures stored in the grids.
+	typedef double temperature_t;
+	/// The MPI datatype of the temperatures stored in the grids, that of the halo messages.
+	#define MPI_TEMPERATURE MPI_DOUBLE
+
+	/// Initialises the grids, see initialise_temperatures().
+	#define INITIALISE_TEMPERATURES(temperature, temperature_last) initialise_temperatures(temperature, temperature_last)
+	/// Prints information used for tracking, see track_progress().
+	#define TRACK_PROGRESS(iteration, temperature) track_progress(iteration, temperature)
+#endif
+
+#endif
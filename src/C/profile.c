@@ -0,0 +1,243 @@
+/**
+ * @file profile.c
+ **/
+
+#ifdef PHASE_TIMERS
+
+#include "profile.h"
+#include "util.h"
+#include <stdio.h> // fprintf
+#include <stdlib.h> // EXIT_FAILURE, malloc, free
+#include <string.h> // memset
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+#endif
+#ifdef PHASE_PAPI
+	#include <papi.h> // PAPI_*
+#endif
+
+/// The name of each phase, as printed.
+static const char* phase_names[PHASE_COUNT] = {"stencil", "delta_copy", "halo_post", "halo_wait", "reduction", "print"};
+
+struct phase_totals_t phase_totals[PHASE_MAX_THREADS];
+
+#ifdef PHASE_PAPI
+	/// The events counted, see PHASE_PAPI_EVENTS.
+	static int phase_events[PHASE_PAPI_EVENTS] = {PAPI_TOT_CYC, PAPI_L3_TCM};
+
+	/// The name of each counter, as printed.
+	static const char* phase_event_names[PHASE_PAPI_EVENTS] = {"cycles", "llc_misses"};
+
+	/**
+	 * @brief Gives the PAPI identifier of the calling thread.
+	 * @return The OpenMP thread number.
+	 **/
+	static unsigned long phase_thread_id(void)
+	{
+		return (unsigned long)phase_thread();
+	}
+
+	void read_phase_counters(long long counters[PHASE_PAPI_EVENTS])
+	{
+		PAPI_read(phase_totals[phase_thread()].event_set, counters);
+	}
+#endif
+
+void initialise_phase_timers(void)
+{
+	#ifdef _OPENMP
+		if(omp_get_max_threads() > PHASE_MAX_THREADS)
+		{
+			printf("PHASE_TIMERS is meant to be run with at most %d OpenMP threads, not %d.\n", PHASE_MAX_THREADS, omp_get_max_threads());
+			exit(EXIT_FAILURE);
+		}
+	#endif
+	memset(phase_totals, 0, sizeof(phase_totals));
+
+	#ifdef PHASE_PAPI
+		if(PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT || PAPI_thread_init(phase_thread_id) != PAPI_OK)
+		{
+			printf("PAPI could not be initialised.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		// Counters are per thread, each thread starts its own
+		#pragma omp parallel
+		{
+			struct phase_totals_t* totals = &phase_totals[phase_thread()];
+			totals->event_set = PAPI_NULL;
+			if(PAPI_create_eventset(&totals->event_set) != PAPI_OK ||
+			   PAPI_add_events(totals->event_set, phase_events, PHASE_PAPI_EVENTS) != PAPI_OK ||
+			   PAPI_start(totals->event_set) != PAPI_OK)
+			{
+				printf("The PAPI counters could not be started.\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+	#endif
+}
+
+/// Number of values kept per thread: seconds, calls, and the counters of each phase.
+#ifdef PHASE_PAPI
+	#define PHASE_VALUES (PHASE_COUNT * (2 + PHASE_PAPI_EVENTS))
+#else
+	#define PHASE_VALUES (PHASE_COUNT * 2)
+#endif
+
+/**
+ * @brief Lays out the totals of the threads of my process in a flat array, the same on every MPI process.
+ * @param[in] thread_count The number of threads laid out.
+ * @param[out] values For each thread, the seconds of each phase, then its calls, then its counters of each event.
+ **/
+static void flatten_phase_totals(int thread_count, double* values)
+{
+	for(int t = 0; t < thread_count; t++)
+	{
+		double* thread_values = values + t * PHASE_VALUES;
+		for(int p = 0; p < PHASE_COUNT; p++)
+		{
+			thread_values[p] = phase_totals[t].seconds[p];
+			thread_values[PHASE_COUNT + p] = (double)phase_totals[t].calls[p];
+			#ifdef PHASE_PAPI
+				for(int e = 0; e < PHASE_PAPI_EVENTS; e++)
+				{
+					thread_values[(2 + e) * PHASE_COUNT + p] = (double)phase_totals[t].counters[p][e];
+				}
+			#endif
+		}
+	}
+}
+
+/**
+ * @brief Dumps the totals of every thread of every MPI process as JSON.
+ * @param[in] process_count The number of MPI processes.
+ * @param[in] thread_count The number of threads per MPI process.
+ * @param[in] values The totals of every thread of every MPI process, laid out by flatten_phase_totals() one MPI process after the other.
+ **/
+static void dump_phase_timers(int process_count, int thread_count, const double* values)
+{
+	fprintf(stderr, "{\"version\": \"%s\", \"phases\": [", VERSION_RUN);
+	for(int p = 0; p < PHASE_COUNT; p++)
+	{
+		fprintf(stderr, "%s\"%s\"", (p == 0) ? "" : ", ", phase_names[p]);
+	}
+	fprintf(stderr, "], \"ranks\": [");
+	for(int r = 0; r < process_count; r++)
+	{
+		fprintf(stderr, "%s{\"rank\": %d, \"threads\": [", (r == 0) ? "" : ", ", r);
+		for(int t = 0; t < thread_count; t++)
+		{
+			const double* thread_values = values + (r * thread_count + t) * PHASE_VALUES;
+			fprintf(stderr, "%s{\"seconds\": [", (t == 0) ? "" : ", ");
+			for(int p = 0; p < PHASE_COUNT; p++)
+			{
+				fprintf(stderr, "%s%.9f", (p == 0) ? "" : ", ", thread_values[p]);
+			}
+			fprintf(stderr, "], \"calls\": [");
+			for(int p = 0; p < PHASE_COUNT; p++)
+			{
+				fprintf(stderr, "%s%.0f", (p == 0) ? "" : ", ", thread_values[PHASE_COUNT + p]);
+			}
+			fprintf(stderr, "]");
+			#ifdef PHASE_PAPI
+				for(int e = 0; e < PHASE_PAPI_EVENTS; e++)
+				{
+					fprintf(stderr, ", \"%s\": [", phase_event_names[e]);
+					for(int p = 0; p < PHASE_COUNT; p++)
+					{
+						fprintf(stderr, "%s%.0f", (p == 0) ? "" : ", ", thread_values[(2 + e) * PHASE_COUNT + p]);
+					}
+					fprintf(stderr, "]");
+				}
+			#endif
+			fprintf(stderr, "}");
+		}
+		fprintf(stderr, "]}");
+	}
+	fprintf(stderr, "]}\n");
+}
+
+/**
+ * @brief Prints, for each phase, the minimum, mean and maximum across MPI processes of the time of their threads.
+ * @param[in] process_count The number of MPI processes.
+ * @param[in] thread_count The number of threads per MPI process.
+ * @param[in] values The totals of every thread of every MPI process, laid out by flatten_phase_totals() one MPI process after the other.
+ **/
+static void summarise_phase_timers(int process_count, int thread_count, const double* values)
+{
+	fprintf(stderr, "\nTime per phase, in seconds summed over the threads of each MPI process (min / mean / max across %d MPI processes):\n", process_count);
+	for(int p = 0; p < PHASE_COUNT; p++)
+	{
+		double minimum = 0.0;
+		double maximum = 0.0;
+		double sum = 0.0;
+		int slowest = 0;
+		double calls = 0.0;
+		for(int r = 0; r < process_count; r++)
+		{
+			double seconds = 0.0;
+			for(int t = 0; t < thread_count; t++)
+			{
+				seconds += values[(r * thread_count + t) * PHASE_VALUES + p];
+				calls += values[(r * thread_count + t) * PHASE_VALUES + PHASE_COUNT + p];
+			}
+			if(r == 0 || seconds < minimum)
+			{
+				minimum = seconds;
+			}
+			if(r == 0 || seconds > maximum)
+			{
+				maximum = seconds;
+				slowest = r;
+			}
+			sum += seconds;
+		}
+		if(calls > 0)
+		{
+			fprintf(stderr, "    %-12s %10.3f / %10.3f / %10.3f (slowest: rank %d)\n", phase_names[p], minimum, sum / process_count, maximum, slowest);
+		}
+	}
+}
+
+void print_phase_timers(void)
+{
+	int my_rank = 0;
+	int process_count = 1;
+	int thread_count = 1;
+	#ifdef _OPENMP
+		thread_count = omp_get_max_threads();
+	#endif
+	#ifdef VERSION_RUN_IS_MPI
+		MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+		MPI_Comm_size(MPI_COMM_WORLD, &process_count);
+		MPI_Allreduce(MPI_IN_PLACE, &thread_count, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+	#endif
+
+	double* values = malloc(sizeof(double) * PHASE_VALUES * thread_count);
+	flatten_phase_totals(thread_count, values);
+	double* all_values = values;
+	#ifdef VERSION_RUN_IS_MPI
+		all_values = (my_rank == 0) ? malloc(sizeof(double) * PHASE_VALUES * thread_count * process_count) : NULL;
+		MPI_Gather(values, PHASE_VALUES * thread_count, MPI_DOUBLE, all_values, PHASE_VALUES * thread_count, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	#endif
+
+	if(my_rank == 0)
+	{
+		if(get_setting("LAPLACE_PHASE_JSON", 0) == 1)
+		{
+			dump_phase_timers(process_count, thread_count, all_values);
+		}
+		else
+		{
+			summarise_phase_timers(process_count, thread_count, all_values);
+		}
+	}
+
+	if(all_values != values)
+	{
+		free(all_values);
+	}
+	free(values);
+}
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file profile.h
+ * @brief This file contains the phase timers used by the C CPU versions with the optional mode PHASE_TIMERS.
+ * @details The timer ends with a single number, which tells nothing of where the time goes. With PHASE_TIMERS, each iteration is cut in named phases, PHASE_BEGIN() and PHASE_END() accumulating the time spent in each of them by each OpenMP thread. Once the simulation is over, print_phase_timers() gives, for each phase, the time of the MPI processes with their minimum, mean and maximum, which shows load imbalance and communication stalls without an external profiler. Phases that only the master thread enters are counted once per MPI process, those entered by several threads count the time of each of them. The report goes to the standard error so that the standard output can still be compared with the reference outputs.
+ * By default, a blocking halo swap is entirely counted as waiting, only non-blocking swaps have their requests posted apart. With PHASE_PAPI, the PAPI counters of cycles and last level cache misses are accumulated alongside, which requires linking with -lpapi.
+ *
+ * Settings:
+ * - LAPLACE_PHASE_JSON: 1 dumps the totals of every thread of every MPI process as JSON instead of printing the summary.
+ **/
+
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+/// The phases of an iteration.
+enum phase_t
+{
+	/// Averaging the four neighbours, finding the temperature change too with FUSED_SWAP.
+	PHASE_STENCIL,
+	/// Finding the temperature change and copying the grid computed.
+	PHASE_DELTA_COPY,
+	/// Posting the requests of a non-blocking halo swap.
+	PHASE_HALO_POST,
+	/// Completing a halo swap, or all of it when the swap is blocking.
+	PHASE_HALO_WAIT,
+	/// Reducing the temperature change across MPI processes.
+	PHASE_REDUCTION,
+	/// Printing the progress.
+	PHASE_PRINT,
+	/// Number of phases.
+	PHASE_COUNT
+};
+
+#if defined(PHASE_TIMERS) || defined(TELEMETRY)
+	#include <time.h> // clock_gettime
+	#ifdef _OPENMP
+		#include <omp.h> // omp_get_thread_num
+	#endif
+
+	/**
+	 * @brief Gives the slot of the calling thread in phase_totals.
+	 * @return The OpenMP thread number, 0 outside parallel regions.
+	 **/
+	static inline int phase_thread(void)
+	{
+		#ifdef _OPENMP
+			return omp_get_thread_num();
+		#else
+			return 0;
+		#endif
+	}
+
+	/**
+	 * @brief Gives a monotonic time.
+	 * @return The time, in seconds.
+	 **/
+	static inline double phase_clock(void)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return now.tv_sec + now.tv_nsec * 1e-9;
+	}
+#endif
+
+#ifdef PHASE_TIMERS
+
+	#ifndef PHASE_MAX_THREADS
+		/// Largest number of OpenMP threads timed per process, can be overriden with a define at compilation time.
+		#define PHASE_MAX_THREADS 256
+	#endif
+	#ifdef PHASE_PAPI
+		/// Number of PAPI counters accumulated: cycles, then last level cache misses.
+		#define PHASE_PAPI_EVENTS 2
+	#endif
+
+	/// The totals of a thread, aligned on cache lines so that threads do not share them.
+	struct phase_totals_t
+	{
+		/// Time spent in each phase, in seconds.
+		double seconds[PHASE_COUNT];
+		/// Number of times each phase was entered.
+		long long calls[PHASE_COUNT];
+		/// Time at which each phase was last entered.
+		double started[PHASE_COUNT];
+		#ifdef PHASE_PAPI
+			/// Counters accumulated in each phase.
+			long long counters[PHASE_COUNT][PHASE_PAPI_EVENTS];
+			/// Counters when each phase was last entered.
+			long long counters_started[PHASE_COUNT][PHASE_PAPI_EVENTS];
+			/// The PAPI event set of the thread.
+			int event_set;
+		#endif
+	} __attribute__((aligned(64)));
+
+	/// The totals of each thread.
+	extern struct phase_totals_t phase_totals[PHASE_MAX_THREADS];
+
+	#ifdef PHASE_PAPI
+		/**
+		 * @brief Reads the PAPI counters of the calling thread.
+		 * @param[out] counters The PHASE_PAPI_EVENTS counters.
+		 **/
+		void read_phase_counters(long long counters[PHASE_PAPI_EVENTS]);
+	#endif
+
+	/**
+	 * @brief Enters a phase on the calling thread.
+	 * @param[in] phase The phase entered.
+	 **/
+	static inline void phase_begin(enum phase_t phase)
+	{
+		struct phase_totals_t* totals = &phase_totals[phase_thread()];
+		#ifdef PHASE_PAPI
+			read_phase_counters(totals->counters_started[phase]);
+		#endif
+		totals->started[phase] = phase_clock();
+	}
+
+	/**
+	 * @brief Leaves a phase on the calling thread, and adds the time spent in it to the totals of the thread.
+	 * @param[in] phase The phase left.
+	 * @pre The phase was entered on the calling thread with phase_begin().
+	 **/
+	static inline void phase_end(enum phase_t phase)
+	{
+		struct phase_totals_t* totals = &phase_totals[phase_thread()];
+		totals->seconds[phase] += phase_clock() - totals->started[phase];
+		totals->calls[phase]++;
+		#ifdef PHASE_PAPI
+			long long counters[PHASE_PAPI_EVENTS];
+			read_phase_counters(counters);
+			for(int e = 0; e < PHASE_PAPI_EVENTS; e++)
+			{
+				totals->counters[phase][e] += counters[e] - totals->counters_started[phase][e];
+			}
+		#endif
+	}
+
+	/**
+	 * @brief Clears the totals, and starts the PAPI counters of every OpenMP thread with PHASE_PAPI.
+	 * @pre Called once, right before the simulation is timed, outside of any parallel region.
+	 **/
+	void initialise_phase_timers(void);
+	/**
+	 * @brief Prints the totals of the phases to the standard error, or dumps them as JSON with LAPLACE_PHASE_JSON.
+	 * @details Collective with MPI: every MPI process must call it, only the first one prints.
+	 **/
+	void print_phase_timers(void);
+
+	/// Enters a phase, see phase_begin().
+	#define PHASE_BEGIN(phase) phase_begin(phase)
+	/// Leaves a phase, see phase_end().
+	#define PHASE_END(phase) phase_end(phase)
+#else
+	/// Enters a phase: nothing by default.
+	#define PHASE_BEGIN(phase)
+	/// Leaves a phase: nothing by default.
+	#define PHASE_END(phase)
+#endif
+
+#endif
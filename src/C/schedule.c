@@ -0,0 +1,271 @@
+/**
+ * @file schedule.c
+ **/
+
+/// clock_gettime, which strict C99 would hide.
+#define _POSIX_C_SOURCE 200809L
+
+#include "schedule.h"
+
+#ifdef TUNED_SCHEDULES
+
+#include "util.h"
+#include "grid.h"
+#include <math.h> // fabs, fmax
+#include <stdio.h> // fprintf, fopen, fgets, sscanf
+#include <stdlib.h> // getenv
+#include <string.h> // strcmp, strcspn, strncpy
+#include <time.h> // clock_gettime
+#ifdef _OPENACC
+	#include <openacc.h> // acc_*
+#endif
+
+/// Number of schedules in the list below.
+#define SCHEDULE_COUNT 9
+
+/// The schedules tried when tuning, numbered from 1 by the setting LAPLACE_SCHEDULE and in the schedule cache.
+static const struct schedule_t schedules[SCHEDULE_COUNT] = {
+	{SCHEDULE_COLLAPSE, 128},
+	{SCHEDULE_COLLAPSE, 256},
+	{SCHEDULE_COLLAPSE, 512},
+	{SCHEDULE_GANG_VECTOR, 128},
+	{SCHEDULE_GANG_VECTOR, 256},
+	{SCHEDULE_GANG_VECTOR, 512},
+	{SCHEDULE_TILE_32X4, 128},
+	{SCHEDULE_TILE_32X8, 256},
+	{SCHEDULE_TILE_64X4, 256}
+};
+
+/// The names of the kinds of schedule, as reported.
+static const char* schedule_kind_names[] = {"collapse", "gang vector", "tile 32x4", "tile 32x8", "tile 64x4"};
+
+/// The schedule picked by initialise_schedule().
+static struct schedule_t schedule = {SCHEDULE_COLLAPSE, 128};
+
+/// Averages the four neighbours of cell [i][j] and finds its temperature change, as the default loops do.
+#define SWEEP_CELL(i, j) \
+	temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] + \
+								temperature_last[i-1][j  ] + \
+								temperature_last[i  ][j+1] + \
+								temperature_last[i  ][j-1]); \
+	dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+
+double scheduled_sweep(temperature_t (*temperature)[COLUMNS+2], temperature_t (*temperature_last)[COLUMNS+2], int first_row, int last_row)
+{
+	const int vector_length = schedule.vector_length;
+	double dt = 0.0;
+
+	switch(schedule.kind)
+	{
+		case SCHEDULE_COLLAPSE:
+			#pragma acc parallel loop collapse(2) vector_length(vector_length) reduction(max:dt) copy(temperature[first_row-1:last_row-first_row+3][0:COLUMNS+2]) copyin(temperature_last[first_row-1:last_row-first_row+3][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(int j = 1; j <= COLUMNS; j++)
+				{
+					SWEEP_CELL(i, j)
+				}
+			}
+			break;
+		case SCHEDULE_GANG_VECTOR:
+			#pragma acc parallel loop gang vector_length(vector_length) reduction(max:dt) copy(temperature[first_row-1:last_row-first_row+3][0:COLUMNS+2]) copyin(temperature_last[first_row-1:last_row-first_row+3][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				#pragma acc loop vector reduction(max:dt)
+				for(int j = 1; j <= COLUMNS; j++)
+				{
+					SWEEP_CELL(i, j)
+				}
+			}
+			break;
+		case SCHEDULE_TILE_32X4:
+			#pragma acc parallel loop tile(32,4) vector_length(vector_length) reduction(max:dt) copy(temperature[first_row-1:last_row-first_row+3][0:COLUMNS+2]) copyin(temperature_last[first_row-1:last_row-first_row+3][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(int j = 1; j <= COLUMNS; j++)
+				{
+					SWEEP_CELL(i, j)
+				}
+			}
+			break;
+		case SCHEDULE_TILE_32X8:
+			#pragma acc parallel loop tile(32,8) vector_length(vector_length) reduction(max:dt) copy(temperature[first_row-1:last_row-first_row+3][0:COLUMNS+2]) copyin(temperature_last[first_row-1:last_row-first_row+3][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(int j = 1; j <= COLUMNS; j++)
+				{
+					SWEEP_CELL(i, j)
+				}
+			}
+			break;
+		case SCHEDULE_TILE_64X4:
+			#pragma acc parallel loop tile(64,4) vector_length(vector_length) reduction(max:dt) copy(temperature[first_row-1:last_row-first_row+3][0:COLUMNS+2]) copyin(temperature_last[first_row-1:last_row-first_row+3][0:COLUMNS+2])
+			for(int i = first_row; i <= last_row; i++)
+			{
+				for(int j = 1; j <= COLUMNS; j++)
+				{
+					SWEEP_CELL(i, j)
+				}
+			}
+			break;
+	}
+	return dt;
+}
+
+void scheduled_copy(temperature_t (*temperature_last)[COLUMNS+2], temperature_t (*temperature)[COLUMNS+2], int first_row, int last_row)
+{
+	const int vector_length = schedule.vector_length;
+
+	#pragma acc parallel loop collapse(2) vector_length(vector_length) copy(temperature_last[first_row:last_row-first_row+1][0:COLUMNS+2]) copyin(temperature[first_row:last_row-first_row+1][0:COLUMNS+2])
+	for(int i = first_row; i <= last_row; i++)
+	{
+		for(int j = 1; j <= COLUMNS; j++)
+		{
+			temperature_last[i][j] = temperature[i][j];
+		}
+	}
+}
+
+/**
+ * @brief Gives the path of the schedule cache, from the setting LAPLACE_SCHEDULE_FILE.
+ * @return The path of the schedule cache.
+ **/
+static const char* get_schedule_path(void)
+{
+	const char* path = getenv("LAPLACE_SCHEDULE_FILE");
+	return (path == NULL || path[0] == '\0') ? SCHEDULE_FILE : path;
+}
+
+/**
+ * @brief Gives the name of the device in use, which keys the schedule cache.
+ * @param[out] name The name of the device.
+ * @param[in] size The size of \p name, in bytes.
+ **/
+static void get_device_name(char* name, size_t size)
+{
+	const char* device = NULL;
+	#ifdef _OPENACC
+		acc_device_t type = acc_get_device_type();
+		device = acc_get_property_string(acc_get_device_num(type), type, acc_property_name);
+	#endif
+	strncpy(name, (device == NULL || device[0] == '\0') ? "host" : device, size - 1);
+	name[size - 1] = '\0';
+	// The name ends the line of the cache
+	name[strcspn(name, "\n")] = '\0';
+}
+
+/**
+ * @brief Looks for the schedule tuned for this device and plate size in the schedule cache.
+ * @param[in] device The name of the device.
+ * @return The number of the schedule, from 1, or 0 if the cache has none.
+ **/
+static int read_cached_schedule(const char* device)
+{
+	FILE* cache = fopen(get_schedule_path(), "r");
+	if(cache == NULL)
+	{
+		return 0;
+	}
+
+	// Each line is: rows columns schedule device name. The last one for this device and size wins.
+	int found = 0;
+	char line[512];
+	while(fgets(line, sizeof(line), cache) != NULL)
+	{
+		int rows;
+		int columns;
+		int number;
+		int name_start;
+		line[strcspn(line, "\n")] = '\0';
+		if(sscanf(line, "%d %d %d %n", &rows, &columns, &number, &name_start) == 3 && rows == ROWS && columns == COLUMNS && number >= 1 && number <= SCHEDULE_COUNT && strcmp(line + name_start, device) == 0)
+		{
+			found = number;
+		}
+	}
+	fclose(cache);
+	return found;
+}
+
+/**
+ * @brief Gives the time elapsed since an arbitrary point, in seconds.
+ * @return The time, in seconds.
+ **/
+static double get_tuning_clock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Times every schedule of the list for a few sweeps on the device.
+ * @param[in] temperature_last The 2D array that contains the previous iteration temperatures, read by every sweep.
+ * @return The number of the fastest schedule, from 1.
+ **/
+static int tune_schedule(temperature_t (*temperature_last)[COLUMNS+2])
+{
+	const int sweeps = get_setting("LAPLACE_TUNING_SWEEPS", TUNING_SWEEPS);
+	// The sweeps write there, the grid computed by the simulation is not touched
+	temperature_t (*scratch)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	int fastest = 1;
+	double fastest_seconds = 0.0;
+
+	#pragma acc data copyin(temperature_last[0:ROWS+2][0:COLUMNS+2]) create(scratch[0:ROWS+2][0:COLUMNS+2])
+	{
+		for(int s = 0; s < SCHEDULE_COUNT; s++)
+		{
+			schedule = schedules[s];
+			// Not timed: the first launch of a kernel pays for loading it
+			scheduled_sweep(scratch, temperature_last, 1, ROWS);
+			double started = get_tuning_clock();
+			for(int k = 0; k < sweeps; k++)
+			{
+				// The reduction brings dt back to the host, so every sweep is complete when it returns
+				scheduled_sweep(scratch, temperature_last, 1, ROWS);
+			}
+			double seconds = get_tuning_clock() - started;
+			if(s == 0 || seconds < fastest_seconds)
+			{
+				fastest = s + 1;
+				fastest_seconds = seconds;
+			}
+		}
+	}
+
+	free_grid(scratch);
+	return fastest;
+}
+
+void initialise_schedule(temperature_t (*temperature_last)[COLUMNS+2])
+{
+	char device[256];
+	get_device_name(device, sizeof(device));
+
+	const char* origin = "from LAPLACE_SCHEDULE";
+	int number = get_setting("LAPLACE_SCHEDULE", 0);
+	if(number > SCHEDULE_COUNT)
+	{
+		number = 0;
+	}
+	if(number == 0)
+	{
+		origin = "from the cache";
+		number = read_cached_schedule(device);
+	}
+	if(number == 0)
+	{
+		origin = "tuned";
+		number = tune_schedule(temperature_last);
+		FILE* cache = fopen(get_schedule_path(), "a");
+		if(cache != NULL)
+		{
+			fprintf(cache, "%d %d %d %s\n", ROWS, COLUMNS, number, device);
+			fclose(cache);
+		}
+	}
+	schedule = schedules[number - 1];
+
+	fprintf(stderr, "Sweeps scheduled as %s with vectors of %d on %s, schedule %d %s.\n", schedule_kind_names[schedule.kind], schedule.vector_length, device, number, origin);
+}
+
+#endif
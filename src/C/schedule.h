@@ -0,0 +1,83 @@
+/**
+ * @file schedule.h
+ * @brief This file contains the explicit kernel schedules of the OpenACC versions with the optional mode TUNED_SCHEDULES, and the autotuning that picks one for the device.
+ * @details By default the OpenACC versions wrap their loops in acc kernels, leaving the compiler to find the parallelism, map it to gangs and vectors, and infer the max-reduction of the temperature change. With TUNED_SCHEDULES, every sweep is an acc parallel loop with an explicit reduction(max:dt), which averages the four neighbours and finds the temperature change in the same kernel; without FUSED_SWAP, the grid computed is then copied by a kernel that no longer reduces anything. The loops are scheduled in one of the ways of enum schedule_kind_t, with a vector length given at runtime, since the best one differs between GPU generations.
+ * The schedule is picked once, before the simulation is timed: given by the setting LAPLACE_SCHEDULE, or found in the schedule cache for the device and the plate size, or else tuned by timing every schedule of the list for a few sweeps on the actual device and appended to the cache, so that only the first run on a device pays for the tuning. The sweeps tuned read temperature_last and write a scratch grid, the grids of the simulation are left untouched. The schedule picked is reported on the standard error.
+ *
+ * Settings:
+ * - LAPLACE_SCHEDULE: the schedule to use, numbered from 1 in the order of the list in schedule.c, skipping the cache and the tuning.
+ * - LAPLACE_TUNING_SWEEPS: the number of sweeps timed per schedule when tuning, TUNING_SWEEPS by default.
+ * - LAPLACE_SCHEDULE_FILE: the path of the schedule cache, SCHEDULE_FILE by default. Unlike the other settings, it is a string.
+ **/
+
+#ifndef SCHEDULE_H_INCLUDED
+#define SCHEDULE_H_INCLUDED
+
+#include "dimensions.h"
+#include "precision.h"
+
+#ifdef TUNED_SCHEDULES
+	#if defined(ASYNC_QUEUES) || defined(MULTI_GPU) || defined(DEEP_HALO)
+		#error "TUNED_SCHEDULES replaces the synchronous kernels of the whole grid: it supports none of ASYNC_QUEUES, MULTI_GPU and DEEP_HALO."
+	#endif
+
+	#ifndef TUNING_SWEEPS
+		/// Default number of sweeps timed per schedule when tuning, can be overriden with a define at compilation time.
+		#define TUNING_SWEEPS 20
+	#endif
+	#ifndef SCHEDULE_FILE
+		/// Default path of the schedule cache, can be overriden with a define at compilation time.
+		#define SCHEDULE_FILE "laplace_schedules.txt"
+	#endif
+
+	/// The ways a sweep can be mapped to the device.
+	enum schedule_kind_t
+	{
+		/// Both loops collapsed into one, spread over gangs and vectors.
+		SCHEDULE_COLLAPSE,
+		/// A gang per row, the vectors of the gang sweeping its columns.
+		SCHEDULE_GANG_VECTOR,
+		/// Tiles of 32 columns by 4 rows, a vector per tile.
+		SCHEDULE_TILE_32X4,
+		/// Tiles of 32 columns by 8 rows, a vector per tile.
+		SCHEDULE_TILE_32X8,
+		/// Tiles of 64 columns by 4 rows, a vector per tile.
+		SCHEDULE_TILE_64X4
+	};
+
+	/// A schedule of the sweeps.
+	struct schedule_t
+	{
+		/// How the loops are mapped to the device.
+		enum schedule_kind_t kind;
+		/// Number of threads of a vector.
+		int vector_length;
+	};
+
+	/**
+	 * @brief Picks the schedule of the sweeps, from the setting LAPLACE_SCHEDULE, the schedule cache or by tuning them on the device.
+	 * @param[in] temperature_last The 2D array that contains the previous iteration temperatures, read by the sweeps tuned.
+	 * @pre Called once, before the simulation is timed, once the device is selected. The grids may or may not be on the device yet.
+	 **/
+	void initialise_schedule(temperature_t (*temperature_last)[COLUMNS+2]);
+	/**
+	 * @brief Averages the four neighbours of the cells of rows \p first_row to \p last_row and finds their largest temperature change, in a single kernel with the schedule picked.
+	 * @param[out] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[in] temperature_last The 2D array that contains the previous iteration temperatures.
+	 * @param[in] first_row The first row computed.
+	 * @param[in] last_row The last row computed.
+	 * @return The largest temperature change of the cells computed.
+	 * @pre initialise_schedule() has been called. The rows computed and their neighbours are copied to and from the device unless already there.
+	 **/
+	double scheduled_sweep(temperature_t (*temperature)[COLUMNS+2], temperature_t (*temperature_last)[COLUMNS+2], int first_row, int last_row);
+	/**
+	 * @brief Copies the cells of rows \p first_row to \p last_row to the grid of the last iteration.
+	 * @param[out] temperature_last The 2D array that contains the previous iteration temperatures.
+	 * @param[in] temperature The 2D array that contains the current iteration temperatures.
+	 * @param[in] first_row The first row copied.
+	 * @param[in] last_row The last row copied.
+	 **/
+	void scheduled_copy(temperature_t (*temperature_last)[COLUMNS+2], temperature_t (*temperature)[COLUMNS+2], int first_row, int last_row);
+#endif
+
+#endif
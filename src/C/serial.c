@@ -7,6 +7,16 @@
  **/
 
 #include "util.h"
+#include "grid.h"
+#include "precision.h"
+#include "stencil.h"
+#include "frontier.h"
+#include "inplace.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "solver.h"
+#include "ensemble.h"
+#include "checksum.h"
 #include <math.h> // fabs
 #include <stdlib.h> // EXIT_SUCCESS
 
@@ -14,6 +24,7 @@
  * @brief Runs the experiment.
  * @pre The macro 'ROWS' contains the number of rows (excluding boundaries). It is a define passed as a compilation flag, see makefile.
  * @pre The macro 'COLUMNS' contains the number of columns (excluding boundaries). It is a define passed as a compilation flag, see makefile.
+ * @note With RUNTIME_GRID, ROWS and COLUMNS are set at startup instead, see dimensions.h.
  **/
 int main(int argc, char *argv[])
 {
@@ -21,17 +32,73 @@ int main(int argc, char *argv[])
 	(void)argc;
 	// We indicate that we are not going to use argv.
 	(void)argv;
-	// Temperature grid.
-	double temperature[ROWS+2][COLUMNS+2];
-	// Temperature grid from last iteration
-	double temperature_last[ROWS+2][COLUMNS+2]; 
+	#ifdef DIMENSIONS_AT_RUNTIME
+		// The grids below are sized from the dimensions
+		initialise_dimensions();
+	#endif
+	#ifdef ENSEMBLE
+		// The plates of the ensemble are solved together instead, see ensemble.h
+		return run_ensemble();
+	#endif
+	#ifdef IN_PLACE
+		#ifdef HEAP_GRIDS
+			// Temperature grid, updated in place.
+			temperature_t (*temperature)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		#else
+			// Temperature grid, updated in place.
+			temperature_t temperature[ROWS+2][COLUMNS+2];
+		#endif
+		// Second grid wanted by initialise_temperatures(), released before the first iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		// Rolling window of the rows of the previous iteration
+		double window[2][COLUMNS+2];
+	#elif defined(HEAP_GRIDS)
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = allocate_grid(ROWS, COLUMNS);
+	#elif defined(FUSED_SWAP)
+		// The two temperature grids, whose roles alternate at every iteration.
+		temperature_t temperature_grids[2][ROWS+2][COLUMNS+2];
+		// Temperature grid.
+		temperature_t (*temperature)[COLUMNS+2] = temperature_grids[0];
+		// Temperature grid from last iteration
+		temperature_t (*temperature_last)[COLUMNS+2] = temperature_grids[1];
+	#else
+		// Temperature grid.
+		temperature_t temperature[ROWS+2][COLUMNS+2];
+		// Temperature grid from last iteration
+		temperature_t temperature_last[ROWS+2][COLUMNS+2]; 
+	#endif
+	#ifdef FUSED_SWAP
+		// Used to swap the two grids above.
+		temperature_t (*temperature_swap)[COLUMNS+2];
+	#endif
+	#ifdef RED_BLACK_SOR
+		// Relaxation factor, read once the dimensions are known
+		double omega = get_relaxation_factor();
+	#endif
 	// Current iteration.
 	unsigned int iteration = 0;
 	// Largest change in temperature. 
 	double dt = 100;
 
 	// Initialise temperatures and temperature_last including boundary conditions
-	initialise_temperatures(temperature, temperature_last);	
+	INITIALISE_TEMPERATURES(temperature, temperature_last);	
+	#ifdef IN_PLACE
+		free_grid(temperature_last);
+	#endif
+
+	#ifdef ROW_KERNELS
+		initialise_stencil_kernels();
+	#endif
+
+	#ifdef PHASE_TIMERS
+		initialise_phase_timers();
+	#endif
+	#ifdef TELEMETRY
+		initialise_telemetry();
+	#endif
 
 	///////////////////////////////////
 	// -- Code from here is timed -- //
@@ -46,33 +113,89 @@ int main(int argc, char *argv[])
 		// Reset largest temperature change
 		dt = 0.0; 
 
-		// Main calculation: average my four neighbors
-		for(unsigned int i = 1; i <= ROWS; i++)
-		{
-			for(unsigned int j = 1; j <= COLUMNS; j++)
+		#ifdef RED_BLACK_SOR
+			// Main calculation: relax the red cells in place, then the black cells from the red cells just relaxed, and find latest dt in the same sweeps
+			PHASE_BEGIN(PHASE_STENCIL);
+			dt = sor_sweep(temperature, SOR_RED, 0, omega, dt);
+			dt = sor_sweep(temperature, SOR_BLACK, 0, omega, dt);
+			PHASE_END(PHASE_STENCIL);
+		#elif defined(IN_PLACE)
+			// Main calculation: average my four neighbors in place and find latest dt in the same sweep. The boundaries are never written.
+			PHASE_BEGIN(PHASE_STENCIL);
+			dt = sweep_in_place(temperature, 1, ROWS, temperature[0], temperature[ROWS+1], window, iteration, 0, dt);
+			PHASE_END(PHASE_STENCIL);
+		#elif defined(FUSED_SWAP)
+			// The grid computed during last iteration becomes the one we read from
+			temperature_swap = temperature_last;
+			temperature_last = temperature;
+			temperature = temperature_swap;
+
+			// Main calculation: average my four neighbors and find latest dt in the same sweep
+			PHASE_BEGIN(PHASE_STENCIL);
+			for(int i = 1; i <= ROWS; i++)
 			{
-				temperature[i][j] = 0.25 * (temperature_last[i+1][j  ] +
-											temperature_last[i-1][j  ] +
-											temperature_last[i  ][j+1] +
-											temperature_last[i  ][j-1]);
+				const int first_column = FRONTIER_FIRST_COLUMN(iteration, i, 0, 1, COLUMNS);
+				#ifdef ROW_KERNELS
+					dt = stencil_row_delta(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column, dt);
+				#else
+					for(int j = first_column; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+						dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+					}
+				#endif
 			}
-		}
+			PHASE_END(PHASE_STENCIL);
+		#else
+			// Main calculation: average my four neighbors
+			PHASE_BEGIN(PHASE_STENCIL);
+			for(int i = 1; i <= ROWS; i++)
+			{
+				const int first_column = FRONTIER_FIRST_COLUMN(iteration, i, 0, 1, COLUMNS);
+				#ifdef ROW_KERNELS
+					stencil_row(&temperature[i][first_column], &temperature_last[i-1][first_column], &temperature_last[i][first_column], &temperature_last[i+1][first_column], COLUMNS + 1 - first_column);
+				#else
+					for(int j = first_column; j <= COLUMNS; j++)
+					{
+						temperature[i][j] = 0.25 * ((double)temperature_last[i+1][j  ] +
+													temperature_last[i-1][j  ] +
+													temperature_last[i  ][j+1] +
+													temperature_last[i  ][j-1]);
+					}
+				#endif
+			}
+			PHASE_END(PHASE_STENCIL);
 
-		// Copy grid to old grid for next iteration and find latest dt
-		for(unsigned int i = 1; i <= ROWS; i++)
-		{
-			for(unsigned int j = 1; j <= COLUMNS; j++)
+			// Copy grid to old grid for next iteration and find latest dt
+			PHASE_BEGIN(PHASE_DELTA_COPY);
+			for(int i = 1; i <= ROWS; i++)
 			{
-				dt = fmax(fabs(temperature[i][j]-temperature_last[i][j]), dt);
-				temperature_last[i][j] = temperature[i][j];
+				const int first_column = FRONTIER_FIRST_COLUMN(iteration, i, 0, 1, COLUMNS);
+				#ifdef ROW_KERNELS
+					dt = delta_copy_row(&temperature_last[i][first_column], &temperature[i][first_column], COLUMNS + 1 - first_column, dt);
+				#else
+					for(int j = first_column; j <= COLUMNS; j++)
+					{
+						dt = fmax(fabs((double)temperature[i][j]-temperature_last[i][j]), dt);
+						temperature_last[i][j] = temperature[i][j];
+					}
+				#endif
 			}
-		}
+			PHASE_END(PHASE_DELTA_COPY);
+		#endif
 
 		// Periodically print test values
 		if((iteration % PRINT_FREQUENCY) == 0)
 		{
- 			track_progress(iteration, temperature);
+			PHASE_BEGIN(PHASE_PRINT);
+ 			TRACK_PROGRESS(iteration, temperature);
+			PHASE_END(PHASE_PRINT);
 		}
+
+		TELEMETRY_RECORD(iteration, dt, dt);
 	}
 
 	/////////////////////////////////////////////
@@ -81,6 +204,22 @@ int main(int argc, char *argv[])
 	stop_timer(&timer_simulation);
 
 	print_summary(iteration, dt, timer_simulation);
+	#ifdef CHECKSUM
+		print_checksum(&temperature[0][0], COLUMNS + 2, ROWS, COLUMNS, 0, 0);
+	#endif
+	#ifdef PHASE_TIMERS
+		print_phase_timers();
+	#endif
+	#ifdef TELEMETRY
+		close_telemetry();
+	#endif
+
+	#ifdef HEAP_GRIDS
+		free_grid(temperature);
+		#ifndef IN_PLACE
+			free_grid(temperature_last);
+		#endif
+	#endif
 
 	return EXIT_SUCCESS;
 }
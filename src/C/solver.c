@@ -0,0 +1,72 @@
+/**
+ * @file solver.c
+ **/
+
+#include "solver.h"
+
+#ifdef RED_BLACK_SOR
+
+#include "util.h"
+#include <math.h> // fabs, fmax, cos, sqrt
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+#endif
+
+#ifdef ROWS_GLOBAL
+	/// Number of rows of the whole plate (excluding boundaries).
+	#define SOR_PLATE_ROWS ROWS_GLOBAL
+#else
+	/// Number of rows of the whole plate (excluding boundaries).
+	#define SOR_PLATE_ROWS ROWS
+#endif
+
+double get_relaxation_factor(void)
+{
+	// Spectral radius of the Jacobi iteration on the plate, with fixed boundaries
+	const double pi = acos(-1.0);
+	double rho = 0.5 * (cos(pi / (SOR_PLATE_ROWS + 1)) + cos(pi / (COLUMNS + 1)));
+	double optimal = 2.0 / (1.0 + sqrt(1.0 - rho * rho));
+
+	int thousandths = get_setting("LAPLACE_SOR_OMEGA", 0);
+	return (thousandths > 0 && thousandths < 2000) ? thousandths / 1000.0 : optimal;
+}
+
+double sor_sweep(double (*temperature)[COLUMNS+2], int colour, int row_offset, double omega, double dt)
+{
+	#pragma omp parallel for reduction(max:dt) schedule(static)
+	for(int i = 1; i <= ROWS; i++)
+	{
+		// The first column of the colour in this row
+		const int first_column = 1 + ((row_offset + i + 1 + colour) & 1);
+		for(int j = first_column; j <= COLUMNS; j += 2)
+		{
+			double change = 0.25 * (temperature[i+1][j  ] +
+									temperature[i-1][j  ] +
+									temperature[i  ][j+1] +
+									temperature[i  ][j-1]) - temperature[i][j];
+			dt = fmax(fabs(change), dt);
+			temperature[i][j] += omega * change;
+		}
+	}
+	return dt;
+}
+
+#ifdef VERSION_RUN_IS_MPI
+void swap_sor_halos(double (*temperature)[COLUMNS+2], double (*temperature_next)[COLUMNS+2])
+{
+	int my_rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+	int comm_size;
+	MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+	int top = (my_rank == 0) ? MPI_PROC_NULL : my_rank - 1;
+	int bottom = (my_rank == comm_size - 1) ? MPI_PROC_NULL : my_rank + 1;
+
+	// Tagged like the default halo swap: 0 travels downwards, 1 upwards
+	MPI_Sendrecv(&temperature[ROWS][1], COLUMNS, MPI_DOUBLE, bottom, 0,
+				 &temperature_next[0][1], COLUMNS, MPI_DOUBLE, top, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	MPI_Sendrecv(&temperature[1][1], COLUMNS, MPI_DOUBLE, top, 1,
+				 &temperature_next[ROWS + 1][1], COLUMNS, MPI_DOUBLE, bottom, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file solver.h
+ * @brief This file contains the red-black successive over-relaxation used by the C serial, OpenMP and MPI versions with the optional mode RED_BLACK_SOR.
+ * @details The Jacobi iteration computes every cell from the grid of the previous iteration, so heat travels one cell per iteration and the big plate needs thousands of sweeps. With RED_BLACK_SOR, the cells are coloured like a chessboard, by the parity of their row and column in the plate: the four neighbours of a red cell are black and vice versa. Each iteration relaxes the red cells in place, then the black cells from the red ones just relaxed, moving each cell past the average of its neighbours by the relaxation factor. The cells of a colour are independent, so each half-sweep is split between OpenMP threads like the Jacobi loops, and between MPI processes with a halo swap after each colour.
+ * The temperature change of an iteration is the largest difference between a cell and the average of its neighbours when it is relaxed, that is the change the Jacobi iteration would make at that point, so the run stops on the same threshold MAX_TEMP_ERROR. It is reached in 751 iterations on the small plate instead of 3264, on a field much closer to convergence, but the output does not match the reference outputs.
+ *
+ * Settings:
+ * - LAPLACE_SOR_OMEGA: the relaxation factor, in thousandths, below 2000. By default the optimal factor of the Jacobi iteration on the plate, 2 / (1 + sqrt(1 - rho^2)) with rho its spectral radius.
+ **/
+
+#ifndef SOLVER_H_INCLUDED
+#define SOLVER_H_INCLUDED
+
+#include "dimensions.h"
+
+#ifdef RED_BLACK_SOR
+	#if defined(FUSED_SWAP) || defined(IN_PLACE) || defined(TEMPORAL_BLOCKING) || defined(ACTIVE_FRONTIER)
+		#error "RED_BLACK_SOR updates a single grid in place and heat no longer moves one cell per iteration: it supports none of FUSED_SWAP, IN_PLACE, TEMPORAL_BLOCKING and ACTIVE_FRONTIER."
+	#endif
+	#if defined(OVERLAP) || defined(DEEP_HALO) || defined(CARTESIAN_2D) || defined(DEFERRED_CONVERGENCE) || defined(PERSISTENT_HALO) || defined(RMA_HALO) || defined(SHARED_HALO)
+		#error "RED_BLACK_SOR swaps halos after each colour: it supports none of OVERLAP, DEEP_HALO, CARTESIAN_2D, DEFERRED_CONVERGENCE, PERSISTENT_HALO, RMA_HALO and SHARED_HALO."
+	#endif
+
+	/// The colour of the cells whose row and column in the plate add up to an even number, relaxed first.
+	#define SOR_RED 0
+	/// The colour of the other cells, relaxed second.
+	#define SOR_BLACK 1
+
+	/**
+	 * @brief Gives the relaxation factor, from the setting LAPLACE_SOR_OMEGA.
+	 * @return The relaxation factor, between 0 and 2.
+	 **/
+	double get_relaxation_factor(void);
+	/**
+	 * @brief Relaxes the cells of a colour in place, and finds their largest temperature change.
+	 * @param[inout] temperature The 2D array that contains the temperatures, whose halos hold the cells of the other colour of the neighbours.
+	 * @param[in] colour The colour relaxed, SOR_RED or SOR_BLACK.
+	 * @param[in] row_offset The row, in the plate, of row 0 of \p temperature.
+	 * @param[in] omega The relaxation factor.
+	 * @param[in] dt The largest temperature change found so far.
+	 * @return The largest of \p dt and of the differences between the cells relaxed and the average of their neighbours.
+	 **/
+	double sor_sweep(double (*temperature)[COLUMNS+2], int colour, int row_offset, double omega, double dt);
+	#ifdef VERSION_RUN_IS_MPI
+		/**
+		 * @brief Swaps the outer rows of my grid with my neighbours, after a colour was relaxed.
+		 * @param[in] temperature The 2D array whose outer rows are sent.
+		 * @param[out] temperature_next The 2D array whose halos receive those of the neighbours, \p temperature itself since the grid is updated in place.
+		 **/
+		void swap_sor_halos(double (*temperature)[COLUMNS+2], double (*temperature_next)[COLUMNS+2]);
+	#endif
+#endif
+
+#endif
@@ -0,0 +1,419 @@
+/**
+ * @file stencil.c
+ **/
+
+#include "stencil.h"
+
+#ifdef ROW_KERNELS
+
+#include "util.h"
+#include <math.h> // fabs, fmax
+#include <stdint.h> // uintptr_t
+
+#ifndef SIMD_KERNELS
+	// The row kernels only stand in for the loops of RUNTIME_GRID, there are no vector kernels
+#elif defined(__x86_64__) && defined(__GNUC__) && !defined(__PGI) && !defined(__NVCOMPILER)
+	#include <immintrin.h> // _mm256_*, _mm512_*
+	// Every kernel is compiled for its own instruction set whatever the compilation flags, and picked at runtime
+	#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+	#define CPU_SUPPORTS(isa) __builtin_cpu_supports(isa)
+	#define HAVE_AVX2_KERNELS
+	#define HAVE_AVX512_KERNELS
+#else
+	// Without function-level targets, only the instruction sets enabled by the compilation flags are available
+	#define KERNEL_TARGET(isa)
+	#define CPU_SUPPORTS(isa) 1
+	#if defined(__AVX2__) || defined(__AVX512F__)
+		#include <immintrin.h> // _mm256_*, _mm512_*
+	#endif
+	#ifdef __AVX2__
+		#define HAVE_AVX2_KERNELS
+	#endif
+	#ifdef __AVX512F__
+		#define HAVE_AVX512_KERNELS
+	#endif
+#endif
+
+#ifdef SIMD_KERNELS
+	/// Tells whether the kernels write with non-temporal stores.
+	static int streaming_stores = 0;
+#endif
+
+/// Tells whether a cell is aligned on a number of bytes.
+#define IS_ALIGNED(cell, alignment) ((((uintptr_t)(cell)) % (alignment)) == 0)
+
+static void stencil_row_scalar(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count)
+{
+	for(int k = 0; k < count; k++)
+	{
+		out[k] = 0.25 * (south[k] + north[k] + centre[k+1] + centre[k-1]);
+	}
+}
+
+static double stencil_row_delta_scalar(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count, double dt)
+{
+	for(int k = 0; k < count; k++)
+	{
+		out[k] = 0.25 * (south[k] + north[k] + centre[k+1] + centre[k-1]);
+		dt = fmax(fabs(out[k]-centre[k]), dt);
+	}
+	return dt;
+}
+
+static double delta_copy_row_scalar(double* restrict last, const double* restrict current, int count, double dt)
+{
+	for(int k = 0; k < count; k++)
+	{
+		dt = fmax(fabs(current[k]-last[k]), dt);
+		last[k] = current[k];
+	}
+	return dt;
+}
+
+#ifndef SIMD_KERNELS
+// The kernels of the plates of the makefile are specialised whatever the width compiled in
+/// Number of columns of the small plate.
+#define SMALL_PLATE_COLUMNS 672
+/// Number of columns of the big plate.
+#define BIG_PLATE_COLUMNS 14560
+
+/**
+ * @brief Defines the kernels of rows of a given width, whose loops have a trip count known at compilation time.
+ * @details Rows of any other width, which ACTIVE_FRONTIER gives, go to the scalar kernels.
+ * @param[in] name The suffix of the kernels.
+ * @param[in] width The number of cells of the rows.
+ **/
+#define FIXED_WIDTH_KERNELS(name, width) \
+	static void stencil_row_##name(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count) \
+	{ \
+		if(count != (width)) \
+		{ \
+			stencil_row_scalar(out, north, centre, south, count); \
+			return; \
+		} \
+		for(int k = 0; k < (width); k++) \
+		{ \
+			out[k] = 0.25 * (south[k] + north[k] + centre[k+1] + centre[k-1]); \
+		} \
+	} \
+	static double stencil_row_delta_##name(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count, double dt) \
+	{ \
+		if(count != (width)) \
+		{ \
+			return stencil_row_delta_scalar(out, north, centre, south, count, dt); \
+		} \
+		for(int k = 0; k < (width); k++) \
+		{ \
+			out[k] = 0.25 * (south[k] + north[k] + centre[k+1] + centre[k-1]); \
+			dt = fmax(fabs(out[k]-centre[k]), dt); \
+		} \
+		return dt; \
+	} \
+	static double delta_copy_row_##name(double* restrict last, const double* restrict current, int count, double dt) \
+	{ \
+		if(count != (width)) \
+		{ \
+			return delta_copy_row_scalar(last, current, count, dt); \
+		} \
+		for(int k = 0; k < (width); k++) \
+		{ \
+			dt = fmax(fabs(current[k]-last[k]), dt); \
+			last[k] = current[k]; \
+		} \
+		return dt; \
+	}
+
+FIXED_WIDTH_KERNELS(compiled, COMPILED_COLUMNS)
+FIXED_WIDTH_KERNELS(small, SMALL_PLATE_COLUMNS)
+FIXED_WIDTH_KERNELS(big, BIG_PLATE_COLUMNS)
+#endif
+
+#if defined(HAVE_AVX2_KERNELS) || defined(HAVE_AVX512_KERNELS)
+/**
+ * @brief Number of cells to compute one at a time before the stores of a row are aligned, when streaming.
+ * @param[in] out The first cell written.
+ * @param[in] count The number of cells written.
+ * @param[in] alignment The alignment of a vector, in bytes.
+ * @return 0 if not streaming.
+ **/
+static int cells_before_alignment(const double* out, int count, int alignment)
+{
+	int peeled = 0;
+	if(streaming_stores)
+	{
+		while(peeled < count && !IS_ALIGNED(&out[peeled], alignment))
+		{
+			peeled++;
+		}
+	}
+	return peeled;
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNELS
+KERNEL_TARGET("avx2")
+static void stencil_row_avx2(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count)
+{
+	const __m256d quarter = _mm256_set1_pd(0.25);
+	int peeled = cells_before_alignment(out, count, 32);
+	stencil_row_scalar(out, north, centre, south, peeled);
+	int k = peeled;
+	for(; k + 4 <= count; k += 4)
+	{
+		__m256d sum = _mm256_add_pd(_mm256_loadu_pd(&south[k]), _mm256_loadu_pd(&north[k]));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(&centre[k+1]));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(&centre[k-1]));
+		if(streaming_stores)
+		{
+			_mm256_stream_pd(&out[k], _mm256_mul_pd(quarter, sum));
+		}
+		else
+		{
+			_mm256_storeu_pd(&out[k], _mm256_mul_pd(quarter, sum));
+		}
+	}
+	stencil_row_scalar(&out[k], &north[k], &centre[k], &south[k], count - k);
+	if(streaming_stores)
+	{
+		// Non-temporal stores are weakly ordered, make them visible before other threads read the row
+		_mm_sfence();
+	}
+}
+
+KERNEL_TARGET("avx2")
+static double stencil_row_delta_avx2(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count, double dt)
+{
+	const __m256d quarter = _mm256_set1_pd(0.25);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	__m256d dt_vector = _mm256_set1_pd(dt);
+	int peeled = cells_before_alignment(out, count, 32);
+	dt = stencil_row_delta_scalar(out, north, centre, south, peeled, dt);
+	int k = peeled;
+	for(; k + 4 <= count; k += 4)
+	{
+		__m256d sum = _mm256_add_pd(_mm256_loadu_pd(&south[k]), _mm256_loadu_pd(&north[k]));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(&centre[k+1]));
+		sum = _mm256_add_pd(sum, _mm256_loadu_pd(&centre[k-1]));
+		__m256d value = _mm256_mul_pd(quarter, sum);
+		if(streaming_stores)
+		{
+			_mm256_stream_pd(&out[k], value);
+		}
+		else
+		{
+			_mm256_storeu_pd(&out[k], value);
+		}
+		// The absolute value clears the sign bit
+		dt_vector = _mm256_max_pd(dt_vector, _mm256_andnot_pd(sign, _mm256_sub_pd(value, _mm256_loadu_pd(&centre[k]))));
+	}
+	__m128d halves = _mm_max_pd(_mm256_castpd256_pd128(dt_vector), _mm256_extractf128_pd(dt_vector, 1));
+	dt = fmax(_mm_cvtsd_f64(_mm_max_sd(halves, _mm_unpackhi_pd(halves, halves))), dt);
+	dt = stencil_row_delta_scalar(&out[k], &north[k], &centre[k], &south[k], count - k, dt);
+	if(streaming_stores)
+	{
+		// Non-temporal stores are weakly ordered, make them visible before other threads read the row
+		_mm_sfence();
+	}
+	return dt;
+}
+
+KERNEL_TARGET("avx2")
+static double delta_copy_row_avx2(double* restrict last, const double* restrict current, int count, double dt)
+{
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	__m256d dt_vector = _mm256_set1_pd(dt);
+	int peeled = cells_before_alignment(last, count, 32);
+	dt = delta_copy_row_scalar(last, current, peeled, dt);
+	int k = peeled;
+	for(; k + 4 <= count; k += 4)
+	{
+		__m256d value = _mm256_loadu_pd(&current[k]);
+		dt_vector = _mm256_max_pd(dt_vector, _mm256_andnot_pd(sign, _mm256_sub_pd(value, _mm256_loadu_pd(&last[k]))));
+		if(streaming_stores)
+		{
+			_mm256_stream_pd(&last[k], value);
+		}
+		else
+		{
+			_mm256_storeu_pd(&last[k], value);
+		}
+	}
+	__m128d halves = _mm_max_pd(_mm256_castpd256_pd128(dt_vector), _mm256_extractf128_pd(dt_vector, 1));
+	dt = fmax(_mm_cvtsd_f64(_mm_max_sd(halves, _mm_unpackhi_pd(halves, halves))), dt);
+	dt = delta_copy_row_scalar(&last[k], &current[k], count - k, dt);
+	if(streaming_stores)
+	{
+		// Non-temporal stores are weakly ordered, make them visible before other threads read the row
+		_mm_sfence();
+	}
+	return dt;
+}
+#endif
+
+#ifdef HAVE_AVX512_KERNELS
+KERNEL_TARGET("avx512f")
+static void stencil_row_avx512(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count)
+{
+	const __m512d quarter = _mm512_set1_pd(0.25);
+	int peeled = cells_before_alignment(out, count, 64);
+	stencil_row_scalar(out, north, centre, south, peeled);
+	int k = peeled;
+	for(; k + 8 <= count; k += 8)
+	{
+		__m512d sum = _mm512_add_pd(_mm512_loadu_pd(&south[k]), _mm512_loadu_pd(&north[k]));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(&centre[k+1]));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(&centre[k-1]));
+		if(streaming_stores)
+		{
+			_mm512_stream_pd(&out[k], _mm512_mul_pd(quarter, sum));
+		}
+		else
+		{
+			_mm512_storeu_pd(&out[k], _mm512_mul_pd(quarter, sum));
+		}
+	}
+	stencil_row_scalar(&out[k], &north[k], &centre[k], &south[k], count - k);
+	if(streaming_stores)
+	{
+		// Non-temporal stores are weakly ordered, make them visible before other threads read the row
+		_mm_sfence();
+	}
+}
+
+KERNEL_TARGET("avx512f")
+static double stencil_row_delta_avx512(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count, double dt)
+{
+	const __m512d quarter = _mm512_set1_pd(0.25);
+	__m512d dt_vector = _mm512_set1_pd(dt);
+	int peeled = cells_before_alignment(out, count, 64);
+	dt = stencil_row_delta_scalar(out, north, centre, south, peeled, dt);
+	int k = peeled;
+	for(; k + 8 <= count; k += 8)
+	{
+		__m512d sum = _mm512_add_pd(_mm512_loadu_pd(&south[k]), _mm512_loadu_pd(&north[k]));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(&centre[k+1]));
+		sum = _mm512_add_pd(sum, _mm512_loadu_pd(&centre[k-1]));
+		__m512d value = _mm512_mul_pd(quarter, sum);
+		if(streaming_stores)
+		{
+			_mm512_stream_pd(&out[k], value);
+		}
+		else
+		{
+			_mm512_storeu_pd(&out[k], value);
+		}
+		dt_vector = _mm512_max_pd(dt_vector, _mm512_abs_pd(_mm512_sub_pd(value, _mm512_loadu_pd(&centre[k]))));
+	}
+	dt = fmax(_mm512_reduce_max_pd(dt_vector), dt);
+	dt = stencil_row_delta_scalar(&out[k], &north[k], &centre[k], &south[k], count - k, dt);
+	if(streaming_stores)
+	{
+		// Non-temporal stores are weakly ordered, make them visible before other threads read the row
+		_mm_sfence();
+	}
+	return dt;
+}
+
+KERNEL_TARGET("avx512f")
+static double delta_copy_row_avx512(double* restrict last, const double* restrict current, int count, double dt)
+{
+	__m512d dt_vector = _mm512_set1_pd(dt);
+	int peeled = cells_before_alignment(last, count, 64);
+	dt = delta_copy_row_scalar(last, current, peeled, dt);
+	int k = peeled;
+	for(; k + 8 <= count; k += 8)
+	{
+		__m512d value = _mm512_loadu_pd(&current[k]);
+		dt_vector = _mm512_max_pd(dt_vector, _mm512_abs_pd(_mm512_sub_pd(value, _mm512_loadu_pd(&last[k]))));
+		if(streaming_stores)
+		{
+			_mm512_stream_pd(&last[k], value);
+		}
+		else
+		{
+			_mm512_storeu_pd(&last[k], value);
+		}
+	}
+	dt = fmax(_mm512_reduce_max_pd(dt_vector), dt);
+	dt = delta_copy_row_scalar(&last[k], &current[k], count - k, dt);
+	if(streaming_stores)
+	{
+		// Non-temporal stores are weakly ordered, make them visible before other threads read the row
+		_mm_sfence();
+	}
+	return dt;
+}
+#endif
+
+void (*stencil_row)(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count) = stencil_row_scalar;
+double (*stencil_row_delta)(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count, double dt) = stencil_row_delta_scalar;
+double (*delta_copy_row)(double* restrict last, const double* restrict current, int count, double dt) = delta_copy_row_scalar;
+
+void initialise_stencil_kernels(void)
+{
+	#ifdef SIMD_KERNELS
+		// The widest vectors the CPU supports
+		int widest = 1;
+		#ifdef HAVE_AVX2_KERNELS
+			if(CPU_SUPPORTS("avx2"))
+			{
+				widest = 4;
+			}
+		#endif
+		#ifdef HAVE_AVX512_KERNELS
+			if(CPU_SUPPORTS("avx512f"))
+			{
+				widest = 8;
+			}
+		#endif
+		int width = get_setting("LAPLACE_SIMD_WIDTH", widest);
+		if(width > widest)
+		{
+			width = widest;
+		}
+		streaming_stores = (get_setting("LAPLACE_STREAMING_STORES", 0) == 1);
+
+		#ifdef HAVE_AVX512_KERNELS
+			if(width >= 8)
+			{
+				stencil_row = stencil_row_avx512;
+				stencil_row_delta = stencil_row_delta_avx512;
+				delta_copy_row = delta_copy_row_avx512;
+				return;
+			}
+		#endif
+		#ifdef HAVE_AVX2_KERNELS
+			if(width >= 4)
+			{
+				stencil_row = stencil_row_avx2;
+				stencil_row_delta = stencil_row_delta_avx2;
+				delta_copy_row = delta_copy_row_avx2;
+				return;
+			}
+		#endif
+		// The scalar kernels, which never stream
+		streaming_stores = 0;
+	#else
+		// The cells are the same whichever kernels compute them, only the trip count changes
+		if(COLUMNS == COMPILED_COLUMNS)
+		{
+			stencil_row = stencil_row_compiled;
+			stencil_row_delta = stencil_row_delta_compiled;
+			delta_copy_row = delta_copy_row_compiled;
+		}
+		else if(COLUMNS == SMALL_PLATE_COLUMNS)
+		{
+			stencil_row = stencil_row_small;
+			stencil_row_delta = stencil_row_delta_small;
+			delta_copy_row = delta_copy_row_small;
+		}
+		else if(COLUMNS == BIG_PLATE_COLUMNS)
+		{
+			stencil_row = stencil_row_big;
+			stencil_row_delta = stencil_row_delta_big;
+			delta_copy_row = delta_copy_row_big;
+		}
+	#endif
+}
+
+#endif
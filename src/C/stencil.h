@@ -0,0 +1,56 @@
+/**
+ * @file stencil.h
+ * @brief This file contains the hand-vectorised row kernels used by the CPU versions with the optional mode SIMD_KERNELS.
+ * @details By default the inner loops over columns are left to the auto-vectoriser. With SIMD_KERNELS, each row is instead handed to a kernel written with AVX2 or AVX-512 intrinsics, picked at runtime among those the CPU supports by initialise_stencil_kernels(). The cells are added in the same order as the loops they replace, so that results are bit-identical. Rows are COLUMNS+2 doubles long and cannot be padded since util.c takes the grids as they are, so loads are unaligned; stores, when streaming, are aligned by computing the first cells of a row one at a time.
+ *
+ * Settings:
+ * - LAPLACE_SIMD_WIDTH: the number of doubles per vector, 1 for the scalar kernels, 4 for AVX2, 8 for AVX-512. The widest the CPU supports by default; narrower kernels are used when the width asked for is not supported.
+ * - LAPLACE_STREAMING_STORES: 1 makes the kernels write the rows computed with non-temporal stores, which bypass the caches. Worth it when the grids are much bigger than the last level cache.
+ *
+ * With RUNTIME_GRID alone, the loops call the row kernels too, so that those lost to a number of columns only known at runtime can be given back: initialise_stencil_kernels() picks kernels whose trip count is fixed at compilation time when the plate is as wide as the one compiled in, or as those of the makefile, and scalar kernels otherwise.
+ **/
+
+#ifndef STENCIL_H_INCLUDED
+#define STENCIL_H_INCLUDED
+
+#include "dimensions.h"
+
+#if defined(SIMD_KERNELS) || defined(DIMENSIONS_AT_RUNTIME)
+	/// The inner loops over columns call the row kernels below.
+	#define ROW_KERNELS
+#endif
+
+#ifdef ROW_KERNELS
+	/**
+	 * @brief Picks the kernels for the CPU, from the settings LAPLACE_SIMD_WIDTH and LAPLACE_STREAMING_STORES, or for the width of the plate with RUNTIME_GRID alone.
+	 * @pre Called once, before any kernel, after initialise_dimensions() with RUNTIME_GRID.
+	 **/
+	void initialise_stencil_kernels(void);
+	/**
+	 * @brief Averages the four neighbours of \p count consecutive cells of a row.
+	 * @details Computes out[k] = 0.25 * (south[k] + north[k] + centre[k+1] + centre[k-1]) for k in [0, count).
+	 * @param[out] out The first cell computed.
+	 * @param[in] north The cell above the first cell computed, in the grid read.
+	 * @param[in] centre The first cell computed, in the grid read.
+	 * @param[in] south The cell below the first cell computed, in the grid read.
+	 * @param[in] count The number of cells computed.
+	 **/
+	extern void (*stencil_row)(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count);
+	/**
+	 * @brief Same as stencil_row(), and finds the largest temperature change in the same sweep.
+	 * @param[in] dt The largest temperature change found so far.
+	 * @return The largest of \p dt and of the temperature changes of the cells computed.
+	 **/
+	extern double (*stencil_row_delta)(double* restrict out, const double* restrict north, const double* restrict centre, const double* restrict south, int count, double dt);
+	/**
+	 * @brief Finds the largest temperature change of \p count consecutive cells of a row, and copies them to the grid of the last iteration.
+	 * @param[inout] last The first cell, in the grid of the last iteration.
+	 * @param[in] current The first cell, in the grid of the current iteration.
+	 * @param[in] count The number of cells.
+	 * @param[in] dt The largest temperature change found so far.
+	 * @return The largest of \p dt and of the temperature changes of the cells.
+	 **/
+	extern double (*delta_copy_row)(double* restrict last, const double* restrict current, int count, double dt);
+#endif
+
+#endif
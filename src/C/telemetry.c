@@ -0,0 +1,141 @@
+/**
+ * @file telemetry.c
+ **/
+
+/// sigaction and the other POSIX functions, which strict C99 would hide.
+#define _POSIX_C_SOURCE 200809L
+
+#include "telemetry.h"
+
+#ifdef TELEMETRY
+
+#include "util.h"
+#include <stdio.h> // printf, snprintf
+#include <stdlib.h> // EXIT_FAILURE, exit, getenv, malloc, free
+#include <string.h> // memset, strcpy
+#include <signal.h> // sigaction, raise, SIG*
+#include <fcntl.h> // open, O_*
+#include <unistd.h> // write, lseek, close
+#ifdef VERSION_RUN_IS_MPI
+	#include <mpi.h> // MPI_*
+#endif
+
+struct telemetry_t telemetry;
+
+/**
+ * @brief Writes bytes to the telemetry file, however many calls it takes.
+ * @param[in] bytes The bytes to write.
+ * @param[in] size The number of bytes to write.
+ **/
+static void write_telemetry(const void* bytes, size_t size)
+{
+	const char* remaining = bytes;
+	while(size > 0)
+	{
+		ssize_t written = write(telemetry.file, remaining, size);
+		if(written <= 0)
+		{
+			return;
+		}
+		remaining += written;
+		size -= (size_t)written;
+	}
+}
+
+/**
+ * @brief Flushes the ring buffer when a signal is received, then lets the signal stop the run unless it is SIGUSR1.
+ * @param[in] signal_number The signal received.
+ **/
+static void handle_telemetry_signal(int signal_number)
+{
+	flush_telemetry();
+	if(signal_number != SIGUSR1)
+	{
+		// The default action, stopping the run, now that the records are safe
+		signal(signal_number, SIG_DFL);
+		raise(signal_number);
+	}
+}
+
+void initialise_telemetry(void)
+{
+	telemetry.rank = 0;
+	#ifdef VERSION_RUN_IS_MPI
+		MPI_Comm_rank(MPI_COMM_WORLD, &telemetry.rank);
+	#endif
+
+	telemetry.capacity = get_setting("LAPLACE_TELEMETRY_RECORDS", TELEMETRY_RECORDS);
+	telemetry.records = malloc(sizeof(struct telemetry_record_t) * telemetry.capacity);
+	const char* prefix = getenv("LAPLACE_TELEMETRY_FILE");
+	if(prefix == NULL || prefix[0] == '\0')
+	{
+		prefix = TELEMETRY_FILE;
+	}
+	char path[4096];
+	snprintf(path, sizeof(path), "%s.%d.bin", prefix, telemetry.rank);
+	telemetry.file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(telemetry.records == NULL || telemetry.file < 0)
+	{
+		printf("The telemetry buffer of %d records could not be allocated, or its file %s opened.\n", telemetry.capacity, path);
+		#ifdef VERSION_RUN_IS_MPI
+			MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+		#else
+			exit(EXIT_FAILURE);
+		#endif
+	}
+	telemetry.next = 0;
+	telemetry.appended = 0;
+	memset(telemetry.phase_seconds, 0, sizeof(telemetry.phase_seconds));
+	telemetry.started = phase_clock();
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(struct sigaction));
+	action.sa_handler = handle_telemetry_signal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	sigaction(SIGINT, &action, NULL);
+}
+
+void flush_telemetry(void)
+{
+	// Snapshot of the counters, in case the handler interrupted record_telemetry()
+	int next = telemetry.next;
+	long long appended = telemetry.appended;
+	int records = (appended < telemetry.capacity) ? (int)appended : telemetry.capacity;
+
+	struct telemetry_header_t header;
+	memset(&header, 0, sizeof(struct telemetry_header_t));
+	strcpy(header.magic, TELEMETRY_MAGIC);
+	header.rank = telemetry.rank;
+	header.phase_count = PHASE_COUNT;
+	header.record_size = sizeof(struct telemetry_record_t);
+	header.records = records;
+	header.appended = appended;
+
+	lseek(telemetry.file, 0, SEEK_SET);
+	write_telemetry(&header, sizeof(struct telemetry_header_t));
+	if(records == telemetry.capacity)
+	{
+		// The oldest records are those after the next slot
+		write_telemetry(&telemetry.records[next], sizeof(struct telemetry_record_t) * (telemetry.capacity - next));
+		write_telemetry(telemetry.records, sizeof(struct telemetry_record_t) * next);
+	}
+	else
+	{
+		write_telemetry(telemetry.records, sizeof(struct telemetry_record_t) * records);
+	}
+}
+
+void close_telemetry(void)
+{
+	signal(SIGUSR1, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	flush_telemetry();
+	close(telemetry.file);
+	free(telemetry.records);
+}
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file telemetry.h
+ * @brief This file contains the telemetry ring buffer used by the C CPU versions with the optional mode TELEMETRY.
+ * @details track_progress() only prints six cells every PRINT_FREQUENCY iterations, the rest of the convergence history is lost. With TELEMETRY, every iteration appends a record to a ring buffer allocated before the simulation: the iteration, the temperature change of the MPI process and across all of them, the time at which the iteration ended and, with PHASE_TIMERS, the time the calling thread spent in each phase during the iteration. Recording is a clock read and a few stores, there is no I/O until the buffer is flushed. Once full, the buffer keeps the latest records.
+ * The buffer is flushed to a binary file per MPI process by close_telemetry() at the end of the run, on SIGUSR1 without stopping the run, and on SIGTERM or SIGINT before the run is stopped, as when a job runs out of time. The file holds a struct telemetry_header_t followed by its records, oldest first, in the native byte order; for instance numpy.fromfile() reads them back with a dtype mirroring struct telemetry_record_t. With OVERLAP, the change across all MPI processes recorded is that of the previous iteration, whose reduction is the one complete.
+ *
+ * Settings:
+ * - LAPLACE_TELEMETRY_RECORDS: the number of records kept, TELEMETRY_RECORDS by default.
+ * - LAPLACE_TELEMETRY_FILE: the path of the files, to which ".<rank>.bin" is appended, TELEMETRY_FILE by default. Unlike the other settings, it is a string.
+ **/
+
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include "profile.h"
+
+#ifdef TELEMETRY
+	#ifndef TELEMETRY_RECORDS
+		/// Default number of records kept, enough for every iteration of a run, can be overriden with a define at compilation time.
+		#define TELEMETRY_RECORDS 4096
+	#endif
+	#ifndef TELEMETRY_FILE
+		/// Default path of the telemetry files, can be overriden with a define at compilation time.
+		#define TELEMETRY_FILE "laplace_telemetry"
+	#endif
+	/// The first bytes of a telemetry file.
+	#define TELEMETRY_MAGIC "LAPTELE"
+
+	/// What an iteration leaves in the ring buffer.
+	struct telemetry_record_t
+	{
+		/// The iteration.
+		int iteration;
+		/// Unused, keeps the times aligned.
+		int reserved;
+		/// The temperature change of my MPI process.
+		double dt;
+		/// The temperature change across all MPI processes.
+		double dt_global;
+		/// The time at which the iteration ended, in seconds since initialise_telemetry().
+		double ended;
+		/// The time spent by the calling thread in each phase during the iteration, in seconds. Zeroes unless PHASE_TIMERS is enabled.
+		double phases[PHASE_COUNT];
+	};
+
+	/// The header of a telemetry file, followed by its records.
+	struct telemetry_header_t
+	{
+		/// TELEMETRY_MAGIC, null terminated.
+		char magic[8];
+		/// The rank of the MPI process, 0 without MPI.
+		int rank;
+		/// The number of phases of a record, PHASE_COUNT.
+		int phase_count;
+		/// The size of a record, in bytes.
+		int record_size;
+		/// The number of records following the header.
+		int records;
+		/// The number of records appended since the start, those beyond the capacity of the buffer having been overwritten.
+		long long appended;
+	};
+
+	/// The ring buffer of an MPI process.
+	struct telemetry_t
+	{
+		/// The records, allocated by initialise_telemetry().
+		struct telemetry_record_t* records;
+		/// The number of records the buffer holds.
+		int capacity;
+		/// The slot of the next record.
+		int next;
+		/// The number of records appended since the start.
+		long long appended;
+		/// The time at which initialise_telemetry() was called.
+		double started;
+		/// The phase totals of the calling thread at the last record.
+		double phase_seconds[PHASE_COUNT];
+		/// The file the buffer is flushed to, open for the whole run.
+		int file;
+		/// The rank of my MPI process.
+		int rank;
+	};
+
+	/// The ring buffer of my MPI process.
+	extern struct telemetry_t telemetry;
+
+	/**
+	 * @brief Appends the record of an iteration to the ring buffer.
+	 * @param[in] iteration The iteration that just ended.
+	 * @param[in] dt The temperature change of my MPI process.
+	 * @param[in] dt_global The temperature change across all MPI processes.
+	 * @pre Called outside parallel regions, or by a single thread.
+	 **/
+	static inline void record_telemetry(int iteration, double dt, double dt_global)
+	{
+		struct telemetry_record_t* record = &telemetry.records[telemetry.next];
+		record->iteration = iteration;
+		record->reserved = 0;
+		record->dt = dt;
+		record->dt_global = dt_global;
+		record->ended = phase_clock() - telemetry.started;
+		for(int p = 0; p < PHASE_COUNT; p++)
+		{
+			#ifdef PHASE_TIMERS
+				double seconds = phase_totals[phase_thread()].seconds[p];
+				record->phases[p] = seconds - telemetry.phase_seconds[p];
+				telemetry.phase_seconds[p] = seconds;
+			#else
+				record->phases[p] = 0.0;
+			#endif
+		}
+		telemetry.next = (telemetry.next + 1 == telemetry.capacity) ? 0 : telemetry.next + 1;
+		telemetry.appended++;
+	}
+
+	/**
+	 * @brief Allocates the ring buffer, opens the file it is flushed to and installs the signal handlers that flush it.
+	 * @pre Called once, right before the simulation is timed, after initialise_phase_timers() with PHASE_TIMERS.
+	 **/
+	void initialise_telemetry(void);
+	/**
+	 * @brief Writes the ring buffer to its file, overwriting the previous flush.
+	 * @details Only calls async-signal-safe functions, so that the signal handlers can call it.
+	 **/
+	void flush_telemetry(void);
+	/**
+	 * @brief Flushes the ring buffer a last time, then closes its file and releases it.
+	 **/
+	void close_telemetry(void);
+
+	/// Appends the record of an iteration, see record_telemetry().
+	#define TELEMETRY_RECORD(iteration, dt, dt_global) record_telemetry(iteration, dt, dt_global)
+#else
+	/// Appends the record of an iteration: nothing by default.
+	#define TELEMETRY_RECORD(iteration, dt, dt_global)
+#endif
+
+#endif
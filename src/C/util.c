@@ -136,6 +136,18 @@ void print_summary(int iteration, double dt, double timer_simulation)
 	printf("Total time was %.1f seconds.\n", timer_simulation / 1000000.0f);
 }
 
+int get_setting(const char* name, int default_value)
+{
+	const char* value = getenv(name);
+	if(value == NULL)
+	{
+		return default_value;
+	}
+
+	int setting = atoi(value);
+	return setting > 0 ? setting : default_value;
+}
+
 void start_timer(double* timer)
 {
 	#ifdef VERSION_RUN_IS_MPI
@@ -6,6 +6,8 @@
 #ifndef UTIL_H_INCLUDED
 #define UTIL_H_INCLUDED
 
+#include "dimensions.h"
+
 /// Largest permitted change in temp
 #define MAX_TEMP_ERROR 0.01
 /// Max number of iterations.
@@ -13,6 +15,49 @@
 /// Number of iterations between two summary printings
 #define PRINT_FREQUENCY 100
 
+/*
+ * Optional modes, all disabled by default so that the challenge rules are respected. They are enabled at compilation
+ * time through the EXTRA_DEFINES variable of the makefile, for instance 'make EXTRA_DEFINES="-DFUSED_SWAP"'. The same
+ * macros are understood by the FORTRAN versions. See the section "Optional modes" of README.md for the full list.
+ *
+ * - ACTIVE_FRONTIER (C CPU versions only): rows are only computed where heat may have reached, see frontier.h.
+ * - ASYNC_QUEUES (OpenACC versions only): kernels and transfers run on asynchronous queues, see hybrid_gpu.c.
+ * - CARTESIAN_2D (MPI and hybrid CPU only): the plate is cut in 2D tiles instead of strips of rows, see decomposition.h.
+ * - CHECKPOINT (C MPI versions only): the plate is written every few iterations and at the end of the run in a file written
+ *   collectively through MPI-IO, from which a run can resume, see checkpoint.h.
+ * - CHECKSUM (C versions but ENSEMBLE): a decomposition-independent checksum of the whole final plate is printed after the summary and checked by verify.sh, see checksum.h.
+ * - DEEP_HALO (MPI versions only): halos are HALO_WIDTH rows deep and swapped every HALO_WIDTH iterations, see halo.h.
+ * - DEFERRED_CONVERGENCE (C MPI only): convergence is checked every few iterations, and the iterations past it are undone.
+ * - DEVICE_RESIDENT (hybrid GPU only): the grids stay on the device, only halos travel through the host.
+ * - ENSEMBLE (C serial and OpenMP only): ENSEMBLE_SIZE plates differing by their bottom boundary are stored
+ *   interleaved and solved together by a single vectorised sweep, see ensemble.h.
+ * - FUSED_SWAP: the stencil writes into the alternate grid and the temperature delta is found in the same sweep, then
+ *   both grids swap roles by pointer instead of being copied. Results are bit-identical to the reference outputs.
+ * - GPU_DIRECT (hybrid GPU only): the halos are swapped from device memory, with a CUDA-aware MPI library.
+ * - HEAP_GRIDS: the grids are allocated on the heap and first touched in parallel, see grid.h.
+ * - IN_PLACE (C serial, OpenMP and MPI only): a single grid is updated in place with a rolling window of rows, see inplace.h.
+ * - MULTI_GPU (OpenACC only): one process drives every device visible, each computing a slab of rows, see openacc.c.
+ * - OVERLAP (MPI only): the halo swap and the reduction of the temperature delta are overlapped with computation.
+ * - PERSISTENT_HALO (C MPI versions only): the halo swap uses persistent requests, created once, see halo.h.
+ * - PHASE_TIMERS (C CPU versions only): the time spent in each phase of an iteration is accumulated per thread and summarised
+ *   across MPI processes on the standard error, see profile.h.
+ * - PLACEMENT (C OpenMP, MPI and hybrid versions only): processes, threads and devices are placed after the topology of the node, read from sysfs: each MPI process
+ *   is bound to its share of the CPUs of the node, its threads pinned within it, and given the GPU of its NUMA domain, see placement.h.
+ * - RED_BLACK_SOR (C serial, OpenMP and MPI versions only): red-black successive over-relaxation replaces the Jacobi iteration, converging in far fewer iterations, see solver.h.
+ * - RMA_HALO (C MPI version only): the halo swap can put rows into the halos of the neighbours with one-sided communications, picked at runtime, see halo.h.
+ * - RUNTIME_GRID (C CPU versions only): the plate size is read at startup and shared between any number of MPI processes, see dimensions.h.
+ * - SHARED_HALO (C MPI version only): the MPI processes of a node keep their grids in a shared memory window and copy the halos of each other, see halo.h.
+ * - SIMD_KERNELS (C CPU versions only): the inner loops over columns call hand-vectorised row kernels, picked at runtime, see stencil.h.
+ * - SINGLE_PRECISION (C versions only): the grids and halo messages are float, the arithmetic stays in double, see precision.h.
+ * - TASK_GRAPH (hybrid CPU only): each iteration is a graph of OpenMP tasks run by a single long-lived team.
+ * - TELEMETRY (C CPU versions only): every iteration appends its temperature changes and timings to a ring buffer, flushed
+ *   to a binary file per MPI process at the end of the run or on a signal, see telemetry.h.
+ * - TEMPORAL_BLOCKING (OpenMP only): the grid is advanced several iterations at a time, one cache-sized tile at a time.
+ *   Results are bit-identical to the reference outputs.
+ * - TUNED_SCHEDULES (OpenACC versions only): the sweeps are explicit parallel loops with the schedule autotuned for the
+ *   device and kept in a cache, see schedule.h.
+ */
+
 /// Time taken during the entire simulation, in seconds
 double timer_simulation;
 
@@ -38,6 +83,14 @@ void track_progress(int iter, double temperature[ROWS+2][COLUMNS+2]);
  * @note This function must NOT be altered in ANY WAY.
  **/
 void print_summary(int iteration, double dt, double timer_simulation);
+/**
+ * @brief Reads an optional integer setting from the environment.
+ * @details Settings are used to tune optional modes at runtime, without recompiling.
+ * @param[in] name The name of the environment variable holding the setting.
+ * @param[in] default_value The value to use when the variable is not set or does not contain a positive integer.
+ * @return The value of the setting.
+ **/
+int get_setting(const char* name, int default_value);
 /**
  * @brief Begins the timer.
  * @details This function initialises the timer given.
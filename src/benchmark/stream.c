@@ -0,0 +1,92 @@
+/**
+ * @file stream.c
+ * @brief Measures the memory bandwidth of a node with the triad of STREAM, as the baseline against which benchmark.sh compares the bandwidth achieved by Laplace.
+ * @details a[i] = b[i] + s * c[i] over arrays much bigger than the last level cache, first touched by the threads that use them. Following STREAM, 24 bytes are counted per element, and the best of a few repetitions is kept.
+ *
+ * Settings:
+ * - LAPLACE_STREAM_ELEMENTS: the number of doubles per array, 40000000 by default (about 1 GB for the three arrays).
+ * - LAPLACE_STREAM_REPETITIONS: the number of times the triad is run, 10 by default.
+ **/
+
+#include <stdio.h> // printf
+#include <stdlib.h> // EXIT_FAILURE, malloc, free, getenv, atoi
+#include <omp.h> // omp_get_wtime, omp_get_max_threads
+
+/**
+ * @brief Reads an optional integer setting from the environment, like get_setting() of util.c.
+ * @param[in] name The name of the environment variable holding the setting.
+ * @param[in] default_value The value to use when the variable is not set or does not contain a positive integer.
+ * @return The value of the setting.
+ **/
+static long get_stream_setting(const char* name, long default_value)
+{
+	const char* value = getenv(name);
+	if(value == NULL)
+	{
+		return default_value;
+	}
+
+	long setting = atol(value);
+	return setting > 0 ? setting : default_value;
+}
+
+/**
+ * @brief Runs the triad and prints the best bandwidth observed, in GB/s.
+ **/
+int main(int argc, char* argv[])
+{
+	// We indicate that we are not going to use argc.
+	(void)argc;
+	// We indicate that we are not going to use argv.
+	(void)argv;
+
+	long elements = get_stream_setting("LAPLACE_STREAM_ELEMENTS", 40000000);
+	long repetitions = get_stream_setting("LAPLACE_STREAM_REPETITIONS", 10);
+	double* a = malloc(sizeof(double) * elements);
+	double* b = malloc(sizeof(double) * elements);
+	double* c = malloc(sizeof(double) * elements);
+	if(a == NULL || b == NULL || c == NULL)
+	{
+		printf("Could not allocate three arrays of %ld doubles.\n", elements);
+		return EXIT_FAILURE;
+	}
+
+	// First touch, with the same partition as the triad
+	#pragma omp parallel for schedule(static)
+	for(long i = 0; i < elements; i++)
+	{
+		a[i] = 0.0;
+		b[i] = 1.0;
+		c[i] = 2.0;
+	}
+
+	double best = 0.0;
+	for(long r = 0; r < repetitions; r++)
+	{
+		double start = omp_get_wtime();
+		#pragma omp parallel for schedule(static)
+		for(long i = 0; i < elements; i++)
+		{
+			a[i] = b[i] + 3.0 * c[i];
+		}
+		double seconds = omp_get_wtime() - start;
+		if(best == 0.0 || seconds < best)
+		{
+			best = seconds;
+		}
+	}
+
+	// Reading a keeps the compiler from dropping the triad
+	if(a[elements / 2] != 7.0)
+	{
+		printf("The triad gave a wrong result.\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Triad bandwidth with %d OpenMP threads was %.3f GB/s.\n", omp_get_max_threads(), 24.0 * elements / best / 1e9);
+
+	free(a);
+	free(b);
+	free(c);
+	return EXIT_SUCCESS;
+}
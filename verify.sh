@@ -45,9 +45,20 @@ clear
 # Check the number of parameters passed
 if [ "$#" -eq "1" ]; then
 	echo_success "Correct number of arguments received; file to verify is \"$1\"."
+elif [ "$#" -eq "2" ]; then
+	echo_success "Correct number of arguments received; file to verify is \"$1\", temperatures may differ by up to $2."
 else
-	echo_failure "Wrong number of arguments received: please pass the file you want to verify. Don't worry about the reference file to compare against, this script will fetch it automatically in the reference file folder."
+	echo_failure "Wrong number of arguments received: please pass the file you want to verify, optionally followed by the largest temperature difference accepted for builds that are not bit-identical, such as SINGLE_PRECISION ones. Don't worry about the reference file to compare against, this script will fetch it automatically in the reference file folder."
 fi
+error_bound=$2
+
+# Prints the temperatures of an output file, one per line: the cells tracked, the final maximum change in temperature and the halo swap verification cell
+function temperatures
+{
+	cat "$1" | grep "^ITERATION *[0-9]" | cut -d '|' -f 2- | tr '|' '\n' | tr -d ' '
+	cat "$1" | grep "iteration" | cut -d ' ' -f 11
+	cat "$1" | grep "verification" | cut -d ' ' -f 9
+}
 
 
 ####################################
@@ -88,9 +99,9 @@ else
 	echo_failure "The reference file \"${reference_file}\" could not be retrieved."
 fi
 
-# Check the numbers of line match
-number_of_lines_reference=`cat ${reference_file} | wc -l | tr -d [:space:]`
-number_of_lines_challenger=`cat ${challenger_file} | wc -l | tr -d [:space:]`
+# Check the numbers of line match, the checksum printed by CHECKSUM builds aside
+number_of_lines_reference=`cat ${reference_file} | grep -v "^Checksum" | wc -l | tr -d [:space:]`
+number_of_lines_challenger=`cat ${challenger_file} | grep -v "^Checksum" | wc -l | tr -d [:space:]`
 
 if [ "${number_of_lines_reference}" -eq "${number_of_lines_challenger}" ]; then
 	echo_success "Both files have ${number_of_lines_reference} lines."
@@ -103,6 +114,8 @@ number_iterations_reference=`cat "${reference_file}" | grep "iteration" | cut -d
 number_iterations_challenger=`cat "${challenger_file}" | grep "iteration" | cut -d ' ' -f 9`
 if [ "${number_iterations_reference}" -eq "${number_iterations_challenger}" ]; then
 	echo_success "The temperature delta triggered the threshold at iteration ${number_iterations_reference} for both."
+elif [ ! -z "${error_bound}" ]; then
+	echo_difference "The temperature delta triggered the threshold at different iterations; ${number_iterations_reference} for the reference file vs ${number_iterations_challenger} for the file to verify."
 else
 	echo_failure "The temperature delta triggered the threshold at different iterations; ${number_iterations_reference} for the reference file vs ${number_iterations_challenger} for the file to verify."
 fi
@@ -125,6 +138,39 @@ else
 	echo_difference "The halo swap verification cell values are different; ${halo_swap_verification_reference} for the reference file vs ${halo_swap_verification_challenger} for the file to verify."
 fi
 
+# Check the checksum of the whole plate, printed by CHECKSUM builds
+checksum_challenger=`cat "${challenger_file}" | grep "^Checksum" | cut -d ' ' -f 7 | tr -d ','`
+if [ ! -z "${checksum_challenger}" ]; then
+	checksum_file="reference_outputs/${language_used}/checksums.txt"
+	checksum_reference=`cat "${checksum_file}" 2>/dev/null | grep "^${version_run} " | cut -d ' ' -f 2`
+	mean_reference=`cat "${checksum_file}" 2>/dev/null | grep "^${version_run} " | cut -d ' ' -f 3`
+	mean_challenger=`cat "${challenger_file}" | grep "^Checksum" | cut -d ' ' -f 11`
+	if [ -z "${checksum_reference}" ]; then
+		echo_difference "No reference checksum of the plate for ${version_run} in \"${checksum_file}\"; the checksum is ${checksum_challenger}, the mean temperature ${mean_challenger}."
+	elif [ "${checksum_reference}" = "${checksum_challenger}" ]; then
+		echo_success "The checksum of the whole plate is ${checksum_reference} for both."
+	elif [ ! -z "${error_bound}" ]; then
+		largest_error=`awk -v reference="${mean_reference}" -v challenger="${mean_challenger}" 'BEGIN { error = reference - challenger; if(error < 0) { error = -error; } printf("%.18f", error); }'`
+		if [ $(bc <<< "${largest_error} <= ${error_bound}") -eq "1" ]; then
+			echo_success "The plate is not bit-identical, its mean temperature differs by ${largest_error}, within the bound of ${error_bound}."
+		else
+			echo_failure "The plate is not bit-identical, its mean temperature differs by ${largest_error}, beyond the bound of ${error_bound}."
+		fi
+	else
+		echo_failure "The checksums of the whole plate are different; ${checksum_reference} for the reference vs ${checksum_challenger} for the file to verify."
+	fi
+fi
+
+# Check the temperatures are within the bound
+if [ ! -z "${error_bound}" ]; then
+	largest_error=`paste <(temperatures "${reference_file}") <(temperatures "${challenger_file}") | awk '{ error = $1 - $2; if(error < 0) { error = -error; } if(error > largest) { largest = error; } } END { printf("%.18f", largest); }'`
+	if [ $(bc <<< "${largest_error} <= ${error_bound}") -eq "1" ]; then
+		echo_success "The temperatures differ by at most ${largest_error}, within the bound of ${error_bound}."
+	else
+		echo_failure "The temperatures differ by up to ${largest_error}, beyond the bound of ${error_bound}."
+	fi
+fi
+
 # Compare times
 timing_reference=`cat "${reference_file}" | grep "Total time was" | cut -d ' ' -f 4`
 timing_challenger=`cat "${challenger_file}" | grep "Total time was" | cut -d ' ' -f 4`